@@ -0,0 +1,61 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinder/Cinder.h>
+#include <cinder/Filesystem.h>
+
+#include <memory>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class MappedFile> MappedFileRef;
+
+//! Read-only memory mapping of a file.
+class MappedFile {
+  public:
+	//! Maps the file at \a path. Returns an empty reference if the file could not be opened or is empty.
+	static MappedFileRef create( const ci::fs::path &path );
+
+	explicit MappedFile( const ci::fs::path &path );
+	~MappedFile();
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile &operator=( const MappedFile & ) = delete;
+
+	//! Returns \c TRUE if the file was mapped.
+	bool isValid() const { return mData != nullptr; }
+
+	//! Returns a pointer to the contents of the file.
+	const void *getData() const { return mData; }
+	//! Returns the size of the file in bytes.
+	size_t getSize() const { return mSize; }
+
+  private:
+	const void *mData;
+	size_t      mSize;
+#if defined( CINDER_MSW )
+	void *mFile;
+	void *mMapping;
+#endif
+};
+
+} // namespace ph::warping
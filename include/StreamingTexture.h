@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinder/Vector.h>
+#include <cinder/gl/Sync.h>
+#include <cinder/gl/gl.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class StreamingTexture> StreamingTextureRef;
+
+//! Streams frames (e.g. decoded video) into a texture through a ring of pixel buffer objects, so uploads never stall the render thread.
+//! A producer thread writes directly into mapped buffer memory using lock() and unlock(). The render thread calls update() once per frame
+//! and draws the returned texture, which always contains the latest completed frame. Buffers are persistently mapped when supported.
+class StreamingTexture {
+  public:
+	class Format {
+	  public:
+		Format()
+			: mNumBuffers( 3 )
+			, mInternalFormat( GL_RGBA8 )
+			, mDataFormat( GL_BGRA )
+			, mDataType( GL_UNSIGNED_BYTE )
+			, mBytesPerPixel( 4 )
+			, mPersistent( true )
+		{
+		}
+
+		//! Set the number of pixel buffers (2-8). Defaults to 3.
+		Format &numBuffers( size_t n )
+		{
+			mNumBuffers = glm::clamp<size_t>( n, 2, 8 );
+			return *this;
+		}
+		//! Set the internal format of the texture. Defaults to GL_RGBA8.
+		Format &internalFormat( GLint internalFormat )
+		{
+			mInternalFormat = internalFormat;
+			return *this;
+		}
+		//! Set the layout of the frames written by the producer. Defaults to GL_BGRA, GL_UNSIGNED_BYTE, 4 bytes per pixel.
+		Format &dataFormat( GLenum dataFormat, GLenum dataType, size_t bytesPerPixel )
+		{
+			mDataFormat = dataFormat;
+			mDataType = dataType;
+			mBytesPerPixel = bytesPerPixel;
+			return *this;
+		}
+		//! Enables or disables persistent mapping, if the driver supports it. Defaults to \c TRUE.
+		Format &persistent( bool enabled = true )
+		{
+			mPersistent = enabled;
+			return *this;
+		}
+
+		size_t getNumBuffers() const { return mNumBuffers; }
+		GLint  getInternalFormat() const { return mInternalFormat; }
+		GLenum getDataFormat() const { return mDataFormat; }
+		GLenum getDataType() const { return mDataType; }
+		size_t getBytesPerPixel() const { return mBytesPerPixel; }
+		bool   isPersistent() const { return mPersistent; }
+
+	  private:
+		size_t mNumBuffers;
+		GLint  mInternalFormat;
+		GLenum mDataFormat;
+		GLenum mDataType;
+		size_t mBytesPerPixel;
+		bool   mPersistent;
+	};
+
+	//! Creates a streaming texture. Must be called on the render thread.
+	static StreamingTextureRef create( int width, int height, const Format &format = Format() ) { return std::make_shared<StreamingTexture>( width, height, format ); }
+
+	StreamingTexture( int width, int height, const Format &format = Format() );
+	~StreamingTexture();
+
+	StreamingTexture( const StreamingTexture & ) = delete;
+	StreamingTexture( StreamingTexture && ) = delete;
+	StreamingTexture &operator=( const StreamingTexture & ) = delete;
+	StreamingTexture &operator=( StreamingTexture && ) = delete;
+
+	//! Returns the width of a frame in pixels.
+	int getWidth() const { return mWidth; }
+	//! Returns the height of a frame in pixels.
+	int getHeight() const { return mHeight; }
+	//! Returns the number of bytes per row of a frame.
+	size_t getStride() const { return mWidth * mFormat.getBytesPerPixel(); }
+	//! Returns the number of bytes of a frame.
+	size_t getDataSize() const { return getStride() * mHeight; }
+	//! Returns \c TRUE if the pixel buffers are persistently mapped.
+	bool isPersistentlyMapped() const { return mIsPersistent; }
+
+	//! Producer thread: returns memory to write the next frame to, or \c nullptr if all buffers are in use (the frame is dropped).
+	uint8_t *lock();
+	//! Producer thread: publishes the frame written since lock(). A published frame that was not uploaded yet is dropped.
+	void unlock();
+	//! Producer thread: convenience function that copies a complete frame. Returns \c FALSE if the frame was dropped.
+	bool write( const void *data );
+
+	//! Render thread: uploads the latest published frame, if any, and returns the texture containing the latest completed frame.
+	const ci::gl::Texture2dRef &update();
+	//! Render thread: returns the texture containing the latest completed frame. May be empty before the first frame.
+	const ci::gl::Texture2dRef &getTexture() const { return mTexture; }
+
+	//! Returns the number of frames that were uploaded.
+	uint64_t getNumUploadedFrames() const { return mNumUploaded; }
+	//! Returns the number of frames that were never uploaded, because no buffer was available or a newer frame replaced them.
+	uint64_t getNumDroppedFrames() const { return mNumDropped; }
+	//! Returns the number of times update() found no new frame, so the previous frame was shown again.
+	uint64_t getNumLateFrames() const { return mNumLate; }
+
+  private:
+	enum class State { FREE, WRITING, READY, CURRENT, RETIRED };
+
+	struct Buffer {
+		GLuint               pbo{ 0 };
+		uint8_t *            mapped{ nullptr };
+		ci::gl::Texture2dRef texture;
+		ci::gl::SyncRef      fence;
+		State                state{ State::FREE };
+		uint64_t             sequence{ 0 };
+	};
+
+	//! Maps a buffer for writing (render thread).
+	void map( Buffer &buffer );
+	//! Uploads the contents of a buffer to its texture (render thread).
+	void upload( Buffer &buffer );
+
+	int    mWidth;
+	int    mHeight;
+	Format mFormat;
+	bool   mIsPersistent;
+
+	//! Guards the state of the buffers, which is shared between the producer and render thread.
+	std::mutex          mMutex;
+	std::vector<Buffer> mBuffers;
+	size_t              mWriting;
+	uint64_t            mSequence;
+
+	ci::gl::Texture2dRef mTexture;
+
+	std::atomic<uint64_t> mNumUploaded;
+	std::atomic<uint64_t> mNumDropped;
+	std::atomic<uint64_t> mNumLate;
+};
+
+} // namespace ph::warping
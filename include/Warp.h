@@ -26,9 +26,20 @@
 #include <cinder/Matrix.h>
 #include <cinder/Rect.h>
 #include <cinder/Vector.h>
+#include <cinder/gl/Sync.h>
 #include <cinder/gl/gl.h>
 
+#include "WarpCanvas.h"
+#include "WarpMeshLru.h"
+#include "WarpResidualGrid.h"
+
 #include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 // forward declarations
@@ -58,10 +69,213 @@ typedef WarpList::const_iterator         WarpConstIter;
 typedef WarpList::reverse_iterator       WarpReverseIter;
 typedef WarpList::const_reverse_iterator WarpConstReverseIter;
 
+//! Uniform grid over the screen space control points of a list of warps, used to quickly find the closest control point.
+class ControlPointIndex {
+  public:
+	explicit ControlPointIndex( float cellSize = 64.0f )
+		: mCellSize( cellSize )
+		, mMin( 0 )
+		, mMax( -1 )
+	{
+	}
+
+	//! Updates the index. Only warps that were changed, added or moved within the list since the last update are inserted again.
+	void update( const WarpList &warps );
+	//! Removes all control points from the index.
+	void clear();
+
+	//! Finds the control point closest to \a pos. On a tie, the last warp and then the lowest control point index wins, just like a linear search.
+	//! Returns \c FALSE if the index is empty.
+	bool findClosest( const ci::vec2 &pos, size_t *warp, unsigned *index, float *distance ) const;
+
+	//! Returns the size in pixels of a grid cell.
+	float getCellSize() const { return mCellSize; }
+	//! Sets the size in pixels of a grid cell. Clears the index.
+	void setCellSize( float size );
+
+  private:
+	struct Entry {
+		ci::vec2 position;
+		uint32_t warp;
+		uint32_t index;
+	};
+
+	struct Slot {
+		std::weak_ptr<Warp>   warp;
+		uint64_t              revision{ 0 };
+		std::vector<ci::vec2> points;
+	};
+
+	ci::ivec2 getCell( const ci::vec2 &pos ) const;
+	uint64_t  getKey( const ci::ivec2 &cell ) const { return ( uint64_t( uint32_t( cell.x ) ) << 32 ) | uint32_t( cell.y ); }
+
+	void insert( uint32_t slot );
+	void remove( uint32_t slot );
+
+	float mCellSize;
+	//! Range of cells that contain control points.
+	ci::ivec2 mMin;
+	ci::ivec2 mMax;
+
+	std::vector<Slot>                                mSlots;
+	std::unordered_map<uint64_t, std::vector<Entry>> mCells;
+};
+
+// ----------------------------------------------------------------------------------------------------------------
+
+typedef std::shared_ptr<class WarpContext> WarpContextRef;
+
+//! Owns the state shared by a set of warps: edit and gamma mode, input handling, control point rendering and shaders.
+//! Warps in different contexts don't affect each other, so each context can be used by its own window and render thread.
+class WarpContext {
+  public:
+	static WarpContextRef create() { return std::make_shared<WarpContext>(); }
+	//! Returns the default context, which is used by all warps unless they are assigned another one.
+	static const WarpContextRef &getDefault();
+	//! Returns the context of a list of warps, which should all share the same context. Returns the default context if the list is empty.
+	static const WarpContextRef &get( const WarpList &warps );
+
+	WarpContext();
+	~WarpContext();
+
+	WarpContext( const WarpContext & ) = delete;
+	WarpContext( WarpContext && ) = delete;
+	WarpContext &operator=( const WarpContext & ) = delete;
+	WarpContext &operator=( WarpContext && ) = delete;
+
+	//! Returns \c TRUE if edit mode is enabled.
+	bool isEditModeEnabled() const { return mIsEditMode; }
+	//! Enables or disables edit mode.
+	void enableEditMode( bool enabled = true ) { mIsEditMode = enabled; }
+	//! Toggles edit mode.
+	void toggleEditMode()
+	{
+		bool exp = mIsEditMode;
+		mIsEditMode.compare_exchange_strong( exp, !exp );
+	}
+
+	//! Returns \c TRUE if gamma mode is enabled. If enabled, renders a gamma correction test image instead of the content.
+	bool isGammaModeEnabled() const { return mIsGammaMode; }
+	//! Enables or disables gamma mode.
+	void enableGammaMode( bool enabled = true ) { mIsGammaMode = enabled; }
+	//! Toggles gamma mode.
+	void toggleGammaMode()
+	{
+		bool exp = mIsGammaMode;
+		mIsGammaMode.compare_exchange_strong( exp, !exp );
+	}
+
+	//! Returns \c TRUE if control points are deferred until flushControlPoints() is called.
+	bool isDeferredControlPointsEnabled() const { return mIsDeferredControlPoints; }
+	//! Enables or disables deferred control points.
+	void enableDeferredControlPoints( bool enabled = true ) { mIsDeferredControlPoints = enabled; }
+	//! Queues a control point.
+	void queueControlPoint( const ci::vec2 &pt, const ci::vec4 &color, float scale );
+	//! Draws the queued control points of all warps using a single instanced draw call.
+	void flushControlPoints();
+
+	//! Returns \c TRUE if mouse moves, drags and cursor key nudges are applied once per frame by processInput().
+	bool isInputCoalescingEnabled() const { return mIsInputCoalescing; }
+	//! Enables or disables input coalescing.
+	void enableInputCoalescing( bool enabled = true ) { mIsInputCoalescing = enabled; }
+
+	//! Returns the index used to find the closest control point.
+	ControlPointIndex &getControlPointIndex() { return mControlPointIndex; }
+	//! Returns the cache of evaluated meshes shared by the warps of this context.
+	WarpMeshLru &getMeshLru() { return mMeshLru; }
+	//! Returns \c TRUE while a control point is being dragged. The intermediate meshes of a drag are not cached.
+	bool isDragging() const { return mIsDragging; }
+
+	//! Returns a shader shared by the warps of this context, compiling it from \a format the first time it is requested. A shader that
+	//! fails to compile is logged once and returned as an empty reference from then on.
+	ci::gl::GlslProgRef getShader( const std::string &name, const ci::gl::GlslProg::Format &format );
+
+  private:
+	//! Instanced control points.
+	struct ControlPoint {
+		ci::vec2 position{ 0 };
+		float    scale{ 1 };
+		float    reserved{ 0 };
+		ci::vec4 color{ 1 };
+
+		ControlPoint() = default;
+		ControlPoint( const ci::vec2 &pt, const ci::vec4 &clr, float scale )
+			: position( pt )
+			, scale( scale )
+			, reserved( 0 )
+			, color( clr )
+		{
+		}
+	};
+
+	std::atomic<bool> mIsEditMode;
+	std::atomic<bool> mIsGammaMode;
+
+	//! Initial capacity of the instance buffer, which grows as needed.
+	static const size_t kInitialInstanceCapacity = 1024;
+
+	//! Control points of all warps, drawn using a single instanced batch.
+	std::vector<ControlPoint> mControlPoints;
+	ci::gl::VboRef            mInstanceDataVbo;
+	size_t                    mInstanceDataCapacity;
+	ci::gl::BatchRef          mInstancedBatch;
+	bool                      mIsDeferredControlPoints;
+
+	//! Last mouse move or drag, and the sum of the cursor key nudges in pixels, since the previous call to Warp::processInput().
+	bool                                 mIsInputCoalescing;
+	std::unique_ptr<ci::app::MouseEvent> mPendingMouseMove;
+	std::unique_ptr<ci::app::MouseEvent> mPendingMouseDrag;
+	ci::vec2                             mPendingNudge;
+	bool                                 mIsDragging;
+
+	ControlPointIndex                          mControlPointIndex;
+	WarpMeshLru                                mMeshLru;
+	std::map<std::string, ci::gl::GlslProgRef> mShaders;
+
+	friend class Warp;
+};
+
 class Warp : public std::enable_shared_from_this<Warp> {
   public:
 	enum class WarpType { UNKNOWN, BILINEAR, PERSPECTIVE, PERSPECTIVE_BILINEAR };
 	enum class PrimitiveType { TRIANGLES, TRIANGLE_STRIP };
+	enum class YuvColorSpace { REC601, REC709, REC601_FULL_RANGE, REC709_FULL_RANGE };
+
+	//! Snapshot of the settings of a warp. Can be built on any thread and handed to the render thread using publishState().
+	struct State {
+		WarpType type{ WarpType::UNKNOWN };
+		size_t   controlsX{ 2 };
+		size_t   controlsY{ 2 };
+		//! Control points as stored by the warp (column-major), see toXml().
+		std::vector<ci::vec2> points;
+		float                 brightness{ 1 };
+
+		//! Edge blending parameters.
+		ci::vec3 luminance{ 0.5f };
+		ci::vec3 gamma{ 1 };
+		ci::vec4 edges{ 0, 0, 1, 1 };
+		float    exponent{ 2 };
+
+		//! Bilinear and perspective-bilinear warps only.
+		int  resolution{ 16 };
+		bool linear{ false };
+		bool adaptive{ false };
+
+		//! Perspective-bilinear warps only: the corners of the perspective warp.
+		std::vector<ci::vec2> corners;
+
+		//! Bilinear and perspective-bilinear warps only: fine corrections on top of the control points, or an empty reference.
+		WarpResidualGridConstRef residuals;
+
+		bool operator==( const State &other ) const
+		{
+			return type == other.type && controlsX == other.controlsX && controlsY == other.controlsY && points == other.points && brightness == other.brightness
+			       && luminance == other.luminance && gamma == other.gamma && edges == other.edges && exponent == other.exponent && resolution == other.resolution
+			       && linear == other.linear && adaptive == other.adaptive && corners == other.corners
+			       && ( residuals == other.residuals || ( residuals && other.residuals && *residuals == *other.residuals ) );
+		}
+		bool operator!=( const State &other ) const { return !( *this == other ); }
+	};
 
 	explicit Warp( WarpType type = WarpType::UNKNOWN );
 	virtual ~Warp() = default;
@@ -72,31 +286,42 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	Warp &operator=( const Warp & ) = delete;
 	Warp &operator=( Warp && ) = delete;
 
-	//! Returns \c TRUE if edit mode is enabled.
-	static bool isEditModeEnabled() { return bool( sIsEditMode ); };
-	//! Enables or disables edit mode.
-	static void enableEditMode( bool enabled = true ) { sIsEditMode = enabled; };
-	//! Disables edit mode.
-	static void disableEditMode() { sIsEditMode = false; };
-	//! Toggles edit mode.
-	static void toggleEditMode()
-	{
-		bool exp = bool( sIsEditMode );
-		sIsEditMode.compare_exchange_strong( exp, !bool( sIsEditMode ) );
-	};
-
-	//! Returns \c TRUE if gamma mode is enabled. If enabled, renders a gamma correction test image instead of the content.
-	static bool isGammaModeEnabled() { return bool( sIsGammaMode ); };
-	//! Enables or disables gamma mode. If enabled, renders a gamma correction test image instead of the content.
-	static void enableGammaMode( bool enabled = true ) { sIsGammaMode = enabled; };
-	//! Disables gamma mode.
-	static void disableGammaMode() { sIsGammaMode = false; };
-	//! Toggles gamma mode. If enabled, renders a gamma correction test image instead of the content.
-	static void toggleGammaMode()
-	{
-		bool exp = bool( sIsGammaMode );
-		sIsGammaMode.compare_exchange_strong( exp, !bool( sIsGammaMode ) );
-	};
+	//! Returns \c TRUE if edit mode is enabled for the default context.
+	static bool isEditModeEnabled() { return WarpContext::getDefault()->isEditModeEnabled(); };
+	//! Enables or disables edit mode for the default context.
+	static void enableEditMode( bool enabled = true ) { WarpContext::getDefault()->enableEditMode( enabled ); };
+	//! Disables edit mode for the default context.
+	static void disableEditMode() { WarpContext::getDefault()->enableEditMode( false ); };
+	//! Toggles edit mode for the default context.
+	static void toggleEditMode() { WarpContext::getDefault()->toggleEditMode(); };
+
+	//! Returns \c TRUE if gamma mode is enabled for the default context. If enabled, renders a gamma correction test image instead of the content.
+	static bool isGammaModeEnabled() { return WarpContext::getDefault()->isGammaModeEnabled(); };
+	//! Enables or disables gamma mode for the default context. If enabled, renders a gamma correction test image instead of the content.
+	static void enableGammaMode( bool enabled = true ) { WarpContext::getDefault()->enableGammaMode( enabled ); };
+	//! Disables gamma mode for the default context.
+	static void disableGammaMode() { WarpContext::getDefault()->enableGammaMode( false ); };
+	//! Toggles gamma mode for the default context. If enabled, renders a gamma correction test image instead of the content.
+	static void toggleGammaMode() { WarpContext::getDefault()->toggleGammaMode(); };
+
+	//! Returns \c TRUE if control points are deferred. If enabled, all warps queue their control points and flushControlPoints() draws them at once.
+	static bool isDeferredControlPointsEnabled() { return WarpContext::getDefault()->isDeferredControlPointsEnabled(); }
+	//! Enables or disables deferred control points. If enabled, call flushControlPoints() after drawing the last warp.
+	static void enableDeferredControlPoints( bool enabled = true ) { WarpContext::getDefault()->enableDeferredControlPoints( enabled ); }
+	//! Draws the queued control points of all warps of the default context using a single instanced draw call.
+	static void flushControlPoints() { WarpContext::getDefault()->flushControlPoints(); }
+
+	//! Returns \c TRUE if input coalescing is enabled. If enabled, mouse moves, drags and cursor key nudges are applied once per frame.
+	static bool isInputCoalescingEnabled() { return WarpContext::getDefault()->isInputCoalescingEnabled(); }
+	//! Enables or disables input coalescing. If enabled, call processInput() once per frame before drawing the warps.
+	static void enableInputCoalescing( bool enabled = true ) { WarpContext::getDefault()->enableInputCoalescing( enabled ); }
+	//! Applies pending mouse input to the warps. Other events apply pending input first, so the order of events is preserved.
+	static void processInput( WarpList &warps );
+
+	//! Returns the context of this warp.
+	const WarpContextRef &getContext() const { return mContext; }
+	//! Assigns the warp to another context, or to the default context if \a context is empty. Call this before drawing the warp.
+	virtual void setContext( const WarpContextRef &context ) { mContext = context ? context : WarpContext::getDefault(); }
 
 	//! Returns the type of the warp.
 	WarpType getType() const { return mType; };
@@ -113,6 +338,13 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	//!
 	virtual void fromXml( const ci::XmlTree &xml );
 
+	//! Returns a snapshot of the settings of the warp.
+	virtual State getState() const;
+	//! Applies a snapshot on the render thread. Ignored if its type does not match. Only invalidates the warp if its geometry changed.
+	virtual void setState( const State &state );
+	//! Publishes a snapshot from any thread, without blocking the render thread. The latest snapshot is applied by begin() or draw(), never in between begin() and end().
+	void publishState( const State &state );
+
 	//! Get the width of the content in pixels.
 	float getWidth() const { return mWidth; };
 	//! Get the height of the content in pixels.
@@ -133,31 +365,55 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	//! Returns the luminance value for the red, green and blue channels, used for edge blending (0.5 = linear).
 	virtual const ci::vec3 &getLuminance() const { return mLuminance; }
 	//! Set the luminance value for all color channels, used for edge blending (0.5 = linear).
-	virtual void setLuminance( float gamma ) { mLuminance = ci::vec3( gamma ); }
+	virtual void setLuminance( float gamma )
+	{
+		mLuminance = ci::vec3( gamma );
+		++mBlendRevision;
+	}
 	//! Set the luminance value for the red, green and blue channels, used for edge blending (0.5 = linear).
 	virtual void setLuminance( float red, float green, float blue )
 	{
 		mLuminance.r = red;
 		mLuminance.g = green;
 		mLuminance.b = blue;
+		++mBlendRevision;
 	}
 
 	//! Returns the gamma curve value for the red, green and blue channels.
 	virtual const ci::vec3 &getGamma() const { return mGamma; }
 	//! Set the gamma curve value for all color channels. Gamma only affects edge blending, it does not alter the content.
-	virtual void setGamma( float gamma ) { mGamma = ci::vec3( gamma ); }
+	virtual void setGamma( float gamma )
+	{
+		mGamma = ci::vec3( gamma );
+		++mBlendRevision;
+	}
 	//! Set the gamma curve value for the red, green and blue channels.
 	virtual void setGamma( float red, float green, float blue )
 	{
 		mGamma.r = red;
 		mGamma.g = green;
 		mGamma.b = blue;
+		++mBlendRevision;
 	}
 
 	//! Returns the edge blending curve exponent (1.0 = linear, 2.0 = quadratic).
 	virtual float getExponent() const { return mExponent; }
 	//! Set the edge blending curve exponent  (1.0 = linear, 2.0 = quadratic).
-	virtual void setExponent( float e ) { mExponent = glm::clamp( e, 1.0f, 100.0f ); }
+	virtual void setExponent( float e )
+	{
+		mExponent = glm::clamp( e, 1.0f, 100.0f );
+		++mBlendRevision;
+	}
+
+	//! Returns the brightness of the content.
+	float getBrightness() const { return mBrightness; }
+	//! Sets the brightness of the content.
+	void setBrightness( float brightness )
+	{
+		mBrightness = brightness;
+		++mBlendRevision;
+	}
+
 	//! Returns the edge blending area for the left, top, right and bottom edges (values between 0 and 1).
 	virtual ci::vec4 getEdges() const { return ci::vec4( mEdges.x, mEdges.y, 1.0f - mEdges.z, 1.0f - mEdges.w ); }
 	//! Set the edge blending area for the left, top, right and bottom edges (values between 0 and 1).
@@ -167,6 +423,7 @@ class Warp : public std::enable_shared_from_this<Warp> {
 		mEdges.y = glm::clamp( top, 0.0f, 1.0f );
 		mEdges.z = glm::clamp( 1.0f - right, 0.0f, 1.0f );
 		mEdges.w = glm::clamp( 1.0f - bottom, 0.0f, 1.0f );
+		++mBlendRevision;
 	}
 	//! Set the edge blending area for the left, top, right and bottom edges (values between 0 and 1).
 	virtual void setEdges( const ci::vec4 &edges )
@@ -175,10 +432,16 @@ class Warp : public std::enable_shared_from_this<Warp> {
 		mEdges.y = glm::clamp( edges.y, 0.0f, 1.0f );
 		mEdges.z = glm::clamp( 1.0f - edges.z, 0.0f, 1.0f );
 		mEdges.w = glm::clamp( 1.0f - edges.w, 0.0f, 1.0f );
+		++mBlendRevision;
 	}
 
 	//! Reset control points to undistorted image.
 	virtual void reset() = 0;
+	//! Performs the CPU work needed before drawing, like computing the mesh. Can be called from any thread, as long as the warp is
+	//! not used elsewhere in the meantime.
+	virtual void prepare() {}
+	//! Creates the shaders and uploads the mesh, so the first draw doesn't have to. Call this on the render thread.
+	virtual void upload() {}
 	//! Setup the warp before drawing its contents.
 	virtual void begin() = 0;
 	//! Restore the warp after drawing.
@@ -190,18 +453,51 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	void draw( const ci::gl::Texture2dRef &texture, const ci::Area &srcArea );
 	//! Draws a specific area of a warped texture to a specific region.
 	virtual void draw( const ci::gl::Texture2dRef &texture, const ci::Area &srcArea, const ci::Rectf &destRect ) = 0;
+	//! Draws a warped NV12 image, provided as a luma texture (red channel) and a half resolution chroma texture (red and green channels).
+	void draw( const ci::gl::Texture2dRef &luma, const ci::gl::Texture2dRef &chroma );
+	//! Draws a specific area (in luma pixels) of a warped NV12 image.
+	void draw( const ci::gl::Texture2dRef &luma, const ci::gl::Texture2dRef &chroma, const ci::Area &srcArea );
+	//! Draws a specific area of a warped NV12 image to a specific region. Converts to RGB in the warp shader, so no separate conversion pass is needed.
+	virtual void draw( const ci::gl::Texture2dRef &luma, const ci::gl::Texture2dRef &chroma, const ci::Area &srcArea, const ci::Rectf &destRect ) = 0;
+	//! Set the color space used to convert YUV content to RGB.
+	void setYuvColorSpace( YuvColorSpace colorSpace ) { mYuvColorSpace = colorSpace; }
+	//! Returns the color space used to convert YUV content to RGB.
+	YuvColorSpace getYuvColorSpace() const { return mYuvColorSpace; }
+	//! Draws a warped canvas.
+	void draw( const WarpCanvasRef &canvas );
+	//! Draws a specific area of a warped canvas. Only the tiles overlapping the area are referenced and sampled.
+	virtual void draw( const WarpCanvasRef &canvas, const ci::Area &srcArea ) = 0;
 
 	//! Adjusts both the source area and destination rectangle so that they are clipped against the warp's content.
 	bool clip( ci::Area &srcArea, ci::Rectf &destRect ) const;
 
+	//! Returns a number that changes whenever the control points or the size of the warp change.
+	virtual uint64_t getRevision() const { return mRevision; }
+	//! Returns a number that changes whenever the brightness or the blend parameters change.
+	uint64_t getBlendRevision() const { return mBlendRevision; }
+	//! Returns \c TRUE if the warp has to be rebuilt before it is drawn.
+	bool isDirty() const { return mIsDirty; }
+
 	//! Returns the coordinates of the specified control point.
 	virtual ci::vec2 getControlPoint( unsigned index ) const;
 	//! Sets the coordinates of the specified control point.
 	virtual void setControlPoint( unsigned index, const ci::vec2 &pos );
 	//! Moves the specified control point.
 	virtual void moveControlPoint( unsigned index, const ci::vec2 &shift );
+	//! Moves the selected control point by \a pixels, like the cursor keys do in edit mode. Returns \c FALSE if no control point is selected.
+	virtual bool nudgeControlPoint( const ci::vec2 &pixels );
+	//! Sets the coordinates of the first \a count control points, in the same order as getControlPoint(). Invalidates the warp only once.
+	virtual void setControlPoints( const ci::vec2 *points, size_t count );
+	//! Sets the coordinates of the control points, in the same order as getControlPoint(). Invalidates the warp only once.
+	void setControlPoints( const std::vector<ci::vec2> &points ) { setControlPoints( points.data(), points.size() ); }
+	//! Transforms all control points in normalized screen space, using homogeneous coordinates. Invalidates the warp only once.
+	virtual void transformControlPoints( const ci::mat3 &transform );
 	//! Get the number of control points.
 	virtual size_t getNumControlPoints() const { return mPoints.size(); }
+	//! Get the number of horizontal control points.
+	size_t getNumControlsX() const { return mControlsX; }
+	//! Get the number of vertical control points.
+	size_t getNumControlsY() const { return mControlsY; }
 	//! Get the index of the currently selected control point.
 	virtual unsigned int getSelectedControlPoint() const { return mSelected; }
 	//! Select one of the control points.
@@ -223,10 +519,18 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	//! Draw a control point in the specified color.
 	void queueControlPoint( const ci::vec2 &pt, const ci::Color &clr, float scale = 1.0f );
 
-	//! Read a settings xml file and pass back a vector of Warps.
+	//! Creates a warp of the given type. Returns an empty reference if the type is unknown.
+	static WarpRef create( WarpType type );
+	//! Read a settings xml file and pass back a vector of Warps. Errors are written to the console, see WarpXmlReader.
 	static WarpList readSettings( const ci::DataSourceRef &source );
 	//! Write a settings xml file.
 	static void writeSettings( const WarpList &warps, const ci::DataTargetRef &target );
+	//! Creates a profile element containing a map for each warp.
+	static ci::XmlTree createProfileXml( const WarpList &warps, const std::string &name = "default" );
+	//! Read a binary settings file and pass back a vector of Warps. Files are memory-mapped when possible. Returns an empty vector if the file is invalid.
+	static WarpList readBinarySettings( const ci::DataSourceRef &source );
+	//! Write a binary settings file, see WarpBinary.h. Converting between the xml and binary formats is lossless.
+	static void writeBinarySettings( const WarpList &warps, const ci::DataTargetRef &target );
 
 	//! Handles mouseMove events for multiple warps.
 	static bool handleMouseMove( WarpList &warps, ci::app::MouseEvent &event );
@@ -257,16 +561,40 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	virtual void resize();
 	virtual void resize( const ci::ivec2 &size );
 
+	//! Allow ControlPointIndex to access the screen space control points.
+	friend class ControlPointIndex;
+	friend class WarpContext;
+
   protected:
 	//! Draw the warp and its editing interface.
 	virtual void draw( bool controls = true ) = 0;
-	//! Draw the control points.
+	//! Draw the control points, unless they are deferred.
 	void drawControlPoints();
+	//! Marks the warp for reconstruction.
+	void invalidate()
+	{
+		mIsDirty = true;
+		++mRevision;
+	}
+	//! Sets the uniforms that convert YUV to RGB.
+	void setYuvUniforms( const ci::gl::GlslProgRef &shader ) const;
+	//! Applies the latest published snapshot, if any. Call this once per frame, from begin() and the draw functions. Snapshots are
+	//! not applied between begin() and end(). Returns \c TRUE if the warp was updated.
+	bool applyPublishedState();
+	//! Formats a value for xml with enough digits to read it back exactly.
+	static std::string formatFloat( float value );
+	//! Returns the distance in pixels a cursor key moves the selected control point, or zero for other keys.
+	static ci::vec2 getNudge( const ci::app::KeyEvent &event );
 
   protected:
-	WarpType mType;
+	WarpType       mType;
+	WarpContextRef mContext;
 
 	bool     mIsDirty;
+	uint64_t mRevision;
+	uint64_t mBlendRevision;
+	//! Set by begin() and cleared by end().
+	bool     mIsInFrame;
 	float    mWidth;
 	float    mHeight;
 	ci::vec2 mWindowSize;
@@ -285,40 +613,27 @@ class Warp : public std::enable_shared_from_this<Warp> {
 	ci::vec4 mEdges;
 	float    mExponent;
 
+	//! Color space of YUV content.
+	YuvColorSpace mYuvColorSpace;
+
+	//! Triple buffer of published snapshots. The render thread owns the front and publishers own the back.
+	State                 mStates[3];
+	unsigned              mStateFront;
+	unsigned              mStateBack;
+	std::atomic<unsigned> mStateMiddle;
+	//! Serializes publishers, the render thread never takes this lock.
+	std::mutex mPublishMutex;
+
 	//! Time of last control point selection.
 	double mSelectedTime;
 	//! Keep track of mouse position.
 	mutable ci::ivec2 mMouse;
 
+	//! Maximum number of control points of a warp grid.
 	static const int MAX_NUM_CONTROL_POINTS = 1024;
 
   private:
-	//! Instanced control points.
-	typedef struct Data {
-		ci::vec2 position{ 0 };
-		float    scale{ 1 };
-		float    reserved{ 0 };
-		ci::vec4 color{ 1 };
-
-		Data() = default;
-		Data( const ci::vec2 &pt, const ci::vec4 &clr, float scale )
-			: position( pt )
-			, scale( scale )
-			, reserved( 0 )
-			, color( clr )
-		{
-		}
-	} Data;
-
-	ci::vec2          mOffset;
-	std::vector<Data> mControlPoints;
-	ci::gl::VboRef    mInstanceDataVbo;
-	ci::gl::BatchRef  mInstancedBatch;
-
-	//! Edit mode for all warps.
-	static std::atomic<bool> sIsEditMode;
-	//! Gamma mode for all warps.
-	static std::atomic<bool> sIsGammaMode;
+	ci::vec2 mOffset;
 };
 
 // ----------------------------------------------------------------------------------------------------------------
@@ -350,11 +665,18 @@ class WarpBilinear : public Warp {
 	//!
 	void fromXml( const ci::XmlTree &xml ) override;
 
+	//! Returns a snapshot of the settings of the warp.
+	State getState() const override;
+	//! Applies a snapshot on the render thread. Only invalidates the warp if its geometry changed.
+	void setState( const State &state ) override;
+	//! Assigns the warp to another context. Shaders, buffers and frame buffers are recreated for the new context.
+	void setContext( const WarpContextRef &context ) override;
+
 	//! Set the width and height of the content in pixels.
 	bool setSize( float w, float h ) override
 	{
 		if( Warp::setSize( w, h ) ) {
-			mFbo.reset();
+			releaseFbos();
 			return true;
 		}
 
@@ -364,23 +686,60 @@ class WarpBilinear : public Warp {
 	void setFormat( const ci::gl::Fbo::Format &format )
 	{
 		mFboFormat = format;
-		mFbo.reset();
+		releaseFbos();
+	}
+	//! Set the number of frame buffers used by begin() and end() (1-3). With more than one, writing frame N never waits on sampling frame N-1.
+	void setNumFbos( size_t n )
+	{
+		n = glm::clamp<size_t>( n, 1, 3 );
+		if( n != mNumFbos ) {
+			mNumFbos = n;
+			releaseFbos();
+		}
 	}
+	//! Returns the number of frame buffers used by begin() and end().
+	size_t getNumFbos() const { return mNumFbos; }
+	//! Returns \c TRUE if the GPU has not yet finished sampling from the specified frame buffer.
+	bool isFboInFlight( size_t index ) const;
+	//! Returns the number of times begin() found its next frame buffer still in flight. A larger ring makes this less likely.
+	size_t getNumFboReuses() const { return mNumFboReuses; }
+	//! Enables or disables sizing the frame buffer to the area the warp covers on screen, instead of the full content size.
+	void enableDynamicResolution( bool enabled = true ) { mIsDynamicResolution = enabled; }
+	//! Returns \c TRUE if the frame buffer is sized to the area the warp covers on screen.
+	bool isDynamicResolutionEnabled() const { return mIsDynamicResolution; }
+	//! Set an additional scale factor (between 0.1 and 1) for the frame buffer size, e.g. to hold a target frame rate.
+	void setResolutionScale( float scale ) { mResolutionScale = glm::clamp( scale, 0.1f, 1.0f ); }
+	//! Returns the additional scale factor for the frame buffer size.
+	float getResolutionScale() const { return mResolutionScale; }
+	//! Returns the size in pixels of the frame buffer used by begin() and end().
+	ci::ivec2 getFboSize() const;
 	//!
 	void setLinear( bool enabled = true )
 	{
 		mIsLinear = enabled;
-		mIsDirty = true;
+		invalidate();
 	};
 	//!
 	void setCurved( bool enabled = true )
 	{
 		mIsLinear = !enabled;
-		mIsDirty = true;
+		invalidate();
 	};
 
+	//! Returns the fine corrections on top of the control points, or an empty reference.
+	const WarpResidualGridConstRef &getResiduals() const { return mResiduals; }
+	//! Sets fine corrections on top of the control points. The grid is shared, so don't modify it afterwards. Pass an empty reference to
+	//! remove them.
+	void setResiduals( const WarpResidualGridConstRef &residuals );
+
 	//! Reset control points to undistorted image.
 	void reset() override;
+	//! Computes the mesh on the CPU. Can be called from any thread, as long as the warp is not used elsewhere in the meantime.
+	void prepare() override;
+	//! Creates the shaders and uploads the mesh. Call this on the render thread.
+	void upload() override;
+	//! Returns a hash of everything the mesh depends on: the control points, the mesh settings, the content size and the window size.
+	uint64_t getMeshKey() const;
 	//! Setup the warp before drawing its contents.
 	void begin() override;
 	//! Restore the warp after drawing.
@@ -388,6 +747,14 @@ class WarpBilinear : public Warp {
 
 	//! Draws a warped texture.
 	void draw( const ci::gl::Texture2dRef &texture, const ci::Area &srcArea, const ci::Rectf &destRect ) override;
+	//! Draws a warped NV12 image.
+	void draw( const ci::gl::Texture2dRef &luma, const ci::gl::Texture2dRef &chroma, const ci::Area &srcArea, const ci::Rectf &destRect ) override;
+	//! Draws a specific area of a warped canvas, using a separate part of the mesh for each tile.
+	void draw( const WarpCanvasRef &canvas, const ci::Area &srcArea ) override;
+
+	//! Transforms all control points in normalized screen space. The residual corrections are multiplied by the linear part of the
+	//! transform, which is exact for affine transforms and an approximation for perspective ones.
+	void transformControlPoints( const ci::mat3 &transform ) override;
 
 	//! Set the number of horizontal control points for this warp.
 	void setNumControlX( size_t n );
@@ -397,6 +764,13 @@ class WarpBilinear : public Warp {
 	void setTexCoords( float x1, float y1, float x2, float y2 );
 
 	void keyDown( ci::app::KeyEvent &event ) override;
+	//! Caches the mesh that resulted from a drag.
+	void mouseUp( ci::app::MouseEvent &event ) override;
+
+	//! Allow WarpMeshCache to store and restore the mesh.
+	friend class WarpMeshCache;
+	//! Allow WarpFitter to replace the control points.
+	friend class WarpFitter;
 
   protected:
 	//! Draws the warp as a mesh, allowing you to use your own texture instead of the FBO.
@@ -405,10 +779,18 @@ class WarpBilinear : public Warp {
 	void createShader();
 	//! Creates the frame buffer object and updates the vertex buffer object if necessary.
 	void createBuffers();
-	//! Creates the vertex buffer object.
-	void createMesh( size_t resolutionX = 36, size_t resolutionY = 36 );
-	//! Updates the vertex buffer object based on the control points.
-	void updateMesh();
+	//! Releases all frame buffers and their fences. They will be recreated by begin().
+	void releaseFbos();
+	//! Computes the resolution, indices, texture coordinates and vertices of the mesh. Does not use OpenGL.
+	void buildMesh();
+	//! Adds the current mesh to the mesh cache of the context.
+	void cacheMesh( uint64_t key );
+	//! Draws the part of the mesh covered by each tile of the current canvas.
+	void drawTiles( const ci::gl::GlslProgRef &shader );
+	//! Returns a batch containing only the mesh cells within the specified normalized area.
+	ci::gl::BatchRef getTileBatch( size_t index, const ci::vec4 &clip );
+	//! Uploads the mesh to the vertex buffer object, which is only recreated if the resolution changed.
+	void uploadMesh();
 	//!	Returns the specified control point. Values for col and row are clamped to prevent errors.
 	ci::vec2 getPoint( long col, long row ) const;
 	//!
@@ -430,12 +812,29 @@ class WarpBilinear : public Warp {
   protected:
 	ci::gl::FboRef      mFbo;
 	ci::gl::Fbo::Format mFboFormat;
+	//! Ring of frame buffers and the fences that guard them. \a mFbo is the one currently in use.
+	std::vector<ci::gl::FboRef>  mFbos;
+	std::vector<ci::gl::SyncRef> mFboFences;
+	size_t                       mNumFbos;
+	size_t                       mCurrentFbo;
+	size_t                       mNumFboReuses;
+	//! Frame buffer sizing.
+	bool  mIsDynamicResolution;
+	float mResolutionScale;
+	//! Maximum texture size of the OpenGL context the warp is drawn in, queried once.
+	mutable int mMaxTextureSize;
 	ci::gl::VboMeshRef  mVboMesh;
 	ci::gl::GlslProgRef mShader2D;
 	ci::gl::GlslProgRef mShader2DRect;
+	ci::gl::GlslProgRef mShader2DYuv;
 	ci::gl::BatchRef    mBatch2D;
 	ci::gl::BatchRef    mBatch2DRect;
-	GLenum              mTarget;
+	ci::gl::BatchRef    mBatch2DYuv;
+	//! Draws the mesh vertices as points in edit mode.
+	ci::gl::BatchRef mBatchPoints;
+	GLenum           mTarget;
+	//! Set while drawing YUV content.
+	bool mIsYuv;
 
 	//! Linear or curved interpolation.
 	bool mIsLinear;
@@ -448,14 +847,35 @@ class WarpBilinear : public Warp {
 	//! Determines the detail of the generated mesh. Multiples of 5 seem to work best.
 	int mResolution;
 
+	//! Fine corrections on top of the control points.
+	WarpResidualGridConstRef mResiduals;
+
 	//! Determines the number of horizontal and vertical quads.
 	size_t mResolutionX;
 	size_t mResolutionY;
 
 	//!
 	std::vector<ci::vec2> mPositions;
-	std::vector<uint32_t> mIndices;
-	std::vector<ci::vec2> mTexCoords;
+	//! Indices and texture coordinates, shared with other meshes of the same resolution.
+	WarpMeshLru::LayoutRef mLayout;
+	//! Revision of the warp the vertices were computed for.
+	uint64_t mMeshRevision;
+	//! Set if the current mesh is stored in the mesh cache of the context.
+	bool mIsMeshCached;
+	//! Set if the indices and texture coordinates need to be uploaded.
+	bool mIsLayoutDirty;
+
+	//! Canvas being drawn and the area of it we're drawing.
+	WarpCanvasRef mCanvas;
+	ci::Area      mCanvasArea;
+
+	//! Per tile index buffers, sharing the vertex buffers of \a mVboMesh.
+	struct TileBatch {
+		size_t           index;
+		ci::ivec4        cells;
+		ci::gl::BatchRef batch;
+	};
+	std::vector<TileBatch> mTileBatches;
 };
 
 // ----------------------------------------------------------------------------------------------------------------
@@ -487,8 +907,16 @@ class WarpPerspective final : public Warp {
 	ci::mat4 getTransform();
 	//! Get the inverted transformation matrix.
 	ci::mat4 getInvertedTransform() const { return mInverted; }
+	//! Applies a snapshot on the render thread. Ignored unless it has 2 by 2 control points.
+	void setState( const State &state ) override;
+	//! Assigns the warp to another context. Shaders are recreated for the new context.
+	void setContext( const WarpContextRef &context ) override;
 	//! Reset control points to undistorted image.
 	void reset() override;
+	//! Computes the transformation matrix.
+	void prepare() override { getTransform(); }
+	//! Creates the shaders. Call this on the render thread.
+	void upload() override { createShader(); }
 	//! Setup the warp before drawing its contents.
 	void begin() override;
 	//! Restore the warp after drawing.
@@ -496,6 +924,10 @@ class WarpPerspective final : public Warp {
 
 	//! Draws a warped texture.
 	void draw( const ci::gl::Texture2dRef &texture, const ci::Area &srcArea, const ci::Rectf &destRect ) override;
+	//! Draws a warped NV12 image.
+	void draw( const ci::gl::Texture2dRef &luma, const ci::gl::Texture2dRef &chroma, const ci::Area &srcArea, const ci::Rectf &destRect ) override;
+	//! Draws a specific area of a warped canvas.
+	void draw( const WarpCanvasRef &canvas, const ci::Area &srcArea ) override;
 
 	//! Override keyDown method to add additional key handling.
 	void keyDown( ci::app::KeyEvent &event ) override;
@@ -514,6 +946,9 @@ class WarpPerspective final : public Warp {
 
 	//!
 	void createShader();
+	//! Binds \a shader with the settings of this warp and applies the brightness and perspective transform, then calls \a drawFn to draw
+	//! the content and draws the interface.
+	void drawContent( const ci::gl::GlslProgRef &shader, const std::function<void()> &drawFn );
 
   protected:
 	ci::vec2 mSource[4];
@@ -524,6 +959,7 @@ class WarpPerspective final : public Warp {
 
 	ci::gl::GlslProgRef mShader2D;
 	ci::gl::GlslProgRef mShader2DRect;
+	ci::gl::GlslProgRef mShader2DYuv;
 };
 
 // ----------------------------------------------------------------------------------------------------------------
@@ -555,6 +991,26 @@ class WarpPerspectiveBilinear final : public WarpBilinear {
 	ci::XmlTree toXml() const override;
 	//!
 	void fromXml( const ci::XmlTree &xml ) override;
+
+	//! Returns a snapshot of the settings of the warp, including the corners of the perspective warp.
+	State getState() const override;
+	//! Applies a snapshot on the render thread. Only invalidates the warp if its geometry changed.
+	void setState( const State &state ) override;
+	//! Assigns the warp and its perspective warp to another context.
+	void setContext( const WarpContextRef &context ) override;
+	//! Computes the mesh and the perspective transform.
+	void prepare() override
+	{
+		mWarp->prepare();
+		WarpBilinear::prepare();
+	}
+	//! Creates the shaders of both warps and uploads the mesh. Call this on the render thread.
+	void upload() override
+	{
+		mWarp->upload();
+		WarpBilinear::upload();
+	}
+
 	void mouseMove( ci::app::MouseEvent &event ) override;
 	void mouseDown( ci::app::MouseEvent &event ) override;
 	void mouseDrag( ci::app::MouseEvent &event ) override;
@@ -562,16 +1018,27 @@ class WarpPerspectiveBilinear final : public WarpBilinear {
 	void keyDown( ci::app::KeyEvent &event ) override;
 
 	void resize() override;
+	void resize( const ci::ivec2 &size ) override;
 
 	//! Set the width and height of the content in pixels.
 	bool setSize( float w, float h ) override;
 
+	//! Also changes when the corners of the perspective warp change.
+	uint64_t getRevision() const override { return Warp::getRevision() + mWarp->getRevision(); }
+
 	//! Returns the coordinates of the specified control point.
 	ci::vec2 getControlPoint( unsigned index ) const override;
 	//! Sets the coordinates of the specified control point.
 	void setControlPoint( unsigned index, const ci::vec2 &pos ) override;
 	//! Moves the specified control point.
 	void moveControlPoint( unsigned index, const ci::vec2 &shift ) override;
+	//! Moves the selected control point, but only on one of the two warps.
+	bool nudgeControlPoint( const ci::vec2 &pixels ) override;
+	//! Sets the coordinates of the first \a count control points. The corners are set first, then the other points are converted in one go.
+	void setControlPoints( const ci::vec2 *points, size_t count ) override;
+	//! Transforms all control points in normalized screen space. The residual corrections are stored in the space of the perspective
+	//! warp, which follows the transform, so they are kept unchanged.
+	void transformControlPoints( const ci::mat3 &transform ) override;
 	//! Select one of the control points.
 	void selectControlPoint( unsigned index ) override;
 	//! Deselect the selected control point.
@@ -586,10 +1053,46 @@ class WarpPerspectiveBilinear final : public WarpBilinear {
 	//! Converts the control point index to the appropriate perspective warp index.
 	unsigned convertIndex( unsigned index ) const;
 
+	//! Allow WarpFitter to fit the control points in the space of the perspective warp.
+	friend class WarpFitter;
+
   protected:
 	WarpPerspectiveRef mWarp;
 };
 
+// ----------------------------------------------------------------------------------------------------------------
+
+//! Scales the frame buffers of bilinear warps to hold a target frame rate. Call update() once per frame.
+class ResolutionController {
+  public:
+	explicit ResolutionController( float targetFrameRate = 60.0f );
+
+	//! Set the frame rate to hold.
+	void setTargetFrameRate( float fps ) { mTargetFrameTime = 1.0 / double( glm::max( fps, 1.0f ) ); }
+	//! Returns the frame rate to hold.
+	float getTargetFrameRate() const { return float( 1.0 / mTargetFrameTime ); }
+	//! Set the lower limit of the resolution scale.
+	void setMinScale( float scale ) { mMinScale = glm::clamp( scale, 0.1f, 1.0f ); }
+	//! Returns the current resolution scale.
+	float getScale() const { return mScale; }
+
+	//! Measures the time since the previous call and updates the resolution scale. Returns the new scale.
+	float update();
+	//! Updates the resolution scale based on the duration of the last frame in seconds. Returns the new scale.
+	float update( double frameTime );
+	//! Applies the current resolution scale to all bilinear warps.
+	void apply( const WarpList &warps ) const;
+
+  private:
+	double mTargetFrameTime;
+	double mAverageFrameTime;
+	double mLastTime;
+	float  mScale;
+	float  mMinScale;
+};
+
+// ----------------------------------------------------------------------------------------------------------------
+
 class ScopedWarp {
 	WarpRef mWarp;
 
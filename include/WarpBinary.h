@@ -0,0 +1,98 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ph::warping {
+
+//! Binary warp settings, see Warp::readBinarySettings(). The file starts with a header, followed by a record for each warp and then
+//! the control points of all warps as (x, y) pairs. All values are little-endian and aligned, so a validated file can be used in place.
+struct WarpBinaryHeader {
+	static const uint32_t kVersion = 1;
+
+	//! "WARPBIN" followed by a zero.
+	char     magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t recordSize;
+	uint32_t numWarps;
+	//! Size of the file in bytes.
+	uint64_t size;
+	//! CRC-32 of everything following the header.
+	uint32_t crc;
+	uint32_t reserved;
+};
+
+//! Settings of a single warp.
+struct WarpBinaryRecord {
+	static const uint32_t kLinear = 1;
+	static const uint32_t kAdaptive = 2;
+
+	//! See Warp::WarpType.
+	uint32_t type;
+	uint32_t controlsX;
+	uint32_t controlsY;
+	int32_t  resolution;
+	uint32_t flags;
+	float    brightness;
+	float    exponent;
+	float    luminance[3];
+	float    gamma[3];
+	float    edges[4];
+	//! Perspective-bilinear warps only.
+	float    corners[8];
+	//! Size in bytes of the residual grid following the control points, or 0. See WarpResidualGrid::writeBinary().
+	uint32_t residuals;
+	//! Offset in bytes from the start of the file to the control points.
+	uint64_t points;
+};
+
+static_assert( sizeof( WarpBinaryHeader ) == 40, "unexpected padding in WarpBinaryHeader" );
+static_assert( sizeof( WarpBinaryRecord ) == 112, "unexpected padding in WarpBinaryRecord" );
+
+//! Computes the CRC-32 of \a size bytes, continuing from a previous \a crc.
+uint32_t crc32( const void *data, size_t size, uint32_t crc = 0 );
+
+//! Checks the header, checksum and bounds of binary settings in memory. Returns the header, or \c nullptr if the data is invalid.
+const WarpBinaryHeader *validateWarpBinary( const void *data, size_t size );
+
+//! Returns the records following the header.
+inline const WarpBinaryRecord *getWarpBinaryRecords( const WarpBinaryHeader *header )
+{
+	return reinterpret_cast<const WarpBinaryRecord *>( reinterpret_cast<const uint8_t *>( header ) + header->headerSize );
+}
+
+//! Copies the settings of a warp to \a record, except for its control points.
+void writeWarpBinaryRecord( const Warp::State &state, WarpBinaryRecord &record );
+//! Copies the settings of \a record to \a state, except for its control points.
+void readWarpBinaryRecord( const WarpBinaryRecord &record, Warp::State &state );
+
+//! Returns the control points of a record as (x, y) pairs.
+inline const float *getWarpBinaryPoints( const WarpBinaryHeader *header, const WarpBinaryRecord &record )
+{
+	return reinterpret_cast<const float *>( reinterpret_cast<const uint8_t *>( header ) + record.points );
+}
+
+} // namespace ph::warping
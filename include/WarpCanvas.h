@@ -0,0 +1,109 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinder/Area.h>
+#include <cinder/Vector.h>
+#include <cinder/gl/gl.h>
+
+#include <functional>
+#include <vector>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpCanvas> WarpCanvasRef;
+
+//! Content target that can be larger than GL_MAX_TEXTURE_SIZE. The canvas is split into tiles,
+//! which are only allocated once a warp references them. Use Warp::draw( canvas, srcArea ) to warp it.
+class WarpCanvas {
+  public:
+	//! Creates a canvas of \a width x \a height pixels. If \a tileSize is 0, the maximum texture size is used.
+	static WarpCanvasRef create( int width, int height, const ci::gl::Fbo::Format &format = ci::gl::Fbo::Format(), int tileSize = 0 )
+	{
+		return std::make_shared<WarpCanvas>( width, height, format, tileSize );
+	}
+
+	WarpCanvas( int width, int height, const ci::gl::Fbo::Format &format = ci::gl::Fbo::Format(), int tileSize = 0 );
+	~WarpCanvas() = default;
+
+	WarpCanvas( const WarpCanvas & ) = delete;
+	WarpCanvas( WarpCanvas && ) = delete;
+	WarpCanvas &operator=( const WarpCanvas & ) = delete;
+	WarpCanvas &operator=( WarpCanvas && ) = delete;
+
+	//! Returns the maximum texture size supported by the current OpenGL context. Queried on every call, so prefer getTileSize().
+	static int getMaxTileSize();
+
+	//! Get the width of the canvas in pixels.
+	int getWidth() const { return mSize.x; }
+	//! Get the height of the canvas in pixels.
+	int getHeight() const { return mSize.y; }
+	//! Get the width and height of the canvas in pixels.
+	ci::ivec2 getSize() const { return mSize; }
+	//! Get the bounds of the canvas in pixels.
+	ci::Area getBounds() const { return ci::Area( ci::ivec2( 0 ), mSize ); }
+
+	//! Returns the (maximum) width and height of a tile in pixels.
+	ci::ivec2 getTileSize() const { return mTileSize; }
+	//! Returns the number of tile columns and rows.
+	ci::ivec2 getNumTiles() const { return mNumTiles; }
+	//! Returns the total number of tiles.
+	size_t getTileCount() const { return mTiles.size(); }
+	//! Returns the area of the canvas covered by the specified tile.
+	ci::Area getTileArea( size_t index ) const { return mTiles[index].area; }
+	//! Returns the indices of all tiles overlapping the specified area.
+	std::vector<size_t> getTiles( const ci::Area &area ) const;
+	//! Returns the texture of the specified tile, or an empty reference if it has not been allocated yet.
+	ci::gl::Texture2dRef getTexture( size_t index ) const;
+	//! Calculates which part of \a srcArea (in normalized coordinates: x1, y1, x2, y2) is covered by the specified tile,
+	//! and the offset and scale that convert those normalized coordinates to texture coordinates of the tile. Returns \c FALSE if they do not overlap.
+	bool getTileCoords( size_t index, const ci::Area &srcArea, ci::vec4 *clip, ci::vec4 *coords ) const;
+
+	//! Marks all tiles overlapping the specified area as in use until the next call to render(), which allocates and renders them.
+	void reference( const ci::Area &area );
+	//! Returns \c TRUE if the specified tile is in use.
+	bool isReferenced( size_t index ) const { return mTiles[index].referenced; }
+	//! Returns \c TRUE if the specified tile has been allocated.
+	bool isAllocated( size_t index ) const { return bool( mTiles[index].fbo ); }
+	//! Returns the number of allocated tiles.
+	size_t getNumAllocated() const;
+	//! Releases all tiles. Tiles will be allocated again once they are referenced.
+	void release();
+
+	//! Renders the content of all referenced tiles. Calls \a fn once per tile, with matrices set up so that you can draw in canvas coordinates.
+	//! Call this once per frame: tiles that were not referenced since the previous call are released.
+	void render( const std::function<void( const ci::Area &tileArea )> &fn );
+
+  private:
+	struct Tile {
+		ci::Area        area;
+		ci::gl::FboRef  fbo;
+		bool            referenced{ false };
+	};
+
+	ci::ivec2           mSize;
+	ci::ivec2           mTileSize;
+	ci::ivec2           mNumTiles;
+	ci::gl::Fbo::Format mFormat;
+	std::vector<Tile>   mTiles;
+};
+
+} // namespace ph::warping
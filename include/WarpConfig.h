@@ -0,0 +1,91 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpConfig> WarpConfigRef;
+
+//! Named profiles, each with its own warps. The warps of inactive profiles are kept ready to draw, so switching profiles only swaps
+//! the active list. Pass getWarps() to the static functions of Warp, like handleMouseDown().
+class WarpConfig {
+  public:
+	static WarpConfigRef create() { return std::make_shared<WarpConfig>(); }
+	//! Reads all profiles of a settings xml file and builds their meshes. Call this on the render thread. Errors are written to the console.
+	static WarpConfigRef read( const ci::DataSourceRef &source );
+
+	WarpConfig();
+
+	WarpConfig( const WarpConfig & ) = delete;
+	WarpConfig &operator=( const WarpConfig & ) = delete;
+
+	//! Writes all profiles to a settings xml file. Warp::readSettings() reads the first profile of such a file.
+	void write( const ci::DataTargetRef &target ) const;
+
+	//! Returns the number of profiles.
+	size_t getNumProfiles() const { return mProfiles.size(); }
+	//! Returns the name of the profile at \a index.
+	const std::string &getProfileName( size_t index ) const { return mProfiles.at( index ).name; }
+	//! Returns \c TRUE if a profile with the given name exists.
+	bool hasProfile( const std::string &name ) const { return findProfile( name ) < mProfiles.size(); }
+	//! Adds a profile, or replaces the warps of an existing profile.
+	void setProfile( const std::string &name, const WarpList &warps );
+	//! Removes a profile. Returns \c FALSE if it doesn't exist or is the active profile.
+	bool removeProfile( const std::string &name );
+
+	//! Returns the name of the active profile, or an empty string if there are no profiles.
+	const std::string &getActiveProfile() const;
+	//! Makes another profile active. Returns \c FALSE if no profile has that name.
+	bool setActiveProfile( const std::string &name );
+
+	//! Returns the warps of the active profile.
+	WarpList &getWarps() { return mActive < mProfiles.size() ? mProfiles[mActive].warps : mEmpty; }
+	//! Returns the warps of the named profile, or an empty list.
+	WarpList &getWarps( const std::string &name );
+
+	//! Resizes the warps of all profiles. Call this instead of Warp::handleResize().
+	void handleResize();
+	//! Resizes the warps of all profiles to the specified size.
+	void handleResize( const ci::ivec2 &size );
+	//! Sets the content size of the warps of all profiles.
+	void setSize( const ci::vec2 &size );
+
+	//! Rebuilds at most one warp of the inactive profiles, so they stay ready without stalling a frame. Call this once per frame on
+	//! the render thread.
+	void update();
+
+  private:
+	struct Profile {
+		std::string name;
+		WarpList    warps;
+	};
+
+	//! Returns the index of the named profile, or the number of profiles if it doesn't exist.
+	size_t findProfile( const std::string &name ) const;
+
+	std::vector<Profile> mProfiles;
+	size_t               mActive;
+	WarpList             mEmpty;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <vector>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpFitter> WarpFitterRef;
+
+//! Fits the control points of a bilinear warp to measured correspondences, for instance from a camera-based calibration. Each sample
+//! maps normalized content coordinates to normalized screen coordinates. The control points are found with a least-squares solve of
+//! the surface the warp actually draws, Catmull-Rom or linear, optionally regularized to keep the grid smooth where samples are sparse.
+//! The normal equations are banded, so a 64x64 grid is solved in a fraction of a second.
+class WarpFitter {
+  public:
+	class Format {
+	  public:
+		Format()
+			: mSmoothness( 0.01f )
+			, mIsCornersFixed( false )
+		{
+		}
+
+		//! Set the weight of the smoothness term, relative to the average weight of the samples per control point. Defaults to 0.01.
+		Format &smoothness( float weight )
+		{
+			mSmoothness = weight;
+			return *this;
+		}
+		//! Keep the 4 corners at their initial position. Always enabled when fitting a perspective-bilinear warp. Defaults to \c FALSE.
+		Format &fixCorners( bool enabled = true )
+		{
+			mIsCornersFixed = enabled;
+			return *this;
+		}
+
+	  private:
+		float mSmoothness;
+		bool  mIsCornersFixed;
+
+		friend class WarpFitter;
+	};
+
+	static WarpFitterRef create( const Format &format = Format() ) { return std::make_shared<WarpFitter>( format ); }
+
+	explicit WarpFitter( const Format &format = Format() );
+
+	//! Adds a correspondence between normalized content coordinates \a uv and normalized screen coordinates \a xy.
+	void addSample( const ci::vec2 &uv, const ci::vec2 &xy, float weight = 1.0f );
+	//! Removes all samples.
+	void clearSamples() { mSamples.clear(); }
+	//! Returns the number of samples.
+	size_t getNumSamples() const { return mSamples.size(); }
+
+	//! Fits a grid of \a controlsX x \a controlsY control points to the samples, in the same order as the control points of a warp. On
+	//! input, \a points holds the initial grid, which is kept where neither the samples nor the smoothness term determine the result. If
+	//! it does not match the size of the grid, a regular grid is used instead. Returns \c FALSE if the grid could not be solved.
+	bool solve( size_t controlsX, size_t controlsY, bool linear, std::vector<ci::vec2> &points );
+	//! Fits the control points of \a warp to the samples, keeping its number of control points. Residual corrections of the warp are
+	//! taken into account. Returns \c FALSE if the grid could not be solved, in which case the warp is left unchanged.
+	bool fit( const WarpBilinearRef &warp );
+
+	//! Returns the root-mean-square distance between the samples and the fitted surface after the last solve.
+	float getError() const { return mError; }
+
+  private:
+	struct Sample {
+		ci::vec2 uv;
+		ci::vec2 xy;
+		float    weight;
+	};
+
+	bool solve( const std::vector<Sample> &samples, size_t controlsX, size_t controlsY, bool linear, bool fixCorners, std::vector<ci::vec2> &points );
+
+	Format              mFormat;
+	std::vector<Sample> mSamples;
+	float               mError;
+};
+
+} // namespace ph::warping
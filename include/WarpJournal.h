@@ -0,0 +1,187 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <cinder/Timer.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <thread>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpJournal> WarpJournalRef;
+
+//! Saves edits as they happen, so a crash loses at most the last moments of work. Changed warps are appended to a journal next to the
+//! settings file by a background thread, once editing has paused. The journal is periodically compacted into the settings file, which
+//! is written to a temporary file first and then renamed, so it is never left half-written. Call recover() at startup to replay it.
+//! The journal tracks the warps loaded by Warp::readSettings(), which are those of the first profile. Other profiles written by WarpConfig
+//! are copied unchanged when the settings file is rewritten. A WarpWatcher of the same file ignores the versions written by compaction.
+class WarpJournal {
+  public:
+	class Format {
+	  public:
+		Format()
+			: mDebounce( 0.5 )
+			, mMaxDelay( 2.0 )
+			, mCompactInterval( 30.0 )
+			, mMaxEntries( 1000 )
+		{
+		}
+
+		//! Set the time in seconds a warp must be left alone before its changes are written. Defaults to 0.5.
+		Format &debounce( double seconds )
+		{
+			mDebounce = seconds;
+			return *this;
+		}
+		//! Set the maximum time in seconds changes are held back during continuous editing. Defaults to 2.
+		Format &maxDelay( double seconds )
+		{
+			mMaxDelay = seconds;
+			return *this;
+		}
+		//! Set the interval in seconds between compactions of the journal into the settings file. Defaults to 30.
+		Format &compactInterval( double seconds )
+		{
+			mCompactInterval = seconds;
+			return *this;
+		}
+		//! Set the number of journal entries that triggers a compaction. Defaults to 1000.
+		Format &maxEntries( size_t n )
+		{
+			mMaxEntries = n;
+			return *this;
+		}
+
+	  private:
+		double mDebounce;
+		double mMaxDelay;
+		double mCompactInterval;
+		size_t mMaxEntries;
+
+		friend class WarpJournal;
+	};
+
+	//! Keeps a journal for the settings xml file at \a path. The journal is stored next to it, with the extension ".journal" appended.
+	static WarpJournalRef create( const ci::fs::path &path, const Format &format = Format() ) { return std::make_shared<WarpJournal>( path, format ); }
+
+	WarpJournal( const ci::fs::path &path, const Format &format );
+	//! Writes pending changes and stops the background thread.
+	~WarpJournal();
+
+	WarpJournal( const WarpJournal & ) = delete;
+	WarpJournal &operator=( const WarpJournal & ) = delete;
+
+	//! Replays the journal onto the \a warps that were loaded from the settings file, then compacts it. Call this once at startup, before
+	//! the first update(). Returns the number of entries that were replayed. A torn entry at the end of the journal is ignored.
+	size_t recover( WarpList &warps );
+
+	//! Records the warps that changed since the previous call. Call this once per frame on the render thread. Never waits for the disk.
+	void update( const WarpList &warps );
+
+	//! Records all changes right away and compacts the journal into the settings file. Waits until the file has been written, so call
+	//! this from cleanup() rather than every frame.
+	void save( const WarpList &warps );
+
+	//! Returns the path of the journal.
+	const ci::fs::path &getJournalPath() const { return mJournalPath; }
+	//! Returns the number of entries written to the journal.
+	uint64_t getNumEntries() const { return mNumEntries; }
+	//! Returns the number of times the settings file was written.
+	uint64_t getNumCompactions() const { return mNumCompactions; }
+
+  private:
+	//! The state of a warp at a given index, in a list of \a numWarps warps.
+	struct Entry {
+		uint32_t    index;
+		uint32_t    numWarps;
+		Warp::State state;
+	};
+
+	//! Writes entries and compacts the journal until stopped.
+	void run();
+	//! Appends entries to the journal and syncs it to disk.
+	void append( const std::deque<Entry> &entries );
+	//! Writes the settings file from \a mSaved and starts a new journal.
+	void compact();
+	//! Writes \a warps as the first profile of the settings file to \a target, keeping the other profiles of the current settings file.
+	void writeSettings( const WarpList &warps, const ci::fs::path &target ) const;
+	//! Opens the journal for appending, writing the header if it is new.
+	bool open( bool truncate );
+	//! Records the current \a warps without journaling them.
+	void seed( const WarpList &warps );
+	//! Moves the changes that have settled to the queue of the background thread.
+	void flush( bool force );
+
+	ci::fs::path mPath;
+	ci::fs::path mJournalPath;
+	Format       mFormat;
+
+	//! Revisions of a warp as last recorded, so unchanged warps are skipped without copying their state.
+	struct Revision {
+		const Warp *warp{ nullptr };
+		uint64_t    points{ 0 };
+		uint64_t    blend{ 0 };
+
+		bool operator==( const Revision &rhs ) const { return warp == rhs.warp && points == rhs.points && blend == rhs.blend; }
+	};
+
+	static Revision getRevision( const WarpRef &warp ) { return { warp.get(), warp->getRevision(), warp->getBlendRevision() }; }
+
+	//! Render thread: the state and revisions of each warp as last recorded, and which of them changed but were not queued yet.
+	std::vector<Warp::State> mStates;
+	std::vector<Revision>    mRevisions;
+	std::vector<bool>        mIsChanged;
+	bool                     mIsCountChanged;
+	bool                     mIsSeeded;
+	ci::Timer                mTimer;
+	//! Time of the first and last change that was not queued yet, or -1 if there is none.
+	double mFirstChange;
+	double mLastChange;
+
+	std::thread              mThread;
+	std::mutex               mMutex;
+	std::condition_variable  mCondition;
+	std::deque<Entry>        mQueue;
+	std::vector<Warp::State> mBaseline;
+	bool                     mHasBaseline;
+	bool                     mIsRunning;
+	bool                     mIsCompactRequested;
+	uint64_t                 mNumRequested;
+	uint64_t                 mNumCompleted;
+	std::condition_variable  mCompleted;
+
+	//! Background thread: the journal and the states it describes.
+	std::FILE *              mFile;
+	std::vector<Warp::State> mSaved;
+	bool                     mIsSaved;
+	size_t                   mNumJournaled;
+	ci::Timer                mCompactionTimer;
+
+	std::atomic<uint64_t> mNumEntries;
+	std::atomic<uint64_t> mNumCompactions;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,151 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MappedFile.h"
+#include "Warp.h"
+#include "WarpMeshCache.h"
+#include "WarpXmlReader.h"
+
+#include <cinder/Timer.h>
+
+#include <thread>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpLoader> WarpLoaderRef;
+
+//! Loads a settings xml file on a number of worker threads. Each map is read and its mesh computed on a worker, leaving only the
+//! creation of shaders and buffers to the render thread. The time spent in each stage is recorded, up to the first frame.
+class WarpLoader {
+  public:
+	class Format {
+	  public:
+		Format()
+			: mNumThreads( 0 )
+			, mWindowSize( 0 )
+			, mContentSize( 0 )
+		{
+		}
+
+		//! Set the number of worker threads. Defaults to 0, which uses one thread per hardware thread.
+		Format &numThreads( size_t n )
+		{
+			mNumThreads = n;
+			return *this;
+		}
+		//! Set the size of the window, so the meshes are computed for it. Defaults to (0, 0), which keeps the size of a new warp.
+		Format &windowSize( const ci::ivec2 &size )
+		{
+			mWindowSize = size;
+			return *this;
+		}
+		//! Set the width and height of the content of the warps. Defaults to (0, 0), which keeps the size of a new warp.
+		Format &contentSize( const ci::vec2 &size )
+		{
+			mContentSize = size;
+			return *this;
+		}
+		//! Set a cache to restore the meshes from, instead of computing them. Defaults to none.
+		Format &meshCache( const WarpMeshCacheRef &cache )
+		{
+			mMeshCache = cache;
+			return *this;
+		}
+
+	  private:
+		size_t           mNumThreads;
+		ci::ivec2        mWindowSize;
+		ci::vec2         mContentSize;
+		WarpMeshCacheRef mMeshCache;
+
+		friend class WarpLoader;
+	};
+
+	//! Durations in seconds. Parsing and preparing are summed over all workers, the others are measured from the creation of the loader.
+	struct Stats {
+		size_t numWarps{ 0 };
+		size_t numThreads{ 0 };
+		//! Number of meshes restored from the mesh cache.
+		size_t numCached{ 0 };
+		//! Finding the maps in the document.
+		double scan{ 0 };
+		//! Reading the maps and constructing the warps.
+		double parse{ 0 };
+		//! Computing the meshes, or restoring them from the mesh cache.
+		double prepare{ 0 };
+		//! Until all workers finished.
+		double loaded{ 0 };
+		//! Creating shaders and buffers on the render thread.
+		double upload{ 0 };
+		//! Until markFirstFrame() was called.
+		double firstFrame{ 0 };
+	};
+
+	//! Starts loading \a source. Files are memory-mapped when possible.
+	static WarpLoaderRef create( const ci::DataSourceRef &source, const Format &format = Format() ) { return std::make_shared<WarpLoader>( source, format ); }
+
+	WarpLoader( const ci::DataSourceRef &source, const Format &format );
+	~WarpLoader();
+
+	WarpLoader( const WarpLoader & ) = delete;
+	WarpLoader &operator=( const WarpLoader & ) = delete;
+
+	//! Returns \c TRUE once all workers have finished, so getWarps() won't block.
+	bool isReady() const { return mNumFinished == mStats.numThreads; }
+	//! Waits for the workers, then creates the shaders and buffers of the warps. Call this on the render thread. Returns the warps in
+	//! the order of the file. Errors are written to the console and the maps that caused them are skipped.
+	const WarpList &getWarps();
+
+	//! Records the time to first frame. Call this at the end of the first draw().
+	void markFirstFrame();
+
+	//! Returns the time spent in each stage.
+	const Stats &getStats() const { return mStats; }
+
+  private:
+	//! Reads maps and computes their meshes until none are left.
+	void work();
+
+	Format    mFormat;
+	ci::Timer mTimer;
+	Stats     mStats;
+
+	//! Contents of the file, kept alive until the workers are done.
+	MappedFileRef mFile;
+	ci::BufferRef mBuffer;
+	const char *  mData;
+	size_t        mSize;
+
+	std::vector<WarpXmlReader::Range> mMaps;
+	std::vector<WarpRef>              mResults;
+	std::vector<std::string>          mErrors;
+
+	std::vector<std::thread> mThreads;
+	std::atomic<size_t>      mNext;
+	std::atomic<size_t>      mNumFinished;
+	std::mutex               mMutex;
+
+	bool     mIsUploaded;
+	WarpList mWarps;
+};
+
+} // namespace ph::warping
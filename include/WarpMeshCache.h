@@ -0,0 +1,76 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MappedFile.h"
+#include "Warp.h"
+
+#include <atomic>
+#include <unordered_map>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpMeshCache> WarpMeshCacheRef;
+
+//! Cache of the meshes of bilinear warps, stored next to the settings file. Each mesh is keyed by WarpBilinear::getMeshKey(), so a
+//! mesh is only found if its control points, settings, content size and window size are unchanged. The file is memory-mapped and the
+//! meshes are copied into the warps as they are, without evaluating them.
+class WarpMeshCache {
+  public:
+	//! Opens the cache of the settings xml file at \a path. The cache is stored with the extension ".meshes" appended.
+	static WarpMeshCacheRef create( const ci::fs::path &path ) { return std::make_shared<WarpMeshCache>( path ); }
+
+	explicit WarpMeshCache( const ci::fs::path &path );
+
+	WarpMeshCache( const WarpMeshCache & ) = delete;
+	WarpMeshCache &operator=( const WarpMeshCache & ) = delete;
+
+	//! Restores the mesh of \a warp if it is cached, so prepare() has nothing left to do. Can be called from any thread, as long as the
+	//! warp is not used elsewhere in the meantime. Returns \c TRUE if the mesh was found.
+	bool load( const WarpRef &warp );
+	//! Restores the meshes of all \a warps that are cached. Returns the number of meshes found.
+	size_t load( const WarpList &warps );
+	//! Replaces the cache with the meshes of \a warps, computing those that are outdated. The file is written to a temporary file first.
+	void save( const WarpList &warps );
+
+	//! Returns the path of the cache file.
+	const ci::fs::path &getCachePath() const { return mCachePath; }
+	//! Returns the number of meshes in the cache.
+	size_t getNumMeshes() const { return mEntries.size(); }
+	//! Returns the number of meshes that were found by load().
+	uint64_t getNumHits() const { return mNumHits; }
+	//! Returns the number of bilinear warps whose mesh was not found by load().
+	uint64_t getNumMisses() const { return mNumMisses; }
+
+  private:
+	//! Maps the cache file and indexes its meshes. An invalid file is ignored.
+	void open();
+
+	ci::fs::path mCachePath;
+
+	MappedFileRef                              mFile;
+	std::unordered_map<uint64_t, const void *> mEntries;
+
+	std::atomic<uint64_t> mNumHits;
+	std::atomic<uint64_t> mNumMisses;
+};
+
+} // namespace ph::warping
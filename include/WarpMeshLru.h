@@ -0,0 +1,116 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinder/Vector.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ph::warping {
+
+//! Bounded cache of evaluated meshes, keyed by WarpBilinear::getMeshKey(). Returning to a previous state of a warp, like undoing an edit
+//! or toggling between linear and curved, becomes a lookup instead of a rebuild. The least recently used meshes are evicted first.
+//! Indices and texture coordinates only depend on the resolution of a mesh, so they are shared by all meshes and warps of the same
+//! resolution. Can be used from any thread. Not to be confused with WarpMeshCache, which stores the meshes of a settings file on disk.
+class WarpMeshLru {
+  public:
+	//! Indices and texture coordinates of a mesh with the given resolution.
+	struct Layout {
+		size_t                resolutionX{ 0 };
+		size_t                resolutionY{ 0 };
+		std::vector<ci::vec2> texCoords;
+		std::vector<uint32_t> indices;
+	};
+
+	typedef std::shared_ptr<const Layout> LayoutRef;
+
+	struct Mesh {
+		LayoutRef             layout;
+		std::vector<ci::vec2> positions;
+	};
+
+	typedef std::shared_ptr<const Mesh> MeshRef;
+
+	//! Creates a cache holding at most \a capacity bytes of meshes.
+	explicit WarpMeshLru( size_t capacity = 64 * 1024 * 1024 )
+		: mCapacity( capacity )
+		, mSize( 0 )
+		, mNumHits( 0 )
+		, mNumMisses( 0 )
+	{
+	}
+
+	//! Returns the mesh with the given key and marks it as most recently used, or returns an empty reference.
+	MeshRef find( uint64_t key );
+	//! Adds a mesh, evicting the least recently used meshes if the cache is full.
+	void insert( uint64_t key, const MeshRef &mesh );
+	//! Removes all meshes.
+	void clear();
+
+	//! Returns the layout for the given resolution, which is shared as long as it is in use. Vertices are stored column-major,
+	//! with 6 indices per cell.
+	LayoutRef getLayout( size_t resolutionX, size_t resolutionY );
+
+	//! Returns the maximum size of the cache in bytes.
+	size_t getCapacity() const { return mCapacity; }
+	//! Sets the maximum size of the cache in bytes. A capacity of 0 disables the cache.
+	void setCapacity( size_t capacity );
+	//! Returns the size of the cached meshes in bytes, not counting their shared layouts.
+	size_t getSize() const;
+	//! Returns the number of cached meshes.
+	size_t getNumMeshes() const;
+
+	//! Returns the number of lookups that found a mesh.
+	uint64_t getNumHits() const { return mNumHits; }
+	//! Returns the number of lookups that did not find a mesh.
+	uint64_t getNumMisses() const { return mNumMisses; }
+	//! Returns the fraction of lookups that found a mesh.
+	double getHitRate() const;
+	//! Resets the number of hits and misses.
+	void resetStats();
+
+  private:
+	typedef std::list<std::pair<uint64_t, MeshRef>> List;
+
+	static size_t getSize( const Mesh &mesh );
+	//! Evicts the least recently used meshes until the cache fits its capacity.
+	void trim();
+
+	mutable std::mutex  mMutex;
+	std::atomic<size_t> mCapacity;
+	size_t              mSize;
+	//! Most recently used mesh first.
+	List                                         mList;
+	std::unordered_map<uint64_t, List::iterator> mMap;
+	//! Layouts in use, by resolution.
+	std::map<std::pair<size_t, size_t>, std::weak_ptr<const Layout>> mLayouts;
+
+	std::atomic<uint64_t> mNumHits;
+	std::atomic<uint64_t> mNumMisses;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+#include "WarpRemoteClient.h"
+
+#if !defined( CINDER_MSW )
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpRemote> WarpRemoteRef;
+
+//! Local control channel, allowing external tools to update the control points, corners and blend parameters of running warps.
+//! Tools write messages to a ring in POSIX shared memory using the C client in WarpRemoteClient.h. A Unix domain socket
+//! is used to notify the application. Only one application can own an endpoint at a time. Not available on Windows.
+class WarpRemote {
+  public:
+	//! Creates an endpoint with the given name. An endpoint left behind by an application that is no longer running is replaced.
+	//! Throws a std::runtime_error if another application owns the endpoint, or if the shared memory or the socket can't be created.
+	static WarpRemoteRef create( const std::string &name = "cinder-warping" ) { return std::make_shared<WarpRemote>( name ); }
+
+	explicit WarpRemote( const std::string &name );
+	~WarpRemote();
+
+	WarpRemote( const WarpRemote & ) = delete;
+	WarpRemote( WarpRemote && ) = delete;
+	WarpRemote &operator=( const WarpRemote & ) = delete;
+	WarpRemote &operator=( WarpRemote && ) = delete;
+
+	//! Returns the name of the endpoint, which clients pass to warp_remote_connect().
+	const std::string &getName() const { return mName; }
+
+	//! Applies all pending messages to the warps, changing the control points of each warp only once. Call this on the render thread
+	//! before drawing the warps. Returns the number of messages.
+	size_t update( WarpList &warps );
+	//! Blocks until a client sends a notification, or until \a timeout seconds have passed. Returns \c TRUE if a client sent a notification.
+	bool wait( double timeout ) const;
+	//! Returns the path of the notification socket, which is published to the clients in the shared memory.
+	const std::string &getSocketPath() const { return mSocketPath; }
+	//! Returns the file descriptor of the notification socket, for use with poll() or select().
+	int getNotificationHandle() const { return mSocket; }
+
+	//! Returns the number of messages that were applied.
+	uint64_t getNumMessages() const { return mNumMessages; }
+	//! Returns the number of messages that were ignored, because they were invalid or referred to an unknown warp.
+	uint64_t getNumRejected() const { return mNumRejected; }
+
+  private:
+	//! Applies a single message.
+	void apply( WarpList &warps, const warp_remote_slot &slot );
+	//! Closes the socket and removes the shared memory.
+	void release();
+
+	std::string       mName;
+	std::string       mSocketPath;
+	warp_remote_ring *mRing;
+	int               mSocket;
+
+	uint64_t mNumMessages;
+	uint64_t mNumRejected;
+
+	//! Control points of the warps changed by the current update, empty for other warps.
+	std::vector<std::vector<ci::vec2>> mPoints;
+};
+
+} // namespace ph::warping
+
+#endif
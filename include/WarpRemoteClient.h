@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ C client for the shared memory control channel of Cinder-Warping (see WarpRemote.h). External tools
+ use it to push control point, corner and blend updates into a running application. Messages are
+ written to a bounded ring in POSIX shared memory, which may be shared by several clients. A datagram
+ on a Unix domain socket wakes up the application when the ring was empty. The application publishes
+ the path of that socket and its process id in the header of the ring.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARP_REMOTE_MAGIC 0x52505257u /* "WRPR" */
+#define WARP_REMOTE_VERSION 2u
+#define WARP_REMOTE_CAPACITY 1024u /* must be a power of two */
+#define WARP_REMOTE_MAX_POINTS 30u
+#define WARP_REMOTE_PATH_SIZE 108u /* size of sockaddr_un::sun_path on Linux */
+
+/* Message types. */
+enum {
+	WARP_REMOTE_CONTROL_POINTS = 1, /* sets 'count' control points, starting at 'first' */
+	WARP_REMOTE_CORNERS = 2,        /* sets the 4 corners: top left, top right, bottom right, bottom left */
+	WARP_REMOTE_BLEND = 3           /* sets the blend parameters, see warp_remote_blend */
+};
+
+/* Blend parameters, as stored in the data of a WARP_REMOTE_BLEND message. */
+typedef struct warp_remote_blend {
+	float exponent;
+	float edges[4]; /* left, top, right, bottom */
+	float gamma[3];
+	float luminance[3];
+	float brightness;
+} warp_remote_blend;
+
+/* A single message. Coordinates are normalized screen coordinates, as returned by Warp::getControlPoint(). */
+typedef struct warp_remote_slot {
+	uint64_t sequence; /* used to synchronize producers and the consumer */
+	uint32_t type;
+	uint32_t warp; /* index of the warp in the WarpList */
+	uint32_t first;
+	uint32_t count;
+	float    data[2 * WARP_REMOTE_MAX_POINTS];
+} warp_remote_slot;
+
+/* Layout of the shared memory. The head and tail live on separate cache lines. */
+typedef struct warp_remote_ring {
+	uint32_t         magic;
+	uint32_t         version;
+	uint32_t         capacity;
+	uint32_t         slot_size;
+	uint32_t         owner;                              /* process id of the application */
+	char             socket_path[WARP_REMOTE_PATH_SIZE]; /* notification socket, empty if there is none */
+	uint64_t         head; /* next slot to write, shared by all clients */
+	uint8_t          reserved1[56];
+	uint64_t         tail; /* next slot to read, owned by the application */
+	uint8_t          reserved2[56];
+	warp_remote_slot slots[WARP_REMOTE_CAPACITY];
+} warp_remote_ring;
+
+/* Returns the name of the shared memory object of an endpoint. */
+static inline void warp_remote_shm_name( const char *name, char *buffer, size_t size )
+{
+	snprintf( buffer, size, "/%s", name );
+}
+
+/* Returns the path the application uses for the notification socket of an endpoint: in $XDG_RUNTIME_DIR if it is set,
+   otherwise in /tmp. Clients use the path published in the ring instead. */
+static inline void warp_remote_socket_path( const char *name, char *buffer, size_t size )
+{
+	const char *dir = getenv( "XDG_RUNTIME_DIR" );
+	snprintf( buffer, size, "%s/%s.sock", dir && dir[0] ? dir : "/tmp", name );
+}
+
+typedef struct warp_remote_client warp_remote_client;
+
+/* Connects to the endpoint with the given name. Returns NULL on failure, errno describes the error. */
+warp_remote_client *warp_remote_connect( const char *name );
+/* Disconnects and frees the client. */
+void warp_remote_disconnect( warp_remote_client *client );
+
+/* Sets 'count' control points of a warp, starting at index 'first'. 'xy' holds 2 floats per point. Returns 0 on success,
+   or -1 if the ring is full (errno is EAGAIN) or the client is invalid. Large updates are split into several messages. */
+int warp_remote_set_points( warp_remote_client *client, uint32_t warp, uint32_t first, uint32_t count, const float *xy );
+/* Sets the 4 corners of a warp. 'xy' holds 8 floats. */
+int warp_remote_set_corners( warp_remote_client *client, uint32_t warp, const float *xy );
+/* Sets the blend parameters of a warp. */
+int warp_remote_set_blend( warp_remote_client *client, uint32_t warp, const warp_remote_blend *blend );
+
+#ifdef __cplusplus
+}
+#endif
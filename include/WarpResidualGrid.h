@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinder/Matrix.h>
+#include <cinder/Vector.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cinder {
+class XmlTree;
+} // namespace cinder
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpResidualGrid> WarpResidualGridRef;
+typedef std::shared_ptr<const WarpResidualGrid> WarpResidualGridConstRef;
+
+//! Fine corrections on top of the control points of a bilinear warp, for instance from a camera-based calibration. Each level is a grid
+//! of offsets spanning the whole warp, in the same normalized coordinates as the control points. Offsets are stored in blocks of 8x8 and
+//! blocks that are all zero are left out, so a dense correction only costs memory where it is needed. When the mesh is built, the offsets
+//! of all levels are interpolated bilinearly and added to the surface defined by the control points.
+//! A grid is shared by the warp and its states once assigned, so create a copy to make changes.
+class WarpResidualGrid {
+  public:
+	static const size_t kBlockSize = 8;
+	//! Maximum number of offsets per row or column of a level.
+	static const size_t kMaxSize = 4096;
+
+	//! Offsets of a block in row-major order.
+	typedef std::array<ci::vec2, kBlockSize * kBlockSize> Block;
+
+	struct Level {
+		size_t width{ 0 };
+		size_t height{ 0 };
+		//! Blocks that contain a non-zero offset, see getBlockKey().
+		std::unordered_map<uint32_t, Block> blocks;
+	};
+
+	static WarpResidualGridRef create() { return std::make_shared<WarpResidualGrid>(); }
+	//! Creates a grid with a single level of \a width x \a height offsets in row-major order. Blocks whose offsets are all within
+	//! \a threshold of zero are left out.
+	static WarpResidualGridRef create( size_t width, size_t height, const ci::vec2 *offsets, float threshold = 0 );
+
+	//! Adds a level of \a width x \a height offsets, which are all zero. Sizes are clamped to [2, kMaxSize]. Returns the index of the level.
+	size_t addLevel( size_t width, size_t height );
+	//! Returns the number of levels.
+	size_t getNumLevels() const { return mLevels.size(); }
+	//! Returns a level.
+	const Level &getLevel( size_t level ) const { return mLevels.at( level ); }
+	//! Returns the number of stored blocks of all levels.
+	size_t getNumBlocks() const;
+	//! Returns \c TRUE if all offsets are zero.
+	bool isEmpty() const { return getNumBlocks() == 0; }
+
+	//! Returns an offset of a level.
+	ci::vec2 getOffset( size_t level, size_t x, size_t y ) const;
+	//! Sets an offset of a level.
+	void setOffset( size_t level, size_t x, size_t y, const ci::vec2 &offset );
+	//! Sets all offsets of a block of a level. The block is removed if they are all zero.
+	void setBlock( size_t level, size_t bx, size_t by, const Block &block );
+
+	//! Returns the sum of the offsets of all levels at the normalized position \a uv.
+	ci::vec2 evaluate( const ci::vec2 &uv ) const;
+
+	//! Returns a copy with every level mirrored horizontally or vertically, for a warp whose control points were flipped.
+	WarpResidualGridRef flipped( bool horizontal ) const;
+	//! Returns a copy with every offset multiplied by \a transform.
+	WarpResidualGridRef transformed( const ci::mat2 &transform ) const;
+
+	bool operator==( const WarpResidualGrid &other ) const;
+	bool operator!=( const WarpResidualGrid &other ) const { return !( *this == other ); }
+
+	//! Returns the grid as a <residuals> element, with a <level> for each level and a <block> for each stored block.
+	ci::XmlTree toXml() const;
+	//! Reads a grid from a <residuals> element. Throws a std::invalid_argument if it is malformed.
+	static WarpResidualGridRef fromXml( const ci::XmlTree &xml );
+	//! Parses the offsets of a block, 64 pairs of numbers separated by spaces. Returns \c FALSE if the text is malformed.
+	static bool parseBlock( const std::string &text, Block &block );
+
+	//! Returns the size in bytes of the binary representation, a multiple of 8.
+	size_t getBinarySize() const;
+	//! Writes the binary representation to \a data, which must hold getBinarySize() bytes and be aligned to 4 bytes.
+	void writeBinary( void *data ) const;
+	//! Reads the binary representation of a grid. Returns an empty reference if the data is invalid.
+	static WarpResidualGridRef readBinary( const void *data, size_t size );
+
+	//! Continues a 64-bit FNV-1a \a hash with the offsets, in a deterministic order.
+	uint64_t hash( uint64_t hash ) const;
+
+  private:
+	static uint32_t getBlockKey( size_t bx, size_t by ) { return uint32_t( ( by << 16 ) | bx ); }
+	//! Returns the keys of the blocks of a level in ascending order.
+	static std::vector<uint32_t> getSortedKeys( const Level &level );
+
+	ci::vec2 getSample( const Level &level, size_t x, size_t y ) const;
+
+	std::vector<Level> mLevels;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,176 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <cinder/Timer.h>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpSync>              WarpSyncRef;
+typedef std::shared_ptr<class WarpSyncTransport>     WarpSyncTransportRef;
+typedef std::shared_ptr<class WarpSyncUdpTransport>  WarpSyncUdpTransportRef;
+#if !defined( CINDER_MSW )
+typedef std::shared_ptr<class WarpSyncUnixTransport> WarpSyncUnixTransportRef;
+#endif
+
+//! Sends and receives the datagrams of a WarpSync. Derive from this class to use your own network layer.
+class WarpSyncTransport {
+  public:
+	virtual ~WarpSyncTransport() = default;
+
+	//! Sends a datagram to all peers.
+	virtual void send( const void *data, size_t size ) = 0;
+	//! Receives a pending datagram without blocking. Returns its size, or 0 if no datagram was pending.
+	virtual size_t receive( void *data, size_t capacity ) = 0;
+};
+
+//! Sends datagrams to a UDP multicast group. Every process that joins the group receives them, including
+//! processes on the same machine.
+class WarpSyncUdpTransport : public WarpSyncTransport {
+  public:
+	//! Joins the multicast \a group on \a port. Throws a std::runtime_error if the socket can't be created.
+	static WarpSyncUdpTransportRef create( const std::string &group = "239.255.42.99", uint16_t port = 9731 ) { return std::make_shared<WarpSyncUdpTransport>( group, port ); }
+
+	WarpSyncUdpTransport( const std::string &group, uint16_t port );
+	~WarpSyncUdpTransport() override;
+
+	WarpSyncUdpTransport( const WarpSyncUdpTransport & ) = delete;
+	WarpSyncUdpTransport &operator=( const WarpSyncUdpTransport & ) = delete;
+
+	void   send( const void *data, size_t size ) override;
+	size_t receive( void *data, size_t capacity ) override;
+
+  private:
+	//! Native socket handle, -1 if the socket is invalid.
+	intptr_t mSocket;
+	uint32_t mGroup;
+	uint16_t mPort;
+};
+
+#if !defined( CINDER_MSW )
+
+//! Sends datagrams to a fixed list of Unix domain sockets, for processes on the same machine. Not available on Windows.
+class WarpSyncUnixTransport : public WarpSyncTransport {
+  public:
+	//! Binds a socket to \a path and sends to the sockets bound to \a peers. Throws a std::runtime_error if the socket can't be created.
+	static WarpSyncUnixTransportRef create( const std::string &path, const std::vector<std::string> &peers ) { return std::make_shared<WarpSyncUnixTransport>( path, peers ); }
+
+	WarpSyncUnixTransport( const std::string &path, const std::vector<std::string> &peers );
+	~WarpSyncUnixTransport() override;
+
+	WarpSyncUnixTransport( const WarpSyncUnixTransport & ) = delete;
+	WarpSyncUnixTransport &operator=( const WarpSyncUnixTransport & ) = delete;
+
+	void   send( const void *data, size_t size ) override;
+	size_t receive( void *data, size_t capacity ) override;
+
+  private:
+	int                      mSocket;
+	std::string              mPath;
+	std::vector<std::string> mPeers;
+};
+
+#endif
+
+//! Keeps the warps of several render nodes in sync. Each node calls update() once per frame. Changes to the control points,
+//! corners and blend parameters of a warp are broadcast as a delta against the previous version of that warp, quantized to 16 bits.
+//! A change to the residual corrections of a bilinear warp is sent as a keyframe, which carries them without loss.
+//! A node that misses a delta asks for a keyframe, which is also sent periodically so that nodes can join at any time.
+//! Warps are matched by their index in the list. The sync keeps its own clock, so it does not require a running app.
+class WarpSync {
+  public:
+	//! Creates a sync using the given transport.
+	static WarpSyncRef create( const WarpSyncTransportRef &transport ) { return std::make_shared<WarpSync>( transport ); }
+
+	explicit WarpSync( const WarpSyncTransportRef &transport );
+
+	WarpSync( const WarpSync & ) = delete;
+	WarpSync &operator=( const WarpSync & ) = delete;
+
+	//! Applies the changes received from other nodes, then broadcasts local changes. Call this on the render thread.
+	void update( WarpList &warps );
+
+	//! Returns the interval between keyframes in seconds.
+	double getKeyframeInterval() const { return mKeyframeInterval; }
+	//! Sets the interval between keyframes in seconds.
+	void setKeyframeInterval( double seconds ) { mKeyframeInterval = seconds; }
+
+	//! Returns the number of datagrams that were sent.
+	uint64_t getNumSent() const { return mNumSent; }
+	//! Returns the number of deltas and keyframes that were applied.
+	uint64_t getNumApplied() const { return mNumApplied; }
+	//! Returns the number of deltas that were dropped, because they did not apply to the current version of a warp.
+	uint64_t getNumDropped() const { return mNumDropped; }
+
+	//! Maximum deviation of a synchronized control point or corner, in normalized coordinates.
+	static constexpr float kPointTolerance = 0.5f * 2.0f / 65535.0f;
+
+  private:
+	//! Last known version of a warp, shared by all nodes.
+	struct Snapshot {
+		uint32_t                 revision{ 0 };
+		Warp::WarpType           type{ Warp::WarpType::UNKNOWN };
+		size_t                   controlsX{ 0 };
+		size_t                   controlsY{ 0 };
+		int                      resolution{ 0 };
+		bool                     linear{ false };
+		bool                     adaptive{ false };
+		std::vector<uint16_t>    values;
+		//! Residual grid, which is only sent with keyframes.
+		WarpResidualGridConstRef residuals;
+
+		//! Set if another node asked for a keyframe.
+		bool keyframe{ false };
+		//! Set if we asked for a keyframe and are waiting for it.
+		bool waiting{ false };
+	};
+
+	//! Quantizes the state of a warp into \a values.
+	static void quantize( const Warp::State &state, std::vector<uint16_t> &values );
+	//! Stores a quantized value in the state.
+	static void dequantize( Warp::State &state, size_t index, uint16_t value );
+
+	void receive( WarpList &warps );
+	void broadcast( WarpList &warps );
+
+	void sendKeyframe( uint16_t warp, const Snapshot &snapshot );
+	void sendDelta( uint16_t warp, const Snapshot &snapshot, const std::vector<uint16_t> &values );
+	void sendRequest( uint16_t warp );
+
+	WarpSyncTransportRef  mTransport;
+	uint64_t              mSender;
+	std::vector<Snapshot> mSnapshots;
+	std::vector<uint16_t> mValues;
+	std::vector<uint8_t>  mBuffer;
+
+	ci::Timer mTimer;
+	double    mKeyframeInterval;
+	double    mJoinTime;
+	double    mKeyframeTime;
+
+	uint64_t mNumSent;
+	uint64_t mNumApplied;
+	uint64_t mNumDropped;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,82 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <atomic>
+#include <thread>
+
+namespace ph::warping {
+
+typedef std::shared_ptr<class WarpWatcher> WarpWatcherRef;
+
+//! Watches a settings xml file and reloads it when it changes on disk. The file is parsed on a background thread. update() compares
+//! the result with the live warps and only updates the warps that changed, so the shaders, buffers and meshes of the others are kept.
+//! Uses inotify on Linux and checks the modification time elsewhere. Versions of the file written by this process through
+//! ignoreContent(), like the compactions of a WarpJournal, are not reloaded.
+class WarpWatcher {
+  public:
+	//! Starts watching \a path. The file doesn't need to exist yet.
+	static WarpWatcherRef create( const ci::fs::path &path ) { return std::make_shared<WarpWatcher>( path ); }
+
+	explicit WarpWatcher( const ci::fs::path &path );
+	~WarpWatcher();
+
+	WarpWatcher( const WarpWatcher & ) = delete;
+	WarpWatcher &operator=( const WarpWatcher & ) = delete;
+
+	//! Applies the latest version of the file to \a warps. Call this once per frame on the render thread. Returns \c TRUE if any warp changed.
+	bool update( WarpList &warps );
+
+	//! Updates \a warps to match \a loaded, matching warps by their index. Warps of the same type receive the state of the loaded warp if
+	//! it differs. Warps of another type are replaced, surplus warps are removed. Returns the number of warps that changed.
+	static size_t apply( WarpList &warps, const WarpList &loaded );
+	//! Tells all watchers of \a path to skip the version of the file with the specified content, because it already matches the warps.
+	static void ignoreContent( const ci::fs::path &path, const std::string &content );
+
+	//! Returns the path of the watched file.
+	const ci::fs::path &getPath() const { return mPath; }
+	//! Returns the number of times the file was parsed successfully.
+	uint64_t getNumReloads() const { return mNumReloads; }
+	//! Returns the number of warps changed by update() so far.
+	uint64_t getNumChanged() const { return mNumChanged; }
+
+  private:
+	//! Waits for changes to the file and parses it.
+	void run();
+	//! Parses the file and hands the warps to the render thread. Errors are written to the console.
+	void reload();
+
+	ci::fs::path mPath;
+
+	std::thread       mThread;
+	std::atomic<bool> mIsRunning;
+
+	std::mutex mMutex;
+	WarpList   mPending;
+	bool       mHasPending;
+
+	std::atomic<uint64_t> mNumReloads;
+	uint64_t              mNumChanged;
+};
+
+} // namespace ph::warping
@@ -0,0 +1,150 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Warp.h"
+
+#include <stdexcept>
+#include <string_view>
+
+namespace ph::warping {
+
+//! Single-pass reader for warp settings xml. Warps are constructed while the document is scanned, without building a DOM.
+//! Only the first profile is loaded, like Warp::readSettings().
+class WarpXmlReader {
+  public:
+	//! Thrown when the document is malformed or does not match the warp settings schema.
+	class Exception : public std::runtime_error {
+	  public:
+		Exception( const std::string &message, size_t line, size_t column );
+
+		//! Returns the line of the error, starting at 1.
+		size_t getLine() const { return mLine; }
+		//! Returns the column of the error, starting at 1.
+		size_t getColumn() const { return mColumn; }
+
+	  private:
+		size_t mLine;
+		size_t mColumn;
+	};
+
+	//! Reads the warps from \a source. Files are memory-mapped when possible. Throws a WarpXmlReader::Exception on errors.
+	static WarpList read( const ci::DataSourceRef &source );
+	//! Reads the warps from \a size bytes of xml. Throws a WarpXmlReader::Exception on errors.
+	static WarpList read( const char *data, size_t size );
+
+	//! Warps of a named profile.
+	struct Profile {
+		std::string name;
+		WarpList    warps;
+	};
+
+	//! Reads the warps of all profiles from \a source. If \a active is not \c nullptr, it receives the name of the profile selected by the
+	//! file, or an empty string. Throws a WarpXmlReader::Exception on errors.
+	static std::vector<Profile> readProfiles( const ci::DataSourceRef &source, std::string *active = nullptr );
+	//! Reads the warps of all profiles from \a size bytes of xml. Throws a WarpXmlReader::Exception on errors.
+	static std::vector<Profile> readProfiles( const char *data, size_t size, std::string *active = nullptr );
+
+	//! Byte range of an element within the document.
+	struct Range {
+		size_t begin;
+		size_t end;
+	};
+
+	//! Returns the ranges of the maps in the first profile, so they can be read in parallel using readMap(). Attribute values are skipped
+	//! rather than parsed. Throws a WarpXmlReader::Exception on errors.
+	static std::vector<Range> findMaps( const char *data, size_t size );
+	//! Reads the warp of a map found by findMaps(). Returns an empty reference if the map contains no supported warp. Throws a
+	//! WarpXmlReader::Exception on errors, reporting the position within the whole document.
+	static WarpRef readMap( const char *data, size_t size, const Range &range );
+
+  private:
+	WarpXmlReader( const char *data, size_t size );
+
+	struct Attribute {
+		std::string_view name;
+		std::string      value;
+	};
+
+	WarpList parse();
+
+	//! Parses a start tag following the '<', including its attributes. Returns \c TRUE if the element is self-closing.
+	bool parseStartTag( std::string_view &name );
+	//! Parses a quoted attribute value and replaces entity references. When only scanning, the value is skipped.
+	void parseValue( std::string &value );
+	//! Parses a name.
+	std::string_view parseName();
+	//! Skips a comment, processing instruction, CDATA section or declaration.
+	void skipMarkup();
+	void skipWhitespace();
+	void skipPast( std::string_view terminator );
+	void expect( char c );
+
+	void startElement( std::string_view name, size_t depth );
+	void endElement( std::string_view name, size_t depth );
+
+	//! Returns the value of an attribute of the current element, or \c nullptr if it has none.
+	const std::string *find( std::string_view name ) const;
+	float getFloat( std::string_view name, float defaultValue ) const;
+	int   getInt( std::string_view name, int defaultValue ) const;
+	bool  getBool( std::string_view name, bool defaultValue ) const;
+
+	//! Throws an exception at the current position.
+	[[noreturn]] void fail( const std::string &message ) const { fail( message, mPos ); }
+	//! Throws an exception at the given position.
+	[[noreturn]] void fail( const std::string &message, const char *pos ) const;
+
+	const char *mBegin;
+	const char *mPos;
+	const char *mEnd;
+
+	//! Number of enclosing elements when reading a fragment of the document.
+	size_t mBaseDepth;
+	//! When set, only the structure of the document is scanned and the ranges of the maps are collected.
+	bool               mIsScanning;
+	std::vector<Range> mMaps;
+	//! When set, the warps of all profiles are read into \a mProfiles.
+	bool                 mIsReadingProfiles;
+	std::vector<Profile> mProfiles;
+	std::string          mActiveProfile;
+
+	std::vector<std::string_view> mStack;
+	std::vector<Attribute>        mAttributes;
+	size_t                        mNumAttributes;
+
+	WarpList    mWarps;
+	WarpRef     mWarp;
+	Warp::State mState;
+	const char *mTagPos;
+	const char *mWarpPos;
+	size_t      mNumCorners;
+	//! Fine corrections of the current warp, while reading its <residuals> element.
+	WarpResidualGridRef mResiduals;
+
+	int  mNumProfiles;
+	bool mInMap;
+	bool mHasWarp;
+	bool mInBlend;
+	bool mHasBlend;
+	bool mInResiduals;
+};
+
+} // namespace ph::warping
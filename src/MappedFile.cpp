@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MappedFile.h"
+
+#if defined( CINDER_MSW )
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ph::warping {
+
+MappedFileRef MappedFile::create( const ci::fs::path &path )
+{
+	auto file = std::make_shared<MappedFile>( path );
+	return file->isValid() ? file : nullptr;
+}
+
+#if defined( CINDER_MSW )
+
+MappedFile::MappedFile( const ci::fs::path &path )
+	: mData( nullptr )
+	, mSize( 0 )
+	, mFile( INVALID_HANDLE_VALUE )
+	, mMapping( nullptr )
+{
+	mFile = CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if( mFile == INVALID_HANDLE_VALUE )
+		return;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( mFile, &size ) || size.QuadPart == 0 )
+		return;
+
+	mMapping = CreateFileMappingW( mFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if( !mMapping )
+		return;
+
+	mData = MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 );
+	if( mData )
+		mSize = size_t( size.QuadPart );
+}
+
+MappedFile::~MappedFile()
+{
+	if( mData )
+		UnmapViewOfFile( mData );
+	if( mMapping )
+		CloseHandle( mMapping );
+	if( mFile != INVALID_HANDLE_VALUE )
+		CloseHandle( mFile );
+}
+
+#else
+
+MappedFile::MappedFile( const ci::fs::path &path )
+	: mData( nullptr )
+	, mSize( 0 )
+{
+	const int fd = open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+		return;
+
+	struct stat info;
+	if( fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+		// the mapping stays valid after closing the file
+		void *data = mmap( nullptr, size_t( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( data != MAP_FAILED ) {
+			mData = data;
+			mSize = size_t( info.st_size );
+		}
+	}
+
+	close( fd );
+}
+
+MappedFile::~MappedFile()
+{
+	if( mData )
+		munmap( const_cast<void *>( mData ), mSize );
+}
+
+#endif
+
+} // namespace ph::warping
@@ -0,0 +1,233 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StreamingTexture.h"
+
+#include <cinder/gl/Texture.h>
+#include <cinder/gl/scoped.h>
+
+#include <cstring>
+
+using namespace ci;
+
+namespace ph::warping {
+
+StreamingTexture::StreamingTexture( int width, int height, const Format &format )
+	: mWidth( glm::max( width, 1 ) )
+	, mHeight( glm::max( height, 1 ) )
+	, mFormat( format )
+	, mIsPersistent( false )
+	, mWriting( ~size_t( 0 ) )
+	, mSequence( 0 )
+	, mNumUploaded( 0 )
+	, mNumDropped( 0 )
+	, mNumLate( 0 )
+{
+	mIsPersistent = mFormat.isPersistent() && gl::isExtensionAvailable( "GL_ARB_buffer_storage" );
+
+	const auto size = GLsizeiptr( getDataSize() );
+	const auto fmt = gl::Texture2d::Format().internalFormat( mFormat.getInternalFormat() ).minFilter( GL_LINEAR ).magFilter( GL_LINEAR );
+
+	mBuffers.resize( mFormat.getNumBuffers() );
+	for( auto &buffer : mBuffers ) {
+		buffer.texture = gl::Texture2d::create( mWidth, mHeight, fmt );
+
+		glGenBuffers( 1, &buffer.pbo );
+		gl::ScopedBuffer scpBuffer( GL_PIXEL_UNPACK_BUFFER, buffer.pbo );
+
+		if( mIsPersistent ) {
+			// map once and keep the buffer mapped, the producer writes to it directly
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage( GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags );
+			buffer.mapped = static_cast<uint8_t *>( glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, flags ) );
+		}
+		else {
+			glBufferData( GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW );
+			map( buffer );
+		}
+	}
+}
+
+StreamingTexture::~StreamingTexture()
+{
+	for( auto &buffer : mBuffers ) {
+		if( buffer.mapped ) {
+			gl::ScopedBuffer scpBuffer( GL_PIXEL_UNPACK_BUFFER, buffer.pbo );
+			glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+		}
+
+		glDeleteBuffers( 1, &buffer.pbo );
+	}
+}
+
+uint8_t *StreamingTexture::lock()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	// only one frame can be written at a time
+	if( mWriting < mBuffers.size() )
+		return mBuffers[mWriting].mapped;
+
+	size_t free = ~size_t( 0 );
+	size_t ready = ~size_t( 0 );
+	for( size_t i = 0; i < mBuffers.size(); ++i ) {
+		const auto &buffer = mBuffers[i];
+		if( !buffer.mapped )
+			continue;
+		if( buffer.state == State::FREE && free >= mBuffers.size() )
+			free = i;
+		else if( buffer.state == State::READY && ( ready >= mBuffers.size() || buffer.sequence < mBuffers[ready].sequence ) )
+			ready = i;
+	}
+
+	// if the render thread can't keep up, overwrite the oldest frame it did not upload yet
+	if( free >= mBuffers.size() && ready < mBuffers.size() ) {
+		free = ready;
+		++mNumDropped;
+	}
+
+	if( free >= mBuffers.size() ) {
+		++mNumDropped;
+		return nullptr;
+	}
+
+	mWriting = free;
+	mBuffers[mWriting].state = State::WRITING;
+
+	return mBuffers[mWriting].mapped;
+}
+
+void StreamingTexture::unlock()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	if( mWriting >= mBuffers.size() )
+		return;
+
+	mBuffers[mWriting].state = State::READY;
+	mBuffers[mWriting].sequence = ++mSequence;
+	mWriting = ~size_t( 0 );
+}
+
+bool StreamingTexture::write( const void *data )
+{
+	auto ptr = lock();
+	if( !ptr )
+		return false;
+
+	std::memcpy( ptr, data, getDataSize() );
+	unlock();
+
+	return true;
+}
+
+const gl::Texture2dRef &StreamingTexture::update()
+{
+	size_t latest = ~size_t( 0 );
+	size_t current = ~size_t( 0 );
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		for( size_t i = 0; i < mBuffers.size(); ++i ) {
+			auto &buffer = mBuffers[i];
+
+			// buffers are free again once the GPU is done reading from them
+			if( buffer.state == State::RETIRED && buffer.fence->clientWaitSync( 0, 0 ) != GL_TIMEOUT_EXPIRED ) {
+				buffer.fence.reset();
+				buffer.state = State::FREE;
+			}
+
+			if( buffer.state == State::READY && ( latest >= mBuffers.size() || buffer.sequence > mBuffers[latest].sequence ) )
+				latest = i;
+			else if( buffer.state == State::CURRENT )
+				current = i;
+		}
+
+		// drop older frames that were published in the meantime
+		for( size_t i = 0; i < mBuffers.size() && latest < mBuffers.size(); ++i ) {
+			if( i != latest && mBuffers[i].state == State::READY ) {
+				mBuffers[i].state = State::FREE;
+				++mNumDropped;
+			}
+		}
+
+		if( latest < mBuffers.size() )
+			mBuffers[latest].state = State::CURRENT;
+	}
+
+	if( latest < mBuffers.size() ) {
+		upload( mBuffers[latest] );
+		mTexture = mBuffers[latest].texture;
+		++mNumUploaded;
+
+		// the previous texture can be reused once the GPU is done sampling it
+		if( current < mBuffers.size() ) {
+			std::lock_guard<std::mutex> lock( mMutex );
+			mBuffers[current].fence = gl::Sync::create();
+			mBuffers[current].state = State::RETIRED;
+		}
+	}
+	else if( mTexture ) {
+		++mNumLate;
+	}
+
+	// without persistent mapping, free buffers are mapped here so the producer can write to them
+	if( !mIsPersistent ) {
+		for( auto &buffer : mBuffers ) {
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( buffer.state == State::FREE && !buffer.mapped )
+				map( buffer );
+		}
+	}
+
+	return mTexture;
+}
+
+void StreamingTexture::map( Buffer &buffer )
+{
+	gl::ScopedBuffer scpBuffer( GL_PIXEL_UNPACK_BUFFER, buffer.pbo );
+
+	// orphan the previous contents, so the driver doesn't have to wait for pending uploads
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+	buffer.mapped = static_cast<uint8_t *>( glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr( getDataSize() ), flags ) );
+}
+
+void StreamingTexture::upload( Buffer &buffer )
+{
+	gl::ScopedBuffer scpBuffer( GL_PIXEL_UNPACK_BUFFER, buffer.pbo );
+
+	if( !mIsPersistent ) {
+		glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+		buffer.mapped = nullptr;
+	}
+
+	// the copy from the pixel buffer to the texture is performed asynchronously by the GPU
+	gl::ScopedTextureBind scpTex( buffer.texture );
+
+	// rows are tightly packed, restore the caller's alignment afterwards
+	GLint alignment = 4;
+	glGetIntegerv( GL_UNPACK_ALIGNMENT, &alignment );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, mFormat.getDataFormat(), mFormat.getDataType(), nullptr );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, alignment );
+}
+
+} // namespace ph::warping
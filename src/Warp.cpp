@@ -19,6 +19,9 @@
  */
 
 #include "Warp.h"
+#include "MappedFile.h"
+#include "WarpBinary.h"
+#include "WarpXmlReader.h"
 
 #include <cinder/Xml.h>
 #include <cinder/app/App.h>
@@ -26,17 +29,22 @@
 #include <cinder/gl/draw.h>
 #include <cinder/gl/scoped.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
 using namespace ci;
 using namespace ci::app;
 
 namespace ph::warping {
 
-std::atomic<bool> Warp::sIsEditMode{ false };
-std::atomic<bool> Warp::sIsGammaMode{ false };
-
 Warp::Warp( WarpType type )
 	: mType( type )
+	, mContext( WarpContext::getDefault() )
 	, mIsDirty( true )
+	, mRevision( 0 )
+	, mBlendRevision( 0 )
+	, mIsInFrame( false )
 	, mWidth( 640 )
 	, mHeight( 480 )
 	, mBrightness( 1.0f )
@@ -47,6 +55,10 @@ Warp::Warp( WarpType type )
 	, mGamma( 1.0f )
 	, mEdges( 0.0f, 0.0f, 1.0f, 1.0f )
 	, mExponent( 2.0f )
+	, mYuvColorSpace( YuvColorSpace::REC709 )
+	, mStateFront( 0 )
+	, mStateBack( 2 )
+	, mStateMiddle( 1 )
 	, mSelectedTime( 0 )
 {
 	mWindowSize = vec2( mWidth, mHeight );
@@ -62,6 +74,45 @@ void Warp::draw( const gl::Texture2dRef &texture, const Area &srcArea )
 	draw( texture, srcArea, Rectf( getBounds() ) );
 }
 
+void Warp::draw( const gl::Texture2dRef &luma, const gl::Texture2dRef &chroma )
+{
+	draw( luma, chroma, luma->getBounds(), Rectf( getBounds() ) );
+}
+
+void Warp::draw( const gl::Texture2dRef &luma, const gl::Texture2dRef &chroma, const Area &srcArea )
+{
+	draw( luma, chroma, srcArea, Rectf( getBounds() ) );
+}
+
+void Warp::setYuvUniforms( const gl::GlslProgRef &shader ) const
+{
+	// luma coefficients of the red and blue channels
+	const bool  isRec601 = mYuvColorSpace == YuvColorSpace::REC601 || mYuvColorSpace == YuvColorSpace::REC601_FULL_RANGE;
+	const float kr = isRec601 ? 0.299f : 0.2126f;
+	const float kb = isRec601 ? 0.114f : 0.0722f;
+	const float kg = 1.0f - kr - kb;
+
+	// video range content uses 16-235 for luma and 16-240 for chroma
+	const bool  isFullRange = mYuvColorSpace == YuvColorSpace::REC601_FULL_RANGE || mYuvColorSpace == YuvColorSpace::REC709_FULL_RANGE;
+	const float ys = isFullRange ? 1.0f : 255.0f / 219.0f;
+	const float cs = isFullRange ? 1.0f : 255.0f / 224.0f;
+
+	// R = Y + rv * V, G = Y - gu * U - gv * V, B = Y + bu * U (column-major)
+	const float rv = 2.0f * ( 1.0f - kr ) * cs;
+	const float bu = 2.0f * ( 1.0f - kb ) * cs;
+	const float gu = 2.0f * kb * ( 1.0f - kb ) / kg * cs;
+	const float gv = 2.0f * kr * ( 1.0f - kr ) / kg * cs;
+
+	shader->uniform( "uYuvMatrix", mat3( ys, ys, ys, 0.0f, -gu, bu, rv, -gv, 0.0f ) );
+	shader->uniform( "uYuvOffset", vec3( isFullRange ? 0.0f : 16.0f / 255.0f, 0.5f, 0.5f ) );
+}
+
+void Warp::draw( const WarpCanvasRef &canvas )
+{
+	if( canvas )
+		draw( canvas, canvas->getBounds() );
+}
+
 bool Warp::clip( Area &srcArea, Rectf &destRect ) const
 {
 	bool clipped = false;
@@ -138,15 +189,15 @@ XmlTree Warp::toXml() const
 	}
 	xml.setAttribute( "width", mControlsX );
 	xml.setAttribute( "height", mControlsY );
-	xml.setAttribute( "brightness", mBrightness );
+	xml.setAttribute( "brightness", formatFloat( mBrightness ) );
 
 	// add <control-point> tags (column-major)
 	std::vector<vec2>::const_iterator itr;
 	for( itr = mPoints.begin(); itr != mPoints.end(); ++itr ) {
 		XmlTree cp;
 		cp.setTag( "control-point" );
-		cp.setAttribute( "x", ( *itr ).x );
-		cp.setAttribute( "y", ( *itr ).y );
+		cp.setAttribute( "x", formatFloat( ( *itr ).x ) );
+		cp.setAttribute( "y", formatFloat( ( *itr ).y ) );
 
 		xml.push_back( cp );
 	}
@@ -154,28 +205,28 @@ XmlTree Warp::toXml() const
 	// add <blend> parameters
 	XmlTree blend;
 	blend.setTag( "blend" );
-	blend.setAttribute( "exponent", mExponent );
+	blend.setAttribute( "exponent", formatFloat( mExponent ) );
 	{
 		XmlTree edges;
 		edges.setTag( "edges" );
-		edges.setAttribute( "left", mEdges.x );
-		edges.setAttribute( "top", mEdges.y );
-		edges.setAttribute( "right", mEdges.z );
-		edges.setAttribute( "bottom", mEdges.w );
+		edges.setAttribute( "left", formatFloat( mEdges.x ) );
+		edges.setAttribute( "top", formatFloat( mEdges.y ) );
+		edges.setAttribute( "right", formatFloat( mEdges.z ) );
+		edges.setAttribute( "bottom", formatFloat( mEdges.w ) );
 		blend.push_back( edges );
 
 		XmlTree gamma;
 		gamma.setTag( "gamma" );
-		gamma.setAttribute( "red", mGamma.x );
-		gamma.setAttribute( "green", mGamma.y );
-		gamma.setAttribute( "blue", mGamma.z );
+		gamma.setAttribute( "red", formatFloat( mGamma.x ) );
+		gamma.setAttribute( "green", formatFloat( mGamma.y ) );
+		gamma.setAttribute( "blue", formatFloat( mGamma.z ) );
 		blend.push_back( gamma );
 
 		XmlTree luminance;
 		luminance.setTag( "luminance" );
-		luminance.setAttribute( "red", mLuminance.x );
-		luminance.setAttribute( "green", mLuminance.y );
-		luminance.setAttribute( "blue", mLuminance.z );
+		luminance.setAttribute( "red", formatFloat( mLuminance.x ) );
+		luminance.setAttribute( "green", formatFloat( mLuminance.y ) );
+		luminance.setAttribute( "blue", formatFloat( mLuminance.z ) );
 		blend.push_back( luminance );
 	}
 	xml.push_back( blend );
@@ -226,7 +277,81 @@ void Warp::fromXml( const XmlTree &xml )
 	}
 
 	// reconstruct warp
-	mIsDirty = true;
+	++mBlendRevision;
+	invalidate();
+}
+
+Warp::State Warp::getState() const
+{
+	State state;
+	state.type = mType;
+	state.controlsX = mControlsX;
+	state.controlsY = mControlsY;
+	state.points = mPoints;
+	state.brightness = mBrightness;
+	state.luminance = mLuminance;
+	state.gamma = mGamma;
+	state.edges = mEdges;
+	state.exponent = mExponent;
+
+	return state;
+}
+
+void Warp::setState( const State &state )
+{
+	if( state.type != mType || state.points.size() != state.controlsX * state.controlsY )
+		return;
+
+	// blend parameters are passed to the shader, they don't require reconstruction
+	if( state.brightness != mBrightness || state.luminance != mLuminance || state.gamma != mGamma || state.edges != mEdges || state.exponent != mExponent ) {
+		mBrightness = state.brightness;
+		mLuminance = state.luminance;
+		mGamma = state.gamma;
+		mEdges = state.edges;
+		mExponent = state.exponent;
+		++mBlendRevision;
+	}
+
+	if( state.controlsX != mControlsX || state.controlsY != mControlsY || state.points != mPoints ) {
+		mControlsX = state.controlsX;
+		mControlsY = state.controlsY;
+		mPoints = state.points;
+
+		invalidate();
+	}
+}
+
+void Warp::publishState( const State &state )
+{
+	std::lock_guard<std::mutex> lock( mPublishMutex );
+
+	// write to the back buffer, then swap it with the middle buffer and mark it as new
+	mStates[mStateBack] = state;
+	mStateBack = mStateMiddle.exchange( mStateBack | 4, std::memory_order_acq_rel ) & 3;
+}
+
+std::string Warp::formatFloat( float value )
+{
+	// 9 significant digits are enough to restore every float exactly
+	char buffer[32];
+	std::snprintf( buffer, sizeof( buffer ), "%.9g", value );
+
+	return buffer;
+}
+
+bool Warp::applyPublishedState()
+{
+	// the warp must not change between begin() and end()
+	if( mIsInFrame )
+		return false;
+	if( !( mStateMiddle.load( std::memory_order_relaxed ) & 4 ) )
+		return false;
+
+	// swap the front buffer with the middle buffer, which holds the latest snapshot
+	mStateFront = mStateMiddle.exchange( mStateFront, std::memory_order_acq_rel ) & 3;
+	setState( mStates[mStateFront] );
+
+	return true;
 }
 
 bool Warp::setSize( float w, float h )
@@ -236,7 +361,8 @@ bool Warp::setSize( float w, float h )
 	mWidth = w;
 	mHeight = h;
 	mWindowSize = vec2( w, h );
-	mIsDirty |= changed;
+	if( changed )
+		invalidate();
 
 	return changed;
 }
@@ -254,7 +380,7 @@ void Warp::setControlPoint( unsigned index, const vec2 &pos )
 		return;
 	mPoints[index] = pos;
 
-	mIsDirty = true;
+	invalidate();
 }
 
 void Warp::moveControlPoint( unsigned index, const vec2 &shift )
@@ -263,7 +389,63 @@ void Warp::moveControlPoint( unsigned index, const vec2 &shift )
 		return;
 	mPoints[index] += shift;
 
-	mIsDirty = true;
+	invalidate();
+}
+
+bool Warp::nudgeControlPoint( const vec2 &pixels )
+{
+	if( !mContext->isEditModeEnabled() )
+		return false;
+	if( mSelected >= mPoints.size() )
+		return false;
+
+	mPoints[mSelected] += pixels / mWindowSize;
+	invalidate();
+
+	return true;
+}
+
+vec2 Warp::getNudge( const KeyEvent &event )
+{
+	const float step = event.isShiftDown() ? 10.0f : 0.5f;
+
+	switch( event.getCode() ) {
+	case KeyEvent::KEY_UP:
+		return vec2( 0, -step );
+	case KeyEvent::KEY_DOWN:
+		return vec2( 0, step );
+	case KeyEvent::KEY_LEFT:
+		return vec2( -step, 0 );
+	case KeyEvent::KEY_RIGHT:
+		return vec2( step, 0 );
+	default:
+		return vec2( 0 );
+	}
+}
+
+void Warp::setControlPoints( const vec2 *points, size_t count )
+{
+	count = glm::min( count, mPoints.size() );
+	if( count == 0 )
+		return;
+
+	std::copy( points, points + count, mPoints.begin() );
+
+	invalidate();
+}
+
+void Warp::transformControlPoints( const mat3 &transform )
+{
+	for( auto &pt : mPoints ) {
+		vec3 p = transform * vec3( pt, 1 );
+
+		if( p.z != 0 )
+			p.z = 1 / p.z;
+
+		pt = vec2( p.x, p.y ) * p.z;
+	}
+
+	invalidate();
 }
 
 void Warp::selectControlPoint( unsigned index )
@@ -307,18 +489,18 @@ void Warp::selectClosestControlPoint( const WarpList &warps, const ivec2 &positi
 {
 	WarpRef  warp;
 	unsigned index = 0;
-	float    d, distance = FLT_MAX;
+	size_t   w;
+	float    distance;
 
-	// find warp and distance to closest control point
-	for( auto itr = warps.rbegin(); itr != warps.rend(); ++itr ) {
-		const unsigned i = ( *itr )->findControlPoint( position, &d );
+	// store mouse position for later use in e.g. WarpBilinear::keyDown().
+	for( const auto &itr : warps )
+		itr->mMouse = position;
 
-		if( d < distance ) {
-			distance = d;
-			index = i;
-			warp = *itr;
-		}
-	}
+	// find warp and closest control point
+	auto &controlPoints = WarpContext::get( warps )->getControlPointIndex();
+	controlPoints.update( warps );
+	if( controlPoints.findClosest( position, &w, &index, &distance ) )
+		warp = warps[w];
 
 	// select the closest control point and deselect all others
 	for( const auto &itr : warps ) {
@@ -335,62 +517,56 @@ void Warp::setSize( const WarpList &warps, float w, float h )
 		warp->setSize( w, h );
 }
 
-WarpList Warp::readSettings( const DataSourceRef &source )
+WarpRef Warp::create( WarpType type )
 {
-	XmlTree  doc;
-	WarpList warps;
+	switch( type ) {
+	case WarpType::BILINEAR:
+		return WarpBilinearRef( new WarpBilinear() );
+	case WarpType::PERSPECTIVE:
+		return WarpPerspectiveRef( new WarpPerspective() );
+	case WarpType::PERSPECTIVE_BILINEAR:
+		return WarpPerspectiveBilinearRef( new WarpPerspectiveBilinear() );
+	default:
+		return WarpRef();
+	}
+}
 
-	// try to load the specified xml file
+WarpList Warp::readSettings( const DataSourceRef &source )
+{
+	// construct the warps while scanning the document, without building a DOM
 	try {
-		doc = XmlTree( source );
+		return WarpXmlReader::read( source );
 	}
-	catch( ... ) {
-		return warps;
+	catch( const std::exception &exc ) {
+		app::console() << exc.what() << std::endl;
 	}
 
-	// check if this is a valid file
-	bool isWarp = doc.hasChild( "warp-config" );
-	if( !isWarp )
-		return warps;
+	return WarpList();
+}
 
-	//
-	if( isWarp ) {
-		// get first profile
-		XmlTree profileXml = doc.getChild( "warp-config/profile" );
-
-		// iterate maps
-		for( XmlTree::ConstIter child = profileXml.begin( "map" ); child != profileXml.end(); ++child ) {
-			XmlTree warpXml = child->getChild( "warp" );
-
-			// create warp of the correct type
-			auto method = warpXml.getAttributeValue<std::string>( "method", "unknown" );
-			if( method == "bilinear" ) {
-				WarpBilinearRef warp( new WarpBilinear() );
-				warp->fromXml( warpXml );
-				warps.push_back( warp );
-			}
-			else if( method == "perspective" ) {
-				WarpPerspectiveRef warp( new WarpPerspective() );
-				warp->fromXml( warpXml );
-				warps.push_back( warp );
-			}
-			else if( method == "perspective-bilinear" ) {
-				WarpPerspectiveBilinearRef warp( new WarpPerspectiveBilinear() );
-				warp->fromXml( warpXml );
-				warps.push_back( warp );
-			}
-		}
-	}
+void Warp::writeSettings( const WarpList &warps, const DataTargetRef &target )
+{
+	// create default <profile>, see WarpConfig for multiple profiles
+	XmlTree profile = createProfileXml( warps );
 
-	return warps;
+	// create config document and root <warp-config>
+	XmlTree doc;
+	doc.setTag( "warp-config" );
+	doc.setAttribute( "version", "1.1" );
+	doc.setAttribute( "profile", "default" );
+
+	// add profile to root
+	doc.push_back( profile );
+
+	// write file
+	doc.write( target );
 }
 
-void Warp::writeSettings( const WarpList &warps, const DataTargetRef &target )
+XmlTree Warp::createProfileXml( const WarpList &warps, const std::string &name )
 {
-	// create default <profile> (profiles are not yet supported)
 	XmlTree profile;
 	profile.setTag( "profile" );
-	profile.setAttribute( "name", "default" );
+	profile.setAttribute( "name", name );
 
 	//
 	for( unsigned i = 0; i < warps.size(); ++i ) {
@@ -407,21 +583,131 @@ void Warp::writeSettings( const WarpList &warps, const DataTargetRef &target )
 		profile.push_back( map );
 	}
 
-	// create config document and root <warp-config>
-	XmlTree doc;
-	doc.setTag( "warp-config" );
-	doc.setAttribute( "version", "1.1" );
-	doc.setAttribute( "profile", "default" );
+	return profile;
+}
 
-	// add profile to root
-	doc.push_back( profile );
+WarpList Warp::readBinarySettings( const DataSourceRef &source )
+{
+	WarpList warps;
+
+	// map the file if possible, otherwise read it into memory
+	MappedFileRef file;
+	BufferRef     buffer;
+	const void *  data = nullptr;
+	size_t        size = 0;
+
+	try {
+		if( source->isFilePath() )
+			file = MappedFile::create( source->getFilePath() );
+
+		if( file ) {
+			data = file->getData();
+			size = file->getSize();
+		}
+		else {
+			buffer = source->getBuffer();
+			data = buffer->getData();
+			size = buffer->getSize();
+		}
+	}
+	catch( ... ) {
+		return warps;
+	}
+
+	// check if this is a valid file
+	const auto header = validateWarpBinary( data, size );
+	if( !header )
+		return warps;
+
+	const auto records = getWarpBinaryRecords( header );
+	for( uint32_t i = 0; i < header->numWarps; ++i ) {
+		const auto &record = records[i];
+
+		// create warp of the correct type
+		WarpRef warp = create( WarpType( record.type ) );
+		if( !warp )
+			continue;
+
+		// copy the settings straight from the record
+		auto state = warp->getState();
+		readWarpBinaryRecord( record, state );
+		const auto points = reinterpret_cast<const vec2 *>( getWarpBinaryPoints( header, record ) );
+		state.points.assign( points, points + state.controlsX * state.controlsY );
+
+		// the residual grid, if any, follows the control points
+		if( record.residuals > 0 )
+			state.residuals = WarpResidualGrid::readBinary( points + state.points.size(), record.residuals );
+
+		warp->setState( state );
+		warps.push_back( warp );
+	}
+
+	return warps;
+}
+
+void Warp::writeBinarySettings( const WarpList &warps, const DataTargetRef &target )
+{
+	static_assert( sizeof( vec2 ) == 2 * sizeof( float ), "control points are written as pairs of floats" );
+
+	std::vector<State> states;
+	states.reserve( warps.size() );
+
+	size_t size = sizeof( WarpBinaryHeader ) + warps.size() * sizeof( WarpBinaryRecord );
+	for( const auto &warp : warps ) {
+		states.push_back( warp->getState() );
+		size += states.back().points.size() * sizeof( vec2 );
+		if( states.back().residuals )
+			size += states.back().residuals->getBinarySize();
+	}
+
+	// build the file in memory
+	std::vector<uint64_t> storage( ( size + 7 ) / 8 );
+	auto                  bytes = reinterpret_cast<uint8_t *>( storage.data() );
+
+	auto header = reinterpret_cast<WarpBinaryHeader *>( bytes );
+	std::memcpy( header->magic, "WARPBIN", 8 );
+	header->version = WarpBinaryHeader::kVersion;
+	header->headerSize = sizeof( WarpBinaryHeader );
+	header->recordSize = sizeof( WarpBinaryRecord );
+	header->numWarps = uint32_t( warps.size() );
+	header->size = size;
+
+	auto   records = reinterpret_cast<WarpBinaryRecord *>( bytes + sizeof( WarpBinaryHeader ) );
+	size_t offset = sizeof( WarpBinaryHeader ) + warps.size() * sizeof( WarpBinaryRecord );
+	for( size_t i = 0; i < states.size(); ++i ) {
+		const auto &state = states[i];
+		auto &      record = records[i];
+
+		writeWarpBinaryRecord( state, record );
+		record.points = offset;
+		std::memcpy( bytes + offset, state.points.data(), state.points.size() * sizeof( vec2 ) );
+		offset += state.points.size() * sizeof( vec2 );
+
+		if( state.residuals ) {
+			record.residuals = uint32_t( state.residuals->getBinarySize() );
+			state.residuals->writeBinary( bytes + offset );
+			offset += record.residuals;
+		}
+	}
+
+	header->crc = crc32( bytes + sizeof( WarpBinaryHeader ), size - sizeof( WarpBinaryHeader ) );
 
 	// write file
-	doc.write( target );
+	target->getStream()->writeData( bytes, size );
 }
 
 bool Warp::handleMouseMove( WarpList &warps, MouseEvent &event )
 {
+	const auto &context = WarpContext::get( warps );
+	if( context->mIsInputCoalescing ) {
+		// only the last mouse move determines the selection
+		if( context->mPendingMouseDrag || context->mPendingNudge != vec2( 0 ) )
+			processInput( warps );
+
+		context->mPendingMouseMove = std::make_unique<MouseEvent>( event );
+		return false;
+	}
+
 	// find and select closest control point
 	selectClosestControlPoint( warps, event.getPos() );
 
@@ -430,6 +716,8 @@ bool Warp::handleMouseMove( WarpList &warps, MouseEvent &event )
 
 bool Warp::handleMouseDown( WarpList &warps, MouseEvent &event )
 {
+	processInput( warps );
+
 	// find and select closest control point
 	selectClosestControlPoint( warps, event.getPos() );
 
@@ -441,6 +729,24 @@ bool Warp::handleMouseDown( WarpList &warps, MouseEvent &event )
 
 bool Warp::handleMouseDrag( WarpList &warps, MouseEvent &event )
 {
+	const auto &context = WarpContext::get( warps );
+	if( context->mIsInputCoalescing ) {
+		if( context->mPendingMouseMove || context->mPendingNudge != vec2( 0 ) )
+			processInput( warps );
+
+		// dragging sets the absolute position of the selected control point, so only the last drag needs to be applied
+		bool handled = false;
+		for( auto itr = warps.begin(); itr != warps.end() && context->isEditModeEnabled() && !handled; ++itr )
+			handled = ( *itr )->mSelected < ( *itr )->getNumControlPoints();
+
+		if( handled ) {
+			context->mPendingMouseDrag = std::make_unique<MouseEvent>( event );
+			event.setHandled( true );
+		}
+
+		return handled;
+	}
+
 	for( auto itr = warps.rbegin(); itr != warps.rend() && !event.isHandled(); ++itr )
 		( *itr )->mouseDrag( event );
 
@@ -449,11 +755,40 @@ bool Warp::handleMouseDrag( WarpList &warps, MouseEvent &event )
 
 bool Warp::handleMouseUp( WarpList &warps, MouseEvent &event )
 {
+	processInput( warps );
+
+	// end the drag, every warp gets to see it
+	WarpContext::get( warps )->mIsDragging = false;
+
+	for( auto &warp : warps )
+		warp->mouseUp( event );
+
 	return false;
 }
 
 bool Warp::handleKeyDown( WarpList &warps, KeyEvent &event )
 {
+	const auto &context = WarpContext::get( warps );
+	const vec2  nudge = getNudge( event );
+	if( context->mIsInputCoalescing && nudge != vec2( 0 ) ) {
+		if( context->mPendingMouseMove || context->mPendingMouseDrag )
+			processInput( warps );
+
+		// cursor keys move the selected control point by a fixed step, so their sum can be applied at once
+		bool handled = false;
+		for( auto itr = warps.begin(); itr != warps.end() && context->isEditModeEnabled() && !handled; ++itr )
+			handled = ( *itr )->mSelected < ( *itr )->getNumControlPoints();
+
+		if( handled ) {
+			context->mPendingNudge += nudge;
+			event.setHandled( true );
+		}
+
+		return handled;
+	}
+
+	processInput( warps );
+
 	for( auto itr = warps.rbegin(); itr != warps.rend() && !event.isHandled(); ++itr )
 		( *itr )->keyDown( event );
 
@@ -471,11 +806,39 @@ bool Warp::handleKeyDown( WarpList &warps, KeyEvent &event )
 
 bool Warp::handleKeyUp( WarpList &warps, KeyEvent &event )
 {
+	processInput( warps );
+
 	return false;
 }
 
+void Warp::processInput( WarpList &warps )
+{
+	const auto &context = WarpContext::get( warps );
+	if( context->mPendingMouseMove ) {
+		const auto event = std::move( context->mPendingMouseMove );
+		selectClosestControlPoint( warps, event->getPos() );
+	}
+
+	if( context->mPendingMouseDrag ) {
+		const auto event = std::move( context->mPendingMouseDrag );
+		for( auto itr = warps.rbegin(); itr != warps.rend() && !event->isHandled(); ++itr )
+			( *itr )->mouseDrag( *event );
+	}
+
+	if( context->mPendingNudge != vec2( 0 ) ) {
+		const vec2 nudge = context->mPendingNudge;
+		context->mPendingNudge = vec2( 0 );
+
+		bool handled = false;
+		for( auto itr = warps.rbegin(); itr != warps.rend() && !handled; ++itr )
+			handled = ( *itr )->nudgeControlPoint( nudge );
+	}
+}
+
 bool Warp::handleResize( WarpList &warps )
 {
+	processInput( warps );
+
 	for( auto &warp : warps )
 		warp->resize();
 
@@ -484,6 +847,8 @@ bool Warp::handleResize( WarpList &warps )
 
 bool Warp::handleResize( WarpList &warps, const ivec2 &size )
 {
+	processInput( warps );
+
 	for( auto &warp : warps )
 		warp->resize( size );
 
@@ -499,7 +864,7 @@ void Warp::mouseMove( cinder::app::MouseEvent &event )
 
 void Warp::mouseDown( cinder::app::MouseEvent &event )
 {
-	if( !sIsEditMode )
+	if( !mContext->isEditModeEnabled() )
 		return;
 	if( mSelected >= mPoints.size() )
 		return;
@@ -508,12 +873,13 @@ void Warp::mouseDown( cinder::app::MouseEvent &event )
 	const ivec2 p = ( getControlPoint( mSelected ) * mWindowSize );
 	mOffset = event.getPos() - p;
 
+	mContext->mIsDragging = true;
 	event.setHandled( true );
 }
 
 void Warp::mouseDrag( cinder::app::MouseEvent &event )
 {
-	if( !sIsEditMode )
+	if( !mContext->isEditModeEnabled() )
 		return;
 	if( mSelected >= mPoints.size() )
 		return;
@@ -524,7 +890,7 @@ void Warp::mouseDrag( cinder::app::MouseEvent &event )
 	// set control point in normalized screen space
 	setControlPoint( mSelected, p / mWindowSize );
 
-	mIsDirty = true;
+	invalidate();
 
 	event.setHandled( true );
 }
@@ -536,10 +902,10 @@ void Warp::mouseUp( cinder::app::MouseEvent &event )
 void Warp::keyDown( KeyEvent &event )
 {
 	// disable keyboard input when not in edit mode
-	if( sIsEditMode ) {
+	if( mContext->isEditModeEnabled() ) {
 		if( event.getCode() == KeyEvent::KEY_ESCAPE ) {
 			// gracefully exit edit mode
-			sIsEditMode = false;
+			mContext->enableEditMode( false );
 			event.setHandled( true );
 			return;
 		}
@@ -568,109 +934,98 @@ void Warp::keyDown( KeyEvent &event )
 			selectControlPoint( mSelected );
 		}
 		break;
-	case KeyEvent::KEY_UP: {
-		if( mSelected >= mPoints.size() )
-			return;
-		const float step = event.isShiftDown() ? 10.0f : 0.5f;
-		mPoints[mSelected].y -= step / mWindowSize.y;
-		mIsDirty = true;
-	} break;
-	case KeyEvent::KEY_DOWN: {
-		if( mSelected >= mPoints.size() )
+	case KeyEvent::KEY_UP:
+	case KeyEvent::KEY_DOWN:
+	case KeyEvent::KEY_LEFT:
+	case KeyEvent::KEY_RIGHT:
+		if( !nudgeControlPoint( getNudge( event ) ) )
 			return;
-		const float step = event.isShiftDown() ? 10.0f : 0.5f;
-		mPoints[mSelected].y += step / mWindowSize.y;
-		mIsDirty = true;
-	} break;
-	case KeyEvent::KEY_LEFT: {
-		if( mSelected >= mPoints.size() )
-			return;
-		const float step = event.isShiftDown() ? 10.0f : 0.5f;
-		mPoints[mSelected].x -= step / mWindowSize.x;
-		mIsDirty = true;
-	} break;
-	case KeyEvent::KEY_RIGHT: {
-		if( mSelected >= mPoints.size() )
-			return;
-		const float step = event.isShiftDown() ? 10.0f : 0.5f;
-		mPoints[mSelected].x += step / mWindowSize.x;
-		mIsDirty = true;
-	} break;
+		break;
 	case KeyEvent::KEY_MINUS:
 	case KeyEvent::KEY_KP_MINUS:
 		if( mSelected >= mPoints.size() )
 			return;
 		mBrightness = math<float>::max( 0.0f, mBrightness - 0.01f );
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_PLUS:
 	case KeyEvent::KEY_KP_PLUS:
 		if( mSelected >= mPoints.size() )
 			return;
 		mBrightness = math<float>::min( 1.0f, mBrightness + 0.01f );
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_r:
 		if( mSelected >= mPoints.size() )
 			return;
 		reset();
-		mIsDirty = true;
+		invalidate();
 		break;
 	case KeyEvent::KEY_KP0:
 		// Toggle gamma mode.
-		Warp::toggleGammaMode();
+		mContext->toggleGammaMode();
 		break;
 	case KeyEvent::KEY_KP1:
 		// Decrease red gamma.
-		if( isGammaModeEnabled() && mGamma.r > 0.0f )
+		if( mContext->isGammaModeEnabled() && mGamma.r > 0.0f )
 			mGamma.r -= 0.05f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP2:
 		// Decrease green gamma.
-		if( isGammaModeEnabled() && mGamma.g > 0.0f )
+		if( mContext->isGammaModeEnabled() && mGamma.g > 0.0f )
 			mGamma.g -= 0.05f;
 		else if( event.isAccelDown() && mEdges.w < 1.0f )
 			mEdges.w += 0.01f;
 		else if( !event.isAccelDown() && mEdges.y < 1.0f )
 			mEdges.y += 0.01f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP3:
 		// Decrease blue gamma.
-		if( isGammaModeEnabled() && mGamma.b > 0.0f )
+		if( mContext->isGammaModeEnabled() && mGamma.b > 0.0f )
 			mGamma.b -= 0.05f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP4:
-		if( isGammaModeEnabled() )
+		if( mContext->isGammaModeEnabled() )
 			return;
 		else if( event.isAccelDown() && mEdges.z > 0.0f )
 			mEdges.z -= 0.01f;
 		else if( !event.isAccelDown() && mEdges.x > 0.0f )
 			mEdges.x -= 0.01f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP6:
-		if( isGammaModeEnabled() )
+		if( mContext->isGammaModeEnabled() )
 			return;
 		else if( event.isAccelDown() && mEdges.z < 1.0f )
 			mEdges.z += 0.01f;
 		else if( !event.isAccelDown() && mEdges.x < 1.0f )
 			mEdges.x += 0.01f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP7:
 		// Increase red gamma.
-		if( isGammaModeEnabled() )
+		if( mContext->isGammaModeEnabled() )
 			mGamma.r += 0.05f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP8:
 		// Increase green gamma.
-		if( isGammaModeEnabled() )
+		if( mContext->isGammaModeEnabled() )
 			mGamma.g += 0.05f;
 		else if( event.isAccelDown() && mEdges.w > 0.0f )
 			mEdges.w -= 0.01f;
 		else if( !event.isAccelDown() && mEdges.y > 0.0f )
 			mEdges.y -= 0.01f;
+		++mBlendRevision;
 		break;
 	case KeyEvent::KEY_KP9:
 		// Increase blue gamma.
-		if( isGammaModeEnabled() )
+		if( mContext->isGammaModeEnabled() )
 			mGamma.b += 0.05f;
+		++mBlendRevision;
 		break;
 	default:
 		return;
@@ -687,7 +1042,7 @@ void Warp::resize()
 void Warp::resize( const ivec2 &size )
 {
 	mWindowSize = vec2( size );
-	mIsDirty = true;
+	invalidate();
 }
 
 void Warp::queueControlPoint( const vec2 &pt, bool selected, bool attached )
@@ -710,23 +1065,75 @@ void Warp::queueControlPoint( const vec2 &pt, bool selected, bool attached )
 
 void Warp::queueControlPoint( const vec2 &pt, const Color &clr, float scale )
 {
-	if( mControlPoints.size() < MAX_NUM_CONTROL_POINTS )
-		mControlPoints.emplace_back( Data( pt, vec4( clr.r, clr.g, clr.b, 1 ), scale ) );
+	mContext->queueControlPoint( pt, vec4( clr.r, clr.g, clr.b, 1 ), scale );
 }
 
 void Warp::drawControlPoints()
+{
+	if( !mContext->isDeferredControlPointsEnabled() )
+		mContext->flushControlPoints();
+}
+
+// ----------------------------------------------------------------------------------------------------------------
+
+const WarpContextRef &WarpContext::getDefault()
+{
+	static const WarpContextRef context = WarpContext::create();
+	return context;
+}
+
+const WarpContextRef &WarpContext::get( const WarpList &warps )
+{
+	return warps.empty() ? getDefault() : warps.front()->getContext();
+}
+
+WarpContext::WarpContext()
+	: mIsEditMode( false )
+	, mIsGammaMode( false )
+	, mInstanceDataCapacity( 0 )
+	, mIsDeferredControlPoints( false )
+	, mIsInputCoalescing( false )
+	, mPendingNudge( 0 )
+	, mIsDragging( false )
+{
+}
+
+WarpContext::~WarpContext() = default;
+
+gl::GlslProgRef WarpContext::getShader( const std::string &name, const gl::GlslProg::Format &format )
+{
+	// shaders that failed to compile are stored as empty references
+	const auto itr = mShaders.find( name );
+	if( itr != mShaders.end() )
+		return itr->second;
+
+	auto &shader = mShaders[name];
+	try {
+		shader = gl::GlslProg::create( format );
+	}
+	catch( const std::exception &exc ) {
+		app::console() << name << ": " << exc.what() << std::endl;
+	}
+
+	return shader;
+}
+
+void WarpContext::queueControlPoint( const vec2 &pt, const vec4 &color, float scale )
+{
+	mControlPoints.emplace_back( pt, color, scale );
+}
+
+void WarpContext::flushControlPoints()
 {
 	if( !mInstancedBatch ) {
 		gl::VboMeshRef mesh = gl::VboMesh::create( geom::Circle().radius( 15 ) );
 
-		std::vector<Data> positions;
-		positions.resize( MAX_NUM_CONTROL_POINTS );
-
-		mInstanceDataVbo = gl::Vbo::create( GL_ARRAY_BUFFER, positions.size() * sizeof( Data ), positions.data(), GL_STATIC_DRAW );
+		mInstanceDataCapacity = kInitialInstanceCapacity;
+		mInstanceDataVbo = gl::Vbo::create( GL_ARRAY_BUFFER, mInstanceDataCapacity * sizeof( ControlPoint ), nullptr, GL_DYNAMIC_DRAW );
 
 		geom::BufferLayout instanceDataLayout;
-		instanceDataLayout.append( geom::Attrib::CUSTOM_0, 4, sizeof( Data ), offsetof( Data, position ), 1 /* per instance */ );
-		instanceDataLayout.append( geom::Attrib::CUSTOM_1, 4, sizeof( Data ), offsetof( Data, color ), 1 /* per instance */ );
+		instanceDataLayout.append( geom::Attrib::CUSTOM_0, 4, sizeof( ControlPoint ), offsetof( ControlPoint, position ), 1 /* per instance */ );
+		instanceDataLayout.append( geom::Attrib::CUSTOM_1, 4, sizeof( ControlPoint ), offsetof( ControlPoint, color ), 1 /* per instance */ );
 
 		mesh->appendVbo( instanceDataLayout, mInstanceDataVbo );
 
@@ -776,15 +1183,23 @@ void Warp::drawControlPoints()
 		}
 		catch( const std::exception &exc ) {
 			app::console() << exc.what() << std::endl;
+			mControlPoints.clear();
 			return;
 		}
 	}
 
 	if( mInstancedBatch && !mControlPoints.empty() ) {
+		// grow instance data buffer if needed, the vertex array keeps referring to the same buffer
+		if( mControlPoints.size() > mInstanceDataCapacity ) {
+			while( mInstanceDataCapacity < mControlPoints.size() )
+				mInstanceDataCapacity *= 2;
+
+			mInstanceDataVbo->bufferData( mInstanceDataCapacity * sizeof( ControlPoint ), nullptr, GL_DYNAMIC_DRAW );
+		}
+
 		// update instance data buffer
-		auto ptr = static_cast<Data *>( mInstanceDataVbo->mapReplace() );
-		for( const auto &controlPoint : mControlPoints )
-			*ptr++ = controlPoint;
+		auto ptr = static_cast<ControlPoint *>( mInstanceDataVbo->mapReplace() );
+		std::copy( mControlPoints.begin(), mControlPoints.end(), ptr );
 		mInstanceDataVbo->unmap();
 
 		// draw instanced
@@ -794,4 +1209,158 @@ void Warp::drawControlPoints()
 	mControlPoints.clear();
 }
 
+// ----------------------------------------------------------------------------------------------------------------
+
+void ControlPointIndex::update( const WarpList &warps )
+{
+	// remove warps that are no longer part of the list
+	while( mSlots.size() > warps.size() ) {
+		remove( uint32_t( mSlots.size() - 1 ) );
+		mSlots.pop_back();
+	}
+
+	mSlots.resize( warps.size() );
+
+	for( uint32_t i = 0; i < uint32_t( warps.size() ); ++i ) {
+		const auto &warp = warps[i];
+		auto &      slot = mSlots[i];
+
+		// skip warps that did not change
+		const bool isSame = !slot.warp.owner_before( warp ) && !warp.owner_before( slot.warp );
+		if( isSame && slot.revision == warp->getRevision() )
+			continue;
+
+		remove( i );
+
+		slot.warp = warp;
+		slot.revision = warp->getRevision();
+		slot.points.resize( warp->getNumControlPoints() );
+		for( unsigned j = 0; j < unsigned( slot.points.size() ); ++j )
+			slot.points[j] = warp->getControlPoint( j ) * warp->mWindowSize;
+
+		insert( i );
+	}
+}
+
+void ControlPointIndex::clear()
+{
+	mSlots.clear();
+	mCells.clear();
+	mMin = ivec2( 0 );
+	mMax = ivec2( -1 );
+}
+
+bool ControlPointIndex::findClosest( const vec2 &pos, size_t *warp, unsigned *index, float *distance ) const
+{
+	if( mCells.empty() )
+		return false;
+
+	float    best = FLT_MAX;
+	uint32_t bestWarp = 0;
+	uint32_t bestIndex = 0;
+
+	const auto search = [&]( const std::vector<Entry> &entries ) {
+		for( const auto &entry : entries ) {
+			// on a tie, prefer the last warp and then the first control point
+			const float d = glm::distance( pos, entry.position );
+			if( d < best || ( d == best && ( entry.warp > bestWarp || ( entry.warp == bestWarp && entry.index < bestIndex ) ) ) ) {
+				best = d;
+				bestWarp = entry.warp;
+				bestIndex = entry.index;
+			}
+		}
+	};
+
+	// visit rings of cells around the position, skipping rings that lie completely outside the occupied cells
+	const ivec2 cell = getCell( pos );
+	const ivec2 lo = cell - mMax;
+	const ivec2 hi = mMin - cell;
+	const int   first = glm::max( 0, glm::max( glm::max( lo.x, lo.y ), glm::max( hi.x, hi.y ) ) );
+	const int   last = glm::max( glm::max( glm::abs( cell.x - mMin.x ), glm::abs( cell.x - mMax.x ) ), glm::max( glm::abs( cell.y - mMin.y ), glm::abs( cell.y - mMax.y ) ) );
+
+	size_t visited = 0;
+	for( int r = first; r <= last; ++r ) {
+		for( int y = glm::max( cell.y - r, mMin.y ); y <= glm::min( cell.y + r, mMax.y ); ++y ) {
+			const int step = ( y == cell.y - r || y == cell.y + r ) ? 1 : 2 * r;
+			for( int x = cell.x - r; x <= cell.x + r; x += step ) {
+				if( x < mMin.x || x > mMax.x )
+					continue;
+
+				const auto itr = mCells.find( getKey( ivec2( x, y ) ) );
+				if( itr != mCells.end() )
+					search( itr->second );
+
+				++visited;
+			}
+		}
+
+		// points in the next ring are at least r cells away
+		if( best < float( r ) * mCellSize - 1.0f )
+			break;
+
+		// for sparse points far apart, it is faster to simply check them all
+		if( visited > mCells.size() ) {
+			best = FLT_MAX;
+			for( const auto &itr : mCells )
+				search( itr.second );
+			break;
+		}
+	}
+
+	if( best == FLT_MAX )
+		return false;
+
+	*warp = bestWarp;
+	*index = bestIndex;
+	*distance = best;
+
+	return true;
+}
+
+void ControlPointIndex::setCellSize( float size )
+{
+	mCellSize = glm::max( 1.0f, size );
+	clear();
+}
+
+ivec2 ControlPointIndex::getCell( const vec2 &pos ) const
+{
+	const vec2 cell = glm::clamp( glm::floor( pos / mCellSize ), vec2( -1e9f ), vec2( 1e9f ) );
+	return ivec2( int( cell.x ), int( cell.y ) );
+}
+
+void ControlPointIndex::insert( uint32_t slot )
+{
+	const auto &points = mSlots[slot].points;
+	for( uint32_t i = 0; i < uint32_t( points.size() ); ++i ) {
+		const ivec2 cell = getCell( points[i] );
+		mCells[getKey( cell )].push_back( { points[i], slot, i } );
+
+		if( mMin.x > mMax.x ) {
+			mMin = cell;
+			mMax = cell;
+		}
+		else {
+			mMin = glm::min( mMin, cell );
+			mMax = glm::max( mMax, cell );
+		}
+	}
+}
+
+void ControlPointIndex::remove( uint32_t slot )
+{
+	for( const auto &pt : mSlots[slot].points ) {
+		const auto itr = mCells.find( getKey( getCell( pt ) ) );
+		if( itr == mCells.end() )
+			continue;
+
+		auto &entries = itr->second;
+		entries.erase( std::remove_if( entries.begin(), entries.end(), [slot]( const Entry &entry ) { return entry.warp == slot; } ), entries.end() );
+		if( entries.empty() )
+			mCells.erase( itr );
+	}
+
+	mSlots[slot].points.clear();
+}
+
 } // namespace ph::warping
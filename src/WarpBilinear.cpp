@@ -26,6 +26,11 @@
 #include <cinder/gl/Texture.h>
 #include <cinder/gl/scoped.h>
 
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <thread>
+
 //
 
 using namespace ci;
@@ -33,10 +38,188 @@ using namespace app;
 
 namespace ph::warping {
 
+namespace {
+
+//! Open uniform B-spline of degree 1 or 3, the same curve as BSpline2f( points, degree, false, true ). It is evaluated directly and its
+//! arc length is tabulated, so it can be resampled without the iterative integration and root finding of BSpline2f.
+class ArcLengthSpline {
+  public:
+	ArcLengthSpline( const std::vector<vec2> &points, int degree )
+		: mDegree( degree )
+	{
+		assert( degree >= 1 && degree <= 3 && points.size() > size_t( degree ) );
+
+		mPoints.assign( points.begin(), points.end() );
+
+		// clamped knots, uniform in between
+		const size_t numPoints = mPoints.size();
+		mKnots.resize( numPoints + mDegree + 1 );
+		for( size_t i = 0; i < mKnots.size(); ++i ) {
+			if( i <= size_t( mDegree ) )
+				mKnots[i] = 0;
+			else if( i < numPoints )
+				mKnots[i] = double( i - mDegree ) / double( numPoints - mDegree );
+			else
+				mKnots[i] = 1;
+		}
+	}
+
+	//! Writes \a n points, evenly spaced along the curve, to every \a stride-th element of \a output.
+	void resample( size_t n, vec2 *output, size_t stride ) const
+	{
+		// tabulate the arc length at a few parameters per knot span
+		const size_t        numSpans = mPoints.size() - mDegree;
+		std::vector<double> params, lengths;
+		params.reserve( numSpans * kSubdivisions + 1 );
+		lengths.reserve( numSpans * kSubdivisions + 1 );
+
+		double length = 0;
+		for( size_t k = 0; k < numSpans; ++k ) {
+			const double a = mKnots[k + mDegree];
+			const double b = mKnots[k + mDegree + 1];
+			for( int i = 0; i < kSubdivisions; ++i ) {
+				const double t0 = a + ( b - a ) * i / kSubdivisions;
+				const double t1 = a + ( b - a ) * ( i + 1 ) / kSubdivisions;
+				params.push_back( t0 );
+				lengths.push_back( length );
+				length += integrate( t0, t1 );
+			}
+		}
+		params.push_back( 1 );
+		lengths.push_back( length );
+
+		for( size_t j = 0; j < n; ++j ) {
+			const double target = length * double( j ) / double( n - 1 );
+
+			// find the tabulated interval, then solve for the parameter within it using safeguarded Newton iterations
+			size_t i = size_t( std::upper_bound( lengths.begin(), lengths.end(), target ) - lengths.begin() );
+			i = glm::clamp<size_t>( i, 1, lengths.size() - 1 ) - 1;
+
+			double lo = params[i];
+			double hi = params[i + 1];
+			double t = lo;
+			if( lengths[i + 1] > lengths[i] )
+				t = lo + ( hi - lo ) * ( target - lengths[i] ) / ( lengths[i + 1] - lengths[i] );
+
+			for( int iteration = 0; iteration < 16; ++iteration ) {
+				const double error = lengths[i] + integrate( params[i], t ) - target;
+				if( std::abs( error ) <= 1e-12 * glm::max( length, 1.0 ) )
+					break;
+
+				if( error > 0 )
+					hi = t;
+				else
+					lo = t;
+
+				dvec2 derivative;
+				evaluate( t, &derivative );
+				const double speed = glm::length( derivative );
+
+				const double next = speed > 0 ? t - error / speed : lo;
+				t = ( next > lo && next < hi ) ? next : 0.5 * ( lo + hi );
+			}
+
+			output[j * stride] = vec2( evaluate( t, nullptr ) );
+		}
+	}
+
+  private:
+	//! Number of tabulated intervals per knot span.
+	static const int kSubdivisions = 4;
+
+	//! Evaluates the curve and optionally its derivative at \a t using de Boor's algorithm.
+	dvec2 evaluate( double t, dvec2 *derivative ) const
+	{
+		// find the knot span containing t
+		const size_t numPoints = mPoints.size();
+		size_t       k = size_t( std::upper_bound( mKnots.begin() + mDegree + 1, mKnots.begin() + numPoints, t ) - mKnots.begin() ) - 1;
+
+		dvec2 d[4];
+		for( int j = 0; j <= mDegree; ++j )
+			d[j] = mPoints[j + k - mDegree];
+
+		for( int r = 1; r <= mDegree; ++r ) {
+			if( r == mDegree && derivative )
+				*derivative = double( mDegree ) * ( d[mDegree] - d[mDegree - 1] ) / ( mKnots[k + 1] - mKnots[k] );
+
+			for( int j = mDegree; j >= r; --j ) {
+				const double u = mKnots[j + k - mDegree];
+				const double alpha = ( t - u ) / ( mKnots[j + 1 + k - r] - u );
+				d[j] = ( 1.0 - alpha ) * d[j - 1] + alpha * d[j];
+			}
+		}
+
+		return d[mDegree];
+	}
+
+	//! Returns the arc length between \a a and \a b, using 5-point Gauss-Legendre quadrature.
+	double integrate( double a, double b ) const
+	{
+		static const double kNodes[] = { 0.0, -0.5384693101056831, 0.5384693101056831, -0.9061798459386640, 0.9061798459386640 };
+		static const double kWeights[] = { 0.5688888888888889, 0.4786286704993665, 0.4786286704993665, 0.2369268850561891, 0.2369268850561891 };
+
+		const double mid = 0.5 * ( a + b );
+		const double half = 0.5 * ( b - a );
+
+		double sum = 0;
+		for( int i = 0; i < 5; ++i ) {
+			dvec2 derivative;
+			evaluate( mid + half * kNodes[i], &derivative );
+			sum += kWeights[i] * glm::length( derivative );
+		}
+
+		return sum * half;
+	}
+
+	std::vector<dvec2>  mPoints;
+	std::vector<double> mKnots;
+	int                 mDegree;
+};
+
+//! Minimum number of resampled control points per thread. Starting a thread costs more than resampling fewer points.
+const size_t kMinPointsPerThread = 256;
+
+//! Calls \a func for each index in [0, \a count), spread over the hardware threads. \a numPoints is the total number of resampled
+//! control points, small grids are resampled on the calling thread.
+template<typename Func>
+void parallelFor( size_t count, size_t numPoints, const Func &func )
+{
+	const size_t numThreads = glm::min<size_t>( glm::min<size_t>( count, numPoints / kMinPointsPerThread ), std::thread::hardware_concurrency() );
+	if( numThreads < 2 ) {
+		for( size_t i = 0; i < count; ++i )
+			func( i );
+		return;
+	}
+
+	std::atomic<size_t> next( 0 );
+	auto                work = [&] {
+		for( size_t i = next++; i < count; i = next++ )
+			func( i );
+	};
+
+	std::vector<std::thread> threads;
+	for( size_t i = 1; i < numThreads; ++i )
+		threads.emplace_back( work );
+
+	work();
+
+	for( auto &thread : threads )
+		thread.join();
+}
+
+} // namespace
+
 WarpBilinear::WarpBilinear( const gl::Fbo::Format &format )
 	: Warp( WarpType::BILINEAR )
 	, mFboFormat( format )
+	, mNumFbos( 1 )
+	, mCurrentFbo( 0 )
+	, mNumFboReuses( 0 )
+	, mIsDynamicResolution( false )
+	, mResolutionScale( 1.0f )
+	, mMaxTextureSize( 0 )
 	, mTarget( GL_TEXTURE_2D )
+	, mIsYuv( false )
 	, mIsLinear( false )
 	, mIsAdaptive( true )
 	, mX1( 0.0f )
@@ -46,21 +229,27 @@ WarpBilinear::WarpBilinear( const gl::Fbo::Format &format )
 	, mResolution( 16 )
 	, mResolutionX( 0 )
 	, mResolutionY( 0 ) // higher value is coarser mesh
+	, mMeshRevision( std::numeric_limits<uint64_t>::max() )
+	, mIsMeshCached( false )
+	, mIsLayoutDirty( true )
 {
 	WarpBilinear::reset();
 }
 
 std::vector<float> WarpBilinear::getWarpMesh( const ci::Rectf &srcRect )
 {
-	createShader();
-	createBuffers();
+	// only the vertices are needed, which doesn't require OpenGL
+	prepare();
 
 	std::vector<float> vertices;
-	vertices.reserve( mIndices.size() * 6 );
+	if( !mLayout )
+		return vertices;
+
+	vertices.reserve( mLayout->indices.size() * 6 );
 
-	for( const auto index : mIndices ) {
+	for( const auto index : mLayout->indices ) {
 		const auto &v = mPositions[index];
-		const auto &t = mTexCoords[index];
+		const auto &t = mLayout->texCoords[index];
 		vertices.emplace_back( v.x );
 		vertices.emplace_back( v.y );
 		vertices.emplace_back( glm::mix( srcRect.x1, srcRect.x2, t.x ) );
@@ -81,6 +270,10 @@ XmlTree WarpBilinear::toXml() const
 	xml.setAttribute( "linear", mIsLinear );
 	xml.setAttribute( "adaptive", mIsAdaptive );
 
+	// add fine corrections, if any
+	if( mResiduals )
+		xml.push_back( mResiduals->toXml() );
+
 	return xml;
 }
 
@@ -92,6 +285,70 @@ void WarpBilinear::fromXml( const XmlTree &xml )
 	mResolution = xml.getAttributeValue<int>( "resolution", 16 );
 	mIsLinear = xml.getAttributeValue<bool>( "linear", false );
 	mIsAdaptive = xml.getAttributeValue<bool>( "adaptive", false );
+
+	// retrieve fine corrections, if any
+	if( xml.hasChild( "residuals" ) ) {
+		const auto residuals = WarpResidualGrid::fromXml( xml.getChild( "residuals" ) );
+		mResiduals = residuals->isEmpty() ? nullptr : residuals;
+	}
+	else {
+		mResiduals.reset();
+	}
+}
+
+Warp::State WarpBilinear::getState() const
+{
+	auto state = Warp::getState();
+	state.resolution = mResolution;
+	state.linear = mIsLinear;
+	state.adaptive = mIsAdaptive;
+	state.residuals = mResiduals;
+
+	return state;
+}
+
+void WarpBilinear::setState( const State &state )
+{
+	if( state.type != mType )
+		return;
+
+	Warp::setState( state );
+
+	if( state.resolution != mResolution || state.linear != mIsLinear || state.adaptive != mIsAdaptive ) {
+		mResolution = state.resolution;
+		mIsLinear = state.linear;
+		mIsAdaptive = state.adaptive;
+
+		invalidate();
+	}
+
+	setResiduals( state.residuals );
+}
+
+void WarpBilinear::setResiduals( const WarpResidualGridConstRef &residuals )
+{
+	const auto grid = ( residuals && !residuals->isEmpty() ) ? residuals : nullptr;
+
+	// only invalidate if the corrections actually changed
+	if( grid == mResiduals || ( grid && mResiduals && *grid == *mResiduals ) )
+		return;
+
+	mResiduals = grid;
+	invalidate();
+}
+
+void WarpBilinear::setContext( const WarpContextRef &context )
+{
+	Warp::setContext( context );
+
+	mShader2D.reset();
+	mShader2DRect.reset();
+	mShader2DYuv.reset();
+	mVboMesh.reset();
+	releaseFbos();
+	mMaxTextureSize = 0;
+
+	invalidate();
 }
 
 void WarpBilinear::reset()
@@ -105,7 +362,8 @@ void WarpBilinear::reset()
 		}
 	}
 
-	mIsDirty = true;
+	mResiduals.reset();
+	invalidate();
 }
 
 void WarpBilinear::draw( const gl::Texture2dRef &texture, const Area &srcArea, const Rectf &destRect )
@@ -131,24 +389,96 @@ void WarpBilinear::draw( const gl::Texture2dRef &texture, const Area &srcArea, c
 	draw();
 }
 
+void WarpBilinear::draw( const gl::Texture2dRef &luma, const gl::Texture2dRef &chroma, const Area &srcArea, const Rectf &destRect )
+{
+	if( !luma || !chroma )
+		return;
+
+	gl::ScopedTextureBind scpTex0( luma, 0 );
+	gl::ScopedTextureBind scpTex1( chroma, 1 );
+
+	// clip against bounds
+	Area  area = srcArea;
+	Rectf rect = destRect;
+	clip( area, rect );
+
+	// set texture coordinates, the chroma plane uses the same normalized coordinates
+	const auto w = float( luma->getWidth() );
+	const auto h = float( luma->getHeight() );
+
+	mTarget = GL_TEXTURE_2D;
+	setTexCoords( area.x1 / w, area.y1 / h, area.x2 / w, area.y2 / h );
+
+	// draw
+	mIsYuv = true;
+	draw();
+	mIsYuv = false;
+}
+
+void WarpBilinear::draw( const WarpCanvasRef &canvas, const Area &srcArea )
+{
+	if( !canvas )
+		return;
+
+	// make sure the tiles we need will be rendered
+	canvas->reference( srcArea );
+
+	mCanvas = canvas;
+	mCanvasArea = srcArea;
+	mTarget = GL_TEXTURE_2D;
+	setTexCoords( 0.0f, 0.0f, 1.0f, 1.0f );
+
+	// draw
+	draw();
+
+	mCanvas.reset();
+}
+
 void WarpBilinear::begin()
 {
+	applyPublishedState();
+	mIsInFrame = true;
+
+	// advance to the next frame buffer in the ring
+	if( mFbos.size() != mNumFbos ) {
+		mFbos.resize( mNumFbos );
+		mFboFences.resize( mNumFbos );
+	}
+	mCurrentFbo = ( mCurrentFbo + 1 ) % mNumFbos;
+
 	// check if the FBO was created and is of the correct size
-	if( !mFbo ) {
+	const ivec2 size = getFboSize();
+
+	auto &fbo = mFbos[mCurrentFbo];
+	if( fbo && fbo->getSize() != size )
+		fbo.reset();
+
+	if( !fbo ) {
 		try {
-			mFbo = gl::Fbo::create( int( mWidth ), int( mHeight ), mFboFormat );
+			fbo = gl::Fbo::create( size.x, size.y, mFboFormat );
 		}
 		catch( ... ) {
 			// try creating Fbo with default format settings
 			try {
-				mFbo = gl::Fbo::create( int( mWidth ), int( mHeight ) );
+				fbo = gl::Fbo::create( size.x, size.y );
 			}
 			catch( ... ) {
+				mFbo.reset();
 				return;
 			}
 		}
 	}
 
+	mFbo = fbo;
+
+	// commands on this context are executed in order, so drawing to an FBO the GPU is still sampling from needs no wait
+	auto &fence = mFboFences[mCurrentFbo];
+	if( fence ) {
+		if( isFboInFlight( mCurrentFbo ) )
+			++mNumFboReuses;
+		fence.reset();
+	}
+
 	// bind the frame buffer so we can draw to the FBO
 	auto ctx = gl::context();
 	ctx->pushFramebuffer( mFbo );
@@ -164,8 +494,10 @@ void WarpBilinear::begin()
 
 void WarpBilinear::end()
 {
-	if( !mFbo )
+	if( !mFbo ) {
+		mIsInFrame = false;
 		return;
+	}
 
 	// restore matrices
 	gl::popMatrices();
@@ -185,10 +517,66 @@ void WarpBilinear::end()
 	srcArea.y2 = t;
 
 	draw( mFbo->getColorTexture(), srcArea, getBounds() );
+
+	// guard the FBO until the GPU is done sampling from it
+	if( mNumFbos > 1 )
+		mFboFences[mCurrentFbo] = gl::Sync::create();
+
+	mIsInFrame = false;
+}
+
+bool WarpBilinear::isFboInFlight( size_t index ) const
+{
+	if( index >= mFboFences.size() || !mFboFences[index] )
+		return false;
+
+	// a zero timeout only queries the state of the fence
+	return mFboFences[index]->clientWaitSync( 0, 0 ) == GL_TIMEOUT_EXPIRED;
+}
+
+ivec2 WarpBilinear::getFboSize() const
+{
+	vec2 size( mWidth, mHeight );
+
+	if( mIsDynamicResolution && !mPoints.empty() ) {
+		// no need to render more pixels than the warp covers on screen, they would be minified away
+		vec2 min = getControlPoint( 0 );
+		vec2 max = min;
+		for( unsigned i = 1; i < unsigned( getNumControlPoints() ); i++ ) {
+			const vec2 pt = getControlPoint( i );
+			min = glm::min( min, pt );
+			max = glm::max( max, pt );
+		}
+
+		size = glm::min( size, ( max - min ) * mWindowSize );
+	}
+
+	size *= mResolutionScale;
+
+	// round up to a multiple of 32 pixels, so that small edits do not cause the FBO to be recreated
+	const int w = 32 * int( glm::ceil( size.x / 32.0f ) );
+	const int h = 32 * int( glm::ceil( size.y / 32.0f ) );
+
+	// content larger than the maximum texture size is scaled down (use a WarpCanvas to render it at full resolution)
+	if( mMaxTextureSize <= 0 )
+		mMaxTextureSize = WarpCanvas::getMaxTileSize();
+
+	const int maxSize = mMaxTextureSize;
+
+	return ivec2( glm::clamp( w, 1, glm::min( int( mWidth ), maxSize ) ), glm::clamp( h, 1, glm::min( int( mHeight ), maxSize ) ) );
+}
+
+void WarpBilinear::releaseFbos()
+{
+	mFbo.reset();
+	mFbos.clear();
+	mFboFences.clear();
 }
 
 void WarpBilinear::draw( bool controls )
 {
+	applyPublishedState();
+
 	createShader();
 	createBuffers();
 
@@ -212,7 +600,10 @@ void WarpBilinear::draw( bool controls )
 	}
 
 	// draw textured mesh
-	auto &shader = mTarget == GL_TEXTURE_RECTANGLE ? mShader2DRect : mShader2D;
+	auto &shader = mIsYuv ? mShader2DYuv : mTarget == GL_TEXTURE_RECTANGLE ? mShader2DRect : mShader2D;
+	auto &batch = mIsYuv ? mBatch2DYuv : mTarget == GL_TEXTURE_RECTANGLE ? mBatch2DRect : mBatch2D;
+	if( !shader || !batch )
+		return;
 
 	gl::ScopedGlslProg scpGlsl( shader );
 	shader->uniform( "uTex0", 0 );
@@ -222,20 +613,30 @@ void WarpBilinear::draw( bool controls )
 	shader->uniform( "uGamma", mGamma );
 	shader->uniform( "uEdges", mEdges );
 	shader->uniform( "uExponent", mExponent );
-	shader->uniform( "uEditMode", isEditModeEnabled() );
-	shader->uniform( "uGammaMode", isEditModeEnabled() && isGammaModeEnabled() && mSelected < mPoints.size() );
+	shader->uniform( "uEditMode", mContext->isEditModeEnabled() );
+	shader->uniform( "uGammaMode", mContext->isEditModeEnabled() && mContext->isGammaModeEnabled() && mSelected < mPoints.size() );
+	shader->uniform( "uClip", vec4( 0, 0, 1, 1 ) );
+
+	if( mIsYuv ) {
+		shader->uniform( "uTex1", 1 );
+		setYuvUniforms( shader );
+	}
 
-	auto &batch = mTarget == GL_TEXTURE_RECTANGLE ? mBatch2DRect : mBatch2D;
-	batch->draw();
+	if( mCanvas )
+		drawTiles( shader );
+	else
+		batch->draw();
 
 	// draw edit interface
-	if( isEditModeEnabled() && controls && mSelected < mPoints.size() ) {
-		// draw mesh
-		gl::ScopedColor scpColor( 0, 1, 1 );
-		gl::begin( GL_POINTS );
-		for( const auto &p : mPositions )
-			gl::vertex( p );
-		gl::end();
+	if( mContext->isEditModeEnabled() && controls && mSelected < mPoints.size() ) {
+		// draw mesh vertices straight from the vertex buffer
+		if( mBatchPoints ) {
+			gl::ScopedColor    scpColor( 0, 1, 1 );
+			gl::ScopedGlslProg scpPoints( mBatchPoints->getGlslProg() );
+			gl::ScopedVao      scpVao( mBatchPoints->getVao() );
+			gl::setDefaultShaderVars();
+			gl::drawArrays( GL_POINTS, 0, GLsizei( mVboMesh->getNumVertices() ) );
+		}
 
 		// draw control points
 		for( unsigned i = 0; i < mPoints.size(); i++ )
@@ -245,6 +646,77 @@ void WarpBilinear::draw( bool controls )
 	}
 }
 
+void WarpBilinear::drawTiles( const gl::GlslProgRef &shader )
+{
+	for( const auto index : mCanvas->getTiles( mCanvasArea ) ) {
+		// tiles become available once the canvas has rendered them
+		const auto texture = mCanvas->getTexture( index );
+		if( !texture )
+			continue;
+
+		vec4 clip, coords;
+		if( !mCanvas->getTileCoords( index, mCanvasArea, &clip, &coords ) )
+			continue;
+
+		const auto batch = getTileBatch( index, clip );
+		if( !batch )
+			continue;
+
+		gl::ScopedTextureBind scpTex0( texture );
+		shader->uniform( "uCoords", coords );
+		shader->uniform( "uClip", clip );
+
+		batch->draw();
+	}
+}
+
+gl::BatchRef WarpBilinear::getTileBatch( size_t index, const vec4 &clip )
+{
+	if( !mLayout || mResolutionX < 2 || mResolutionY < 2 )
+		return gl::BatchRef();
+
+	// find the range of mesh cells covered by the tile
+	const auto sx = float( mResolutionX - 1 );
+	const auto sy = float( mResolutionY - 1 );
+
+	ivec4 cells;
+	cells.x = glm::clamp( int( glm::floor( clip.x * sx ) ), 0, int( sx ) );
+	cells.y = glm::clamp( int( glm::floor( clip.y * sy ) ), 0, int( sy ) );
+	cells.z = glm::clamp( int( glm::ceil( clip.z * sx ) ), 0, int( sx ) );
+	cells.w = glm::clamp( int( glm::ceil( clip.w * sy ) ), 0, int( sy ) );
+
+	auto itr = std::find_if( mTileBatches.begin(), mTileBatches.end(), [index]( const TileBatch &tile ) { return tile.index == index; } );
+	if( itr != mTileBatches.end() && itr->cells == cells )
+		return itr->batch;
+
+	// collect the indices of those cells, 6 per cell (see buildMesh)
+	std::vector<uint32_t> indices;
+	for( int x = cells.x; x < cells.z; ++x ) {
+		for( int y = cells.y; y < cells.w; ++y ) {
+			const size_t i = 6 * ( x * ( mResolutionY - 1 ) + y );
+			indices.insert( indices.end(), mLayout->indices.begin() + i, mLayout->indices.begin() + i + 6 );
+		}
+	}
+
+	gl::BatchRef batch;
+	if( !indices.empty() ) {
+		// share the vertex buffers, only the index buffer is specific to the tile
+		auto indexVbo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( uint32_t ), indices.data(), GL_STATIC_DRAW );
+		auto mesh = gl::VboMesh::create( mVboMesh->getNumVertices(), GL_TRIANGLES, mVboMesh->getVertexArrayLayoutVbos(), uint32_t( indices.size() ), GL_UNSIGNED_INT, indexVbo );
+		batch = gl::Batch::create( mesh, mShader2D );
+	}
+
+	if( itr != mTileBatches.end() ) {
+		itr->cells = cells;
+		itr->batch = batch;
+	}
+	else {
+		mTileBatches.push_back( { index, cells, batch } );
+	}
+
+	return batch;
+}
+
 void WarpBilinear::keyDown( KeyEvent &event )
 {
 	// let base class handle keys first
@@ -253,7 +725,7 @@ void WarpBilinear::keyDown( KeyEvent &event )
 		return;
 
 	// disable keyboard input when not in edit mode
-	if( !isEditModeEnabled() )
+	if( !mContext->isEditModeEnabled() )
 		return;
 
 	// do not listen to key input if not selected
@@ -304,26 +776,26 @@ void WarpBilinear::keyDown( KeyEvent &event )
 	case KeyEvent::KEY_m:
 		// toggle between linear and curved mapping
 		mIsLinear = !mIsLinear;
-		mIsDirty = true;
+		invalidate();
 		break;
 	case KeyEvent::KEY_F5:
 		// decrease the mesh resolution
 		if( mResolution < 64 ) {
 			mResolution += 4;
-			mIsDirty = true;
+			invalidate();
 		}
 		break;
 	case KeyEvent::KEY_F6:
 		// increase the mesh resolution
 		if( mResolution > 4 ) {
 			mResolution -= 4;
-			mIsDirty = true;
+			invalidate();
 		}
 		break;
 	case KeyEvent::KEY_F7:
 		// toggle adaptive mesh resolution
 		mIsAdaptive = !mIsAdaptive;
-		mIsDirty = true;
+		invalidate();
 		break;
 	// case KeyEvent::KEY_F9:
 	//	// TODO: rotate content ccw
@@ -341,7 +813,9 @@ void WarpBilinear::keyDown( KeyEvent &event )
 			}
 		}
 		mPoints = points;
-		mIsDirty = true;
+		if( mResiduals )
+			mResiduals = mResiduals->flipped( true );
+		invalidate();
 		// find closest control point
 		mSelected = findControlPoint( pt, &distance );
 	} break;
@@ -355,7 +829,9 @@ void WarpBilinear::keyDown( KeyEvent &event )
 			}
 		}
 		mPoints = points;
-		mIsDirty = true;
+		if( mResiduals )
+			mResiduals = mResiduals->flipped( false );
+		invalidate();
 		// find closest control point
 		mSelected = findControlPoint( pt, &distance );
 	} break;
@@ -366,25 +842,100 @@ void WarpBilinear::keyDown( KeyEvent &event )
 	event.setHandled( true );
 }
 
+void WarpBilinear::mouseUp( MouseEvent &event )
+{
+	Warp::mouseUp( event );
+
+	// the meshes built during the drag were not cached, but the final one is worth keeping
+	if( !mIsMeshCached && mLayout && mMeshRevision == mRevision && !mContext->isDragging() && mContext->getMeshLru().getCapacity() > 0 )
+		cacheMesh( getMeshKey() );
+}
+
+void WarpBilinear::prepare()
+{
+	if( mIsDirty && mMeshRevision != mRevision )
+		buildMesh();
+}
+
+void WarpBilinear::upload()
+{
+	createShader();
+	createBuffers();
+}
+
+uint64_t WarpBilinear::getMeshKey() const
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	auto     add = [&]( const void *data, size_t size ) {
+		auto bytes = static_cast<const uint8_t *>( data );
+		for( size_t i = 0; i < size; ++i )
+			hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+	};
+
+	const uint32_t controls[] = { uint32_t( mControlsX ), uint32_t( mControlsY ) };
+	const int32_t  settings[] = { mResolution, mIsLinear ? 1 : 0, mIsAdaptive ? 1 : 0 };
+	const float    sizes[] = { mWidth, mHeight, mWindowSize.x, mWindowSize.y };
+
+	add( controls, sizeof( controls ) );
+	add( settings, sizeof( settings ) );
+	add( sizes, sizeof( sizes ) );
+	add( mPoints.data(), mPoints.size() * sizeof( vec2 ) );
+
+	if( mResiduals )
+		hash = mResiduals->hash( hash );
+
+	return hash;
+}
+
 void WarpBilinear::createBuffers()
 {
 	if( mIsDirty ) {
-		if( mIsAdaptive ) {
-			// determine a suitable mesh resolution based on width/height of the window
-			// and the size of the mesh in pixels
-			const Rectf rect = getMeshBounds();
-			createMesh( int( rect.getWidth() / float( mResolution ) ), int( rect.getHeight() / float( mResolution ) ) );
-		}
-		else {
-			// use a fixed mesh resolution
-			createMesh( int( mWidth ) / mResolution, int( mHeight ) / mResolution );
-		}
-		updateMesh();
+		// the mesh may already have been built by prepare()
+		if( mMeshRevision != mRevision )
+			buildMesh();
+
+		uploadMesh();
 	}
 }
 
-void WarpBilinear::createMesh( size_t resolutionX, size_t resolutionY )
+void WarpBilinear::buildMesh()
 {
+	// the mesh may have been evaluated before, for instance before an undo or a toggle. While a control point is dragged, every mesh
+	// is new and short-lived, so the cache is skipped until the drag ends, see mouseUp()
+	auto &         cache = mContext->getMeshLru();
+	const bool     isCached = cache.getCapacity() > 0 && !mContext->isDragging();
+	const uint64_t key = isCached ? getMeshKey() : 0;
+	if( isCached ) {
+		if( const auto mesh = cache.find( key ) ) {
+			if( mesh->layout != mLayout ) {
+				mResolutionX = mesh->layout->resolutionX;
+				mResolutionY = mesh->layout->resolutionY;
+				mLayout = mesh->layout;
+				mIsLayoutDirty = true;
+			}
+
+			mPositions = mesh->positions;
+			mMeshRevision = mRevision;
+			mIsMeshCached = true;
+			return;
+		}
+	}
+
+	size_t resolutionX, resolutionY;
+	if( mIsAdaptive ) {
+		// determine a suitable mesh resolution based on width/height of the window
+		// and the size of the mesh in pixels
+		const Rectf rect = getMeshBounds();
+		resolutionX = size_t( int( rect.getWidth() / float( mResolution ) ) );
+		resolutionY = size_t( int( rect.getHeight() / float( mResolution ) ) );
+	}
+	else {
+		// use a fixed mesh resolution
+		resolutionX = size_t( int( mWidth ) / mResolution );
+		resolutionY = size_t( int( mHeight ) / mResolution );
+	}
+
 	// Find a value for resolutionX and resolutionY that can be
 	// evenly divided by mControlsX and mControlsY.
 	if( mControlsX > 0 && mControlsX <= resolutionX ) {
@@ -407,72 +958,15 @@ void WarpBilinear::createMesh( size_t resolutionX, size_t resolutionY )
 		resolutionY = mControlsY;
 	}
 
-	//
-	mResolutionX = resolutionX;
-	mResolutionY = resolutionY;
-
-	//
-	const uint32_t numVertices = uint32_t( mResolutionX * mResolutionY );
-	const uint32_t numTriangles = uint32_t( 2 * ( mResolutionX - 1 ) * ( mResolutionY - 1 ) );
-	const uint32_t numIndices = numTriangles * 3;
-
-	//
-	gl::VboMesh::Layout layout;
-	layout.interleave( false );
-	layout.attrib( geom::POSITION, 2 );
-	layout.attrib( geom::TEX_COORD_0, 2 );
-	layout.usage( GL_STATIC_DRAW );
-
-	//
-	mVboMesh = gl::VboMesh::create( numVertices, GL_TRIANGLES, { layout }, numIndices, GL_UNSIGNED_INT );
-	if( !mVboMesh )
-		return;
-
-	// buffer static data
-	mIndices.resize( numIndices );
-	mPositions.resize( numVertices );
-	mTexCoords.resize( numVertices );
-
-	int i = 0;
-	int j = 0;
-
-	for( size_t x = 0; x < mResolutionX; ++x ) {
-		for( size_t y = 0; y < mResolutionY; ++y ) {
-			// index
-			if( x + 1 < resolutionX && y + 1 < resolutionY ) {
-				mIndices[i++] = uint32_t( ( x + 0 ) * resolutionY + ( y + 0 ) );
-				mIndices[i++] = uint32_t( ( x + 1 ) * resolutionY + ( y + 0 ) );
-				mIndices[i++] = uint32_t( ( x + 1 ) * resolutionY + ( y + 1 ) );
-
-				mIndices[i++] = uint32_t( ( x + 0 ) * resolutionY + ( y + 0 ) );
-				mIndices[i++] = uint32_t( ( x + 1 ) * resolutionY + ( y + 1 ) );
-				mIndices[i++] = uint32_t( ( x + 0 ) * resolutionY + ( y + 1 ) );
-			}
-			// texCoords
-			const float tx = x / float( resolutionX - 1 );
-			const float ty = y / float( resolutionY - 1 );
-			mTexCoords[j++] = vec2( tx, ty );
-		}
+	// indices and texture coordinates only depend on the resolution, they are shared by all meshes of that resolution
+	if( !mLayout || resolutionX != mResolutionX || resolutionY != mResolutionY ) {
+		mResolutionX = resolutionX;
+		mResolutionY = resolutionY;
+		mLayout = cache.getLayout( resolutionX, resolutionY );
+		mIsLayoutDirty = true;
 	}
 
-	mPositions.resize( numVertices );
-	mVboMesh->bufferAttrib( geom::POSITION, mPositions.size() * sizeof( vec2 ), mPositions.data() );
-	mVboMesh->bufferAttrib( geom::TEX_COORD_0, mTexCoords.size() * sizeof( vec2 ), mTexCoords.data() );
-	mVboMesh->bufferIndices( mIndices.size() * sizeof( uint32_t ), mIndices.data() );
-
-	//
-	mIsDirty = true;
-}
-
-void WarpBilinear::updateMesh()
-{
-	if( !mShader2D || !mShader2DRect )
-		return;
-	if( !mVboMesh )
-		return;
-	if( !mIsDirty )
-		return;
-
+	// evaluate the positions of the vertices
 	float u, v;
 	long  col, row;
 
@@ -497,11 +991,12 @@ void WarpBilinear::updateMesh()
 			u -= floor( u );
 			v -= floor( v );
 
+			vec2 p;
 			if( mIsLinear ) {
 				// perform linear interpolation
 				vec2 p1 = ( 1.0f - u ) * getPoint( col, row ) + u * getPoint( col + 1, row );
 				vec2 p2 = ( 1.0f - u ) * getPoint( col, row + 1 ) + u * getPoint( col + 1, row + 1 );
-				mPositions[index++] = ( ( 1.0f - v ) * p1 + v * p2 ) * mWindowSize;
+				p = ( 1.0f - v ) * p1 + v * p2;
 			}
 			else {
 				// perform bi-cubic interpolation
@@ -513,15 +1008,67 @@ void WarpBilinear::updateMesh()
 					}
 					rows.push_back( cubicInterpolate( cols, v ) );
 				}
-				mPositions[index++] = cubicInterpolate( rows, u ) * mWindowSize;
+				p = cubicInterpolate( rows, u );
 			}
+
+			// add fine corrections
+			if( mResiduals )
+				p += mResiduals->evaluate( vec2( float( x ) / dx, float( y ) / dy ) );
+
+			mPositions[index++] = p * mWindowSize;
 		}
 	}
 
+	mMeshRevision = mRevision;
+	mIsMeshCached = false;
+
+	if( isCached )
+		cacheMesh( key );
+}
+
+void WarpBilinear::cacheMesh( uint64_t key )
+{
+	auto mesh = std::make_shared<WarpMeshLru::Mesh>();
+	mesh->layout = mLayout;
+	mesh->positions = mPositions;
+	mContext->getMeshLru().insert( key, mesh );
+
+	mIsMeshCached = true;
+}
+
+void WarpBilinear::uploadMesh()
+{
+	if( !mShader2D || !mShader2DRect || !mLayout )
+		return;
+
+	// only recreate the vertex buffer object if the resolution changed
+	if( !mVboMesh || mIsLayoutDirty ) {
+		const auto numVertices = uint32_t( mPositions.size() );
+		const auto numIndices = uint32_t( mLayout->indices.size() );
+
+		gl::VboMesh::Layout layout;
+		layout.interleave( false );
+		layout.attrib( geom::POSITION, 2 );
+		layout.attrib( geom::TEX_COORD_0, 2 );
+		layout.usage( GL_STATIC_DRAW );
+
+		mVboMesh = gl::VboMesh::create( numVertices, GL_TRIANGLES, { layout }, numIndices, GL_UNSIGNED_INT );
+		mTileBatches.clear();
+		if( !mVboMesh )
+			return;
+
+		mVboMesh->bufferAttrib( geom::TEX_COORD_0, mLayout->texCoords.size() * sizeof( vec2 ), mLayout->texCoords.data() );
+		mVboMesh->bufferIndices( mLayout->indices.size() * sizeof( uint32_t ), mLayout->indices.data() );
+		mIsLayoutDirty = false;
+	}
+
 	mVboMesh->bufferAttrib( geom::POSITION, mPositions.size() * sizeof( vec2 ), mPositions.data() );
 
 	mBatch2D = gl::Batch::create( mVboMesh, mShader2D );
 	mBatch2DRect = gl::Batch::create( mVboMesh, mShader2DRect );
+	if( mShader2DYuv )
+		mBatch2DYuv = gl::Batch::create( mVboMesh, mShader2DYuv );
+	mBatchPoints = gl::Batch::create( mVboMesh, gl::getStockShader( gl::ShaderDef().color() ) );
 
 	mIsDirty = false;
 }
@@ -553,6 +1100,15 @@ vec2 WarpBilinear::cubicInterpolate( const std::vector<vec2> &knots, float t )
 	return knots[1] + 0.5f * t * ( knots[2] - knots[0] + t * ( 2.0f * knots[0] - 5.0f * knots[1] + 4.0f * knots[2] - knots[3] + t * ( 3.0f * ( knots[1] - knots[2] ) + knots[3] - knots[0] ) ) );
 }
 
+void WarpBilinear::transformControlPoints( const mat3 &transform )
+{
+	Warp::transformControlPoints( transform );
+
+	// the offsets are vectors, so only the linear part applies, undoing the homogeneous scale of an affine transform
+	if( mResiduals && transform[2][2] != 0 )
+		mResiduals = mResiduals->transformed( mat2( transform ) / transform[2][2] );
+}
+
 void WarpBilinear::setNumControlX( size_t n )
 {
 	// there should be a minimum of 2 control points
@@ -565,23 +1121,15 @@ void WarpBilinear::setNumControlX( size_t n )
 	// create a list of new points
 	std::vector<vec2> temp( n * mControlsY );
 
-	// perform spline fitting
-	for( long row = 0; row < long( mControlsY ); ++row ) {
+	// resample each row along its length, the rows are independent
+	parallelFor( mControlsY, temp.size(), [&]( size_t r ) {
+		const long row = long( r );
+
 		std::vector<vec2> points;
 		if( mIsLinear ) {
 			// construct piece-wise linear spline
-			for( long col = 0; col < long( mControlsX ); ++col ) {
+			for( long col = 0; col < long( mControlsX ); ++col )
 				points.push_back( getPoint( col, row ) );
-			}
-
-			BSpline2f s( points, 1, false, true );
-
-			// calculate position of new control points
-			float length = s.getLength( 0.0f, 1.0f );
-			float step = 1.0f / ( float( n ) - 1.0f );
-			for( size_t col = 0; col < n; ++col ) {
-				temp[col * mControlsY + row] = s.getPosition( s.getTime( length * col * step ) );
-			}
 		}
 		else {
 			// construct piece-wise catmull-rom spline
@@ -602,23 +1150,17 @@ void WarpBilinear::setNumControlX( size_t n )
 					points.push_back( b2 );
 				}
 			}
-
-			BSpline2f s( points, 3, false, true );
-
-			// calculate position of new control points
-			float length = s.getLength( 0.0f, 1.0f );
-			float step = 1.0f / ( float( n ) - 1 );
-			for( size_t col = 0; col < n; ++col ) {
-				temp[col * mControlsY + row] = s.getPosition( s.getTime( length * col * step ) );
-			}
 		}
-	}
+
+		// calculate position of new control points
+		ArcLengthSpline( points, mIsLinear ? 1 : 3 ).resample( n, &temp[r], mControlsY );
+	} );
 
 	// copy new control points
 	mPoints = temp;
 	mControlsX = n;
 
-	mIsDirty = true;
+	invalidate();
 }
 
 void WarpBilinear::setNumControlY( size_t n )
@@ -633,22 +1175,15 @@ void WarpBilinear::setNumControlY( size_t n )
 	// create a list of new points
 	std::vector<vec2> temp( mControlsX * n );
 
-	// perform spline fitting
-	for( long col = 0; col < long( mControlsX ); ++col ) {
+	// resample each column along its length, the columns are independent
+	parallelFor( mControlsX, temp.size(), [&]( size_t c ) {
+		const long col = long( c );
+
 		std::vector<vec2> points;
 		if( mIsLinear ) {
 			// construct piece-wise linear spline
 			for( long row = 0; row < long( mControlsY ); ++row )
 				points.push_back( getPoint( col, row ) );
-
-			BSpline2f s( points, 1, false, true );
-
-			// calculate position of new control points
-			float length = s.getLength( 0.0f, 1.0f );
-			float step = 1.0f / ( float( n ) - 1 );
-			for( size_t row = 0; row < n; ++row ) {
-				temp[col * n + row] = s.getPosition( s.getTime( length * row * step ) );
-			}
 		}
 		else {
 			// construct piece-wise catmull-rom spline
@@ -669,27 +1204,22 @@ void WarpBilinear::setNumControlY( size_t n )
 					points.push_back( b2 );
 				}
 			}
-
-			BSpline2f s( points, 3, false, true );
-
-			// calculate position of new control points
-			float length = s.getLength( 0.0f, 1.0f );
-			float step = 1.0f / ( float( n ) - 1.0f );
-			for( size_t row = 0; row < n; ++row ) {
-				temp[col * n + row] = s.getPosition( s.getTime( length * row * step ) );
-			}
 		}
-	}
+
+		// calculate position of new control points
+		ArcLengthSpline( points, mIsLinear ? 1 : 3 ).resample( n, &temp[c * n], 1 );
+	} );
 
 	// copy new control points
 	mPoints = temp;
 	mControlsY = n;
 
-	mIsDirty = true;
+	invalidate();
 }
 
 void WarpBilinear::createShader()
 {
+	// the NV12 shader is optional, and shaders that failed to compile are not compiled again
 	if( mShader2D && mShader2DRect )
 		return;
 
@@ -728,6 +1258,7 @@ void WarpBilinear::createShader()
 		"uniform vec3          uLuminance;\n"
 		"uniform bool          uEditMode;\n"
 		"uniform bool          uGammaMode;\n"
+		"uniform vec4          uClip;\n"
 		""
 		"in vec2 vertTexCoord0;\n"
 		"in vec2 vertTexCoord1;\n"
@@ -743,6 +1274,8 @@ void WarpBilinear::createShader()
 		"}\n"
 		""
 		"void main( void ) {\n"
+		"   if( any( lessThan( vertTexCoord0, uClip.xy ) ) || any( greaterThan( vertTexCoord0, uClip.zw ) ) ) discard;\n"
+		""
 		"   fragColor.a = 1.0;\n"
 		""
 		"   if( uGammaMode ) {\n"
@@ -788,90 +1321,95 @@ void WarpBilinear::createShader()
 		"	}\n"
 		"}" );
 
-	try {
-		mShader2DRect = gl::GlslProg::create( fmt );
-	}
-	catch( const std::exception &e ) {
-		console() << e.what() << std::endl;
-	}
-
-	fmt.fragment(
-		"#version 150\n"
-		""
-		"uniform sampler2D uTex0;\n"
-		"uniform vec4      uExtends;\n"
-		"uniform vec4      uEdges;\n"
-		"uniform vec3      uGamma;\n"
-		"uniform float     uExponent;\n"
-		"uniform vec3      uLuminance;\n"
-		"uniform bool      uEditMode;\n"
-		"uniform bool      uGammaMode;\n"
-		""
-		"in vec2 vertTexCoord0;\n"
-		"in vec2 vertTexCoord1;\n"
-		"in vec4 vertColor;\n"
-		""
-		"out vec4 fragColor;\n"
-		""
-		"float grid( in vec2 uv, in vec2 size ) {\n"
-		"	vec2 coord = uv / size;\n"
-		"	vec2 grid = abs( fract( coord - 0.5 ) - 0.5 ) / ( 2.0 * fwidth( coord ) );\n"
-		"	float line = min( grid.x, grid.y );\n"
-		"	return 1.0 - min( line, 1.0 );\n"
-		"}\n"
-		""
-		"void main( void ) {\n"
-		"   fragColor.a = 1.0;\n"
-		""
-		"   if( uGammaMode ) {\n"
-		"       float b = mod( floor( gl_FragCoord.x / 64.0 ) + floor( gl_FragCoord.y / 64.0 ), 2.0 );\n"
-		"       float r = mod( gl_FragCoord.x + gl_FragCoord.y, 2.0 );\n"
-		"       int c = int( mod( floor( gl_FragCoord.x / 128.0 ) + 2 * floor( gl_FragCoord.y / 128.0 ), 4.0 ) );\n"
-		"       vec3 clr;\n"
-		"       if( c < 3.0 ) clr[c] = 1.0;\n"
-		"       else clr = vec3( 1 );\n"
-		"	    const vec3 one = vec3( 1.0 );\n"
-		"       fragColor.rgb = pow( mix( 0.5 * clr, r * clr, b ), one / uGamma );\n"
-		"   }\n"
-		"   else {\n"
-		"	    fragColor.rgb = texture( uTex0, vertTexCoord1 ).rgb;\n"
-		""
-		// Edge blending.
-		"       float a = 1.0;\n"
-		"       if( uEdges.x > 0.0 ) a *= clamp( vertTexCoord0.x / uEdges.x, 0.0, 1.0 );\n"
-		"       if( uEdges.y > 0.0 ) a *= clamp( vertTexCoord0.y / uEdges.y, 0.0, 1.0 );\n"
-		"       if( uEdges.z < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.x ) / ( 1.0 - uEdges.z ), 0.0, 1.0 );\n"
-		"       if( uEdges.w < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.y ) / ( 1.0 - uEdges.w ), 0.0, 1.0 );\n"
-		""
-		"       const vec3 one = vec3( 1.0 );\n"
-		"       vec3 blend = ( a < 0.5 ) ? ( uLuminance * pow( 2.0 * a, uExponent ) ) : one - ( one - uLuminance ) * pow( 2.0 * ( 1.0 - a ), uExponent );\n"
-		""
-		"       fragColor.rgb *= clamp( pow( blend, one / uGamma ), 0.0, 1.0 );\n"
-		"   }\n"
-		""
-		"	if( uEditMode ) {\n"
-		// Draw control point grid.
-		"		float f = grid( vertTexCoord0.xy * uExtends.xy, uExtends.zw );\n"
-		"		const vec4 kGridColor = vec4( 1 );\n"
-		"		fragColor = mix( fragColor, kGridColor, f );\n"
-		// Draw edge blending limits.
-		"       const vec4 kEdgeColor = vec4( 0, 1, 1, 1 );\n"
-		"       vec4 edges = abs( vertTexCoord0.xyxy - uEdges );\n"
-		"       vec4 w = 0.5 * fwidth( edges );\n"
-		"       float e = step( edges.x, w.x );\n"
-		"       e += step( edges.y, w.y );\n"
-		"       e += step( edges.z, w.z );\n"
-		"       e += step( edges.w, w.w );\n"
-		"       fragColor = mix( fragColor, kEdgeColor, e );\n"
-		"	}\n"
-		"}" );
-
-	try {
-		mShader2D = gl::GlslProg::create( fmt );
-	}
-	catch( const std::exception &e ) {
-		console() << e.what() << std::endl;
-	}
+	mShader2DRect = mContext->getShader( "WarpBilinear2DRect", fmt );
+
+	// the 2D and NV12 shaders only differ in their samplers and in how they sample the content
+	const auto fragment2D = []( const std::string &samplers, const std::string &sample ) {
+		return "#version 150\n"
+		       ""
+		       + samplers +
+		       "uniform vec4      uExtends;\n"
+		       "uniform vec4      uEdges;\n"
+		       "uniform vec3      uGamma;\n"
+		       "uniform float     uExponent;\n"
+		       "uniform vec3      uLuminance;\n"
+		       "uniform bool      uEditMode;\n"
+		       "uniform bool      uGammaMode;\n"
+		       "uniform vec4      uClip;\n"
+		       ""
+		       "in vec2 vertTexCoord0;\n"
+		       "in vec2 vertTexCoord1;\n"
+		       "in vec4 vertColor;\n"
+		       ""
+		       "out vec4 fragColor;\n"
+		       ""
+		       "float grid( in vec2 uv, in vec2 size ) {\n"
+		       "	vec2 coord = uv / size;\n"
+		       "	vec2 grid = abs( fract( coord - 0.5 ) - 0.5 ) / ( 2.0 * fwidth( coord ) );\n"
+		       "	float line = min( grid.x, grid.y );\n"
+		       "	return 1.0 - min( line, 1.0 );\n"
+		       "}\n"
+		       ""
+		       "void main( void ) {\n"
+		       "   if( any( lessThan( vertTexCoord0, uClip.xy ) ) || any( greaterThan( vertTexCoord0, uClip.zw ) ) ) discard;\n"
+		       ""
+		       "   fragColor.a = 1.0;\n"
+		       ""
+		       "   if( uGammaMode ) {\n"
+		       "       float b = mod( floor( gl_FragCoord.x / 64.0 ) + floor( gl_FragCoord.y / 64.0 ), 2.0 );\n"
+		       "       float r = mod( gl_FragCoord.x + gl_FragCoord.y, 2.0 );\n"
+		       "       int c = int( mod( floor( gl_FragCoord.x / 128.0 ) + 2 * floor( gl_FragCoord.y / 128.0 ), 4.0 ) );\n"
+		       "       vec3 clr;\n"
+		       "       if( c < 3.0 ) clr[c] = 1.0;\n"
+		       "       else clr = vec3( 1 );\n"
+		       "	    const vec3 one = vec3( 1.0 );\n"
+		       "       fragColor.rgb = pow( mix( 0.5 * clr, r * clr, b ), one / uGamma );\n"
+		       "   }\n"
+		       "   else {\n"
+		       + sample +
+		       ""
+		       // Edge blending.
+		       "       float a = 1.0;\n"
+		       "       if( uEdges.x > 0.0 ) a *= clamp( vertTexCoord0.x / uEdges.x, 0.0, 1.0 );\n"
+		       "       if( uEdges.y > 0.0 ) a *= clamp( vertTexCoord0.y / uEdges.y, 0.0, 1.0 );\n"
+		       "       if( uEdges.z < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.x ) / ( 1.0 - uEdges.z ), 0.0, 1.0 );\n"
+		       "       if( uEdges.w < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.y ) / ( 1.0 - uEdges.w ), 0.0, 1.0 );\n"
+		       ""
+		       "       const vec3 one = vec3( 1.0 );\n"
+		       "       vec3 blend = ( a < 0.5 ) ? ( uLuminance * pow( 2.0 * a, uExponent ) ) : one - ( one - uLuminance ) * pow( 2.0 * ( 1.0 - a ), uExponent );\n"
+		       ""
+		       "       fragColor.rgb *= clamp( pow( blend, one / uGamma ), 0.0, 1.0 );\n"
+		       "   }\n"
+		       ""
+		       "	if( uEditMode ) {\n"
+		       // Draw control point grid.
+		       "		float f = grid( vertTexCoord0.xy * uExtends.xy, uExtends.zw );\n"
+		       "		const vec4 kGridColor = vec4( 1 );\n"
+		       "		fragColor = mix( fragColor, kGridColor, f );\n"
+		       // Draw edge blending limits.
+		       "       const vec4 kEdgeColor = vec4( 0, 1, 1, 1 );\n"
+		       "       vec4 edges = abs( vertTexCoord0.xyxy - uEdges );\n"
+		       "       vec4 w = 0.5 * fwidth( edges );\n"
+		       "       float e = step( edges.x, w.x );\n"
+		       "       e += step( edges.y, w.y );\n"
+		       "       e += step( edges.z, w.z );\n"
+		       "       e += step( edges.w, w.w );\n"
+		       "       fragColor = mix( fragColor, kEdgeColor, e );\n"
+		       "	}\n"
+		       "}";
+	};
+
+	fmt.fragment( fragment2D( "uniform sampler2D uTex0;\n", "\t    fragColor.rgb = texture( uTex0, vertTexCoord1 ).rgb;\n" ) );
+	mShader2D = mContext->getShader( "WarpBilinear2D", fmt );
+
+	// NV12: luma in the red channel of uTex0, interleaved chroma in red and green of uTex1
+	fmt.fragment( fragment2D( "uniform sampler2D uTex0;\n"
+	                          "uniform sampler2D uTex1;\n"
+	                          "uniform mat3      uYuvMatrix;\n"
+	                          "uniform vec3      uYuvOffset;\n",
+	    "\t    vec3 yuv = vec3( texture( uTex0, vertTexCoord1 ).r, texture( uTex1, vertTexCoord1 ).rg );\n"
+	    "\t    fragColor.rgb = clamp( uYuvMatrix * ( yuv - uYuvOffset ), 0.0, 1.0 );\n" ) );
+	mShader2DYuv = mContext->getShader( "WarpBilinear2DYuv", fmt );
 }
 
 Rectf WarpBilinear::getMeshBounds() const
@@ -897,4 +1435,49 @@ void WarpBilinear::setTexCoords( float x1, float y1, float x2, float y2 )
 	mY2 = y2;
 }
 
+// ----------------------------------------------------------------------------------------------------------------
+
+ResolutionController::ResolutionController( float targetFrameRate )
+	: mTargetFrameTime( 1.0 / double( glm::max( targetFrameRate, 1.0f ) ) )
+	, mAverageFrameTime( mTargetFrameTime )
+	, mLastTime( -1.0 )
+	, mScale( 1.0f )
+	, mMinScale( 0.5f )
+{
+}
+
+float ResolutionController::update()
+{
+	const double time = app::getElapsedSeconds();
+	const double elapsed = mLastTime < 0.0 ? mTargetFrameTime : time - mLastTime;
+	mLastTime = time;
+
+	return update( elapsed );
+}
+
+float ResolutionController::update( double frameTime )
+{
+	// smooth out the occasional spike
+	mAverageFrameTime = glm::mix( mAverageFrameTime, frameTime, 0.1 );
+
+	// lower the resolution quickly if we're too slow, raise it slowly if there is headroom
+	if( mAverageFrameTime > 1.05 * mTargetFrameTime )
+		mScale *= 0.95f;
+	else if( mAverageFrameTime < 0.85 * mTargetFrameTime )
+		mScale *= 1.01f;
+
+	mScale = glm::clamp( mScale, mMinScale, 1.0f );
+
+	return mScale;
+}
+
+void ResolutionController::apply( const WarpList &warps ) const
+{
+	for( const auto &warp : warps ) {
+		auto bilinear = std::dynamic_pointer_cast<WarpBilinear>( warp );
+		if( bilinear )
+			bilinear->setResolutionScale( mScale );
+	}
+}
+
 } // namespace ph::warping
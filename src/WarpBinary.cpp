@@ -0,0 +1,140 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpBinary.h"
+
+#include <cstring>
+
+namespace ph::warping {
+
+namespace {
+
+struct Crc32Table {
+	uint32_t entries[256];
+
+	Crc32Table()
+	{
+		for( uint32_t i = 0; i < 256; ++i ) {
+			uint32_t c = i;
+			for( int k = 0; k < 8; ++k )
+				c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+			entries[i] = c;
+		}
+	}
+};
+
+bool isLittleEndian()
+{
+	const uint16_t probe = 1;
+	return *reinterpret_cast<const uint8_t *>( &probe ) == 1;
+}
+
+} // namespace
+
+uint32_t crc32( const void *data, size_t size, uint32_t crc )
+{
+	static const Crc32Table table;
+
+	auto ptr = static_cast<const uint8_t *>( data );
+
+	crc = ~crc;
+	for( size_t i = 0; i < size; ++i )
+		crc = table.entries[( crc ^ ptr[i] ) & 0xFF] ^ ( crc >> 8 );
+
+	return ~crc;
+}
+
+const WarpBinaryHeader *validateWarpBinary( const void *data, size_t size )
+{
+	// the records are used in place, which requires a little-endian host and aligned data
+	if( !isLittleEndian() || !data || ( reinterpret_cast<uintptr_t>( data ) & 7 ) != 0 || size < sizeof( WarpBinaryHeader ) )
+		return nullptr;
+
+	auto header = static_cast<const WarpBinaryHeader *>( data );
+	if( std::memcmp( header->magic, "WARPBIN", 8 ) != 0 || header->version != WarpBinaryHeader::kVersion )
+		return nullptr;
+
+	if( header->headerSize != sizeof( WarpBinaryHeader ) || header->recordSize != sizeof( WarpBinaryRecord ) || header->size != size )
+		return nullptr;
+
+	if( uint64_t( header->numWarps ) * sizeof( WarpBinaryRecord ) > size - sizeof( WarpBinaryHeader ) )
+		return nullptr;
+
+	auto bytes = static_cast<const uint8_t *>( data );
+	if( crc32( bytes + sizeof( WarpBinaryHeader ), size - sizeof( WarpBinaryHeader ) ) != header->crc )
+		return nullptr;
+
+	// make sure the control points and residuals of each warp are inside the file
+	auto records = getWarpBinaryRecords( header );
+	for( uint32_t i = 0; i < header->numWarps; ++i ) {
+		const uint64_t count = uint64_t( records[i].controlsX ) * records[i].controlsY;
+		if( records[i].controlsX > 0xFFFF || records[i].controlsY > 0xFFFF || ( records[i].points & 3 ) != 0 )
+			return nullptr;
+		if( records[i].points > size || count * 2 * sizeof( float ) + records[i].residuals > size - records[i].points )
+			return nullptr;
+	}
+
+	return header;
+}
+
+void writeWarpBinaryRecord( const Warp::State &state, WarpBinaryRecord &record )
+{
+	record.type = uint32_t( state.type );
+	record.controlsX = uint32_t( state.controlsX );
+	record.controlsY = uint32_t( state.controlsY );
+	record.resolution = state.resolution;
+	record.flags = ( state.linear ? WarpBinaryRecord::kLinear : 0 ) | ( state.adaptive ? WarpBinaryRecord::kAdaptive : 0 );
+	record.brightness = state.brightness;
+	record.exponent = state.exponent;
+	for( int j = 0; j < 3; ++j ) {
+		record.luminance[j] = state.luminance[j];
+		record.gamma[j] = state.gamma[j];
+	}
+	for( int j = 0; j < 4; ++j )
+		record.edges[j] = state.edges[j];
+	for( size_t j = 0; j < state.corners.size() && j < 4; ++j ) {
+		record.corners[2 * j] = state.corners[j].x;
+		record.corners[2 * j + 1] = state.corners[j].y;
+	}
+}
+
+void readWarpBinaryRecord( const WarpBinaryRecord &record, Warp::State &state )
+{
+	state.type = Warp::WarpType( record.type );
+	state.controlsX = record.controlsX;
+	state.controlsY = record.controlsY;
+	state.brightness = record.brightness;
+	state.exponent = record.exponent;
+	state.luminance = ci::vec3( record.luminance[0], record.luminance[1], record.luminance[2] );
+	state.gamma = ci::vec3( record.gamma[0], record.gamma[1], record.gamma[2] );
+	state.edges = ci::vec4( record.edges[0], record.edges[1], record.edges[2], record.edges[3] );
+	state.resolution = record.resolution;
+	state.linear = ( record.flags & WarpBinaryRecord::kLinear ) != 0;
+	state.adaptive = ( record.flags & WarpBinaryRecord::kAdaptive ) != 0;
+
+	// only perspective-bilinear warps have corners
+	state.corners.clear();
+	if( state.type == Warp::WarpType::PERSPECTIVE_BILINEAR ) {
+		for( size_t j = 0; j < 4; ++j )
+			state.corners.emplace_back( record.corners[2 * j], record.corners[2 * j + 1] );
+	}
+}
+
+} // namespace ph::warping
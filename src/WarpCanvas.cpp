@@ -0,0 +1,186 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpCanvas.h"
+
+#include <cinder/app/App.h>
+#include <cinder/gl/Fbo.h>
+#include <cinder/gl/scoped.h>
+
+using namespace ci;
+using namespace ci::app;
+
+namespace ph::warping {
+
+WarpCanvas::WarpCanvas( int width, int height, const gl::Fbo::Format &format, int tileSize )
+	: mSize( glm::max( width, 1 ), glm::max( height, 1 ) )
+	, mFormat( format )
+{
+	const int maxSize = getMaxTileSize();
+	if( tileSize <= 0 || tileSize > maxSize )
+		tileSize = maxSize;
+
+	mTileSize = ivec2( glm::min( tileSize, mSize.x ), glm::min( tileSize, mSize.y ) );
+	mNumTiles = ivec2( ( mSize.x + mTileSize.x - 1 ) / mTileSize.x, ( mSize.y + mTileSize.y - 1 ) / mTileSize.y );
+
+	// tiles are stored row by row, the last column and row may be smaller
+	mTiles.resize( size_t( mNumTiles.x * mNumTiles.y ) );
+	for( int row = 0; row < mNumTiles.y; ++row ) {
+		for( int col = 0; col < mNumTiles.x; ++col ) {
+			const ivec2 ul( col * mTileSize.x, row * mTileSize.y );
+			const ivec2 lr( glm::min( ul.x + mTileSize.x, mSize.x ), glm::min( ul.y + mTileSize.y, mSize.y ) );
+			mTiles[row * mNumTiles.x + col].area = Area( ul, lr );
+		}
+	}
+}
+
+int WarpCanvas::getMaxTileSize()
+{
+	// the limit differs between contexts, so it is not cached
+	GLint size = 0;
+	glGetIntegerv( GL_MAX_TEXTURE_SIZE, &size );
+
+	return size > 0 ? int( size ) : 4096;
+}
+
+std::vector<size_t> WarpCanvas::getTiles( const Area &area ) const
+{
+	std::vector<size_t> result;
+
+	// srcArea may be flipped
+	const int x1 = glm::max( glm::min( area.x1, area.x2 ), 0 );
+	const int x2 = glm::min( glm::max( area.x1, area.x2 ), mSize.x );
+	const int y1 = glm::max( glm::min( area.y1, area.y2 ), 0 );
+	const int y2 = glm::min( glm::max( area.y1, area.y2 ), mSize.y );
+	if( x1 >= x2 || y1 >= y2 )
+		return result;
+
+	const int col1 = x1 / mTileSize.x;
+	const int col2 = ( x2 - 1 ) / mTileSize.x;
+	const int row1 = y1 / mTileSize.y;
+	const int row2 = ( y2 - 1 ) / mTileSize.y;
+
+	for( int row = row1; row <= row2; ++row )
+		for( int col = col1; col <= col2; ++col )
+			result.push_back( size_t( row * mNumTiles.x + col ) );
+
+	return result;
+}
+
+gl::Texture2dRef WarpCanvas::getTexture( size_t index ) const
+{
+	if( index >= mTiles.size() || !mTiles[index].fbo )
+		return gl::Texture2dRef();
+
+	return mTiles[index].fbo->getColorTexture();
+}
+
+bool WarpCanvas::getTileCoords( size_t index, const Area &srcArea, vec4 *clip, vec4 *coords ) const
+{
+	const float sw = float( srcArea.getWidth() );
+	const float sh = float( srcArea.getHeight() );
+	if( index >= mTiles.size() || sw == 0.0f || sh == 0.0f )
+		return false;
+
+	const Area &tile = mTiles[index].area;
+
+	// srcArea may be flipped, so sort the coordinates
+	const float u1 = ( tile.x1 - srcArea.x1 ) / sw;
+	const float u2 = ( tile.x2 - srcArea.x1 ) / sw;
+	const float v1 = ( tile.y1 - srcArea.y1 ) / sh;
+	const float v2 = ( tile.y2 - srcArea.y1 ) / sh;
+
+	clip->x = glm::clamp( glm::min( u1, u2 ), 0.0f, 1.0f );
+	clip->y = glm::clamp( glm::min( v1, v2 ), 0.0f, 1.0f );
+	clip->z = glm::clamp( glm::max( u1, u2 ), 0.0f, 1.0f );
+	clip->w = glm::clamp( glm::max( v1, v2 ), 0.0f, 1.0f );
+	if( clip->x >= clip->z || clip->y >= clip->w )
+		return false;
+
+	// frame buffer textures are stored upside down
+	const float tw = float( tile.getWidth() );
+	const float th = float( tile.getHeight() );
+	coords->x = ( srcArea.x1 - tile.x1 ) / tw;
+	coords->y = 1.0f - ( srcArea.y1 - tile.y1 ) / th;
+	coords->z = sw / tw;
+	coords->w = -sh / th;
+
+	return true;
+}
+
+void WarpCanvas::reference( const Area &area )
+{
+	for( const auto index : getTiles( area ) )
+		mTiles[index].referenced = true;
+}
+
+size_t WarpCanvas::getNumAllocated() const
+{
+	size_t count = 0;
+	for( const auto &tile : mTiles )
+		if( tile.fbo )
+			++count;
+
+	return count;
+}
+
+void WarpCanvas::release()
+{
+	for( auto &tile : mTiles ) {
+		tile.fbo.reset();
+		tile.referenced = false;
+	}
+}
+
+void WarpCanvas::render( const std::function<void( const Area & )> &fn )
+{
+	for( auto &tile : mTiles ) {
+		// tiles that no warp referenced since the last render are freed
+		if( !tile.referenced ) {
+			tile.fbo.reset();
+			continue;
+		}
+
+		// warps reference the tiles again while they draw
+		tile.referenced = false;
+
+		if( !tile.fbo ) {
+			try {
+				tile.fbo = gl::Fbo::create( tile.area.getWidth(), tile.area.getHeight(), mFormat );
+			}
+			catch( const std::exception &exc ) {
+				console() << exc.what() << std::endl;
+				continue;
+			}
+		}
+
+		gl::ScopedFramebuffer scpFbo( tile.fbo );
+		gl::ScopedViewport    scpViewport( ivec2( 0 ), tile.fbo->getSize() );
+		gl::ScopedMatrices    scpMatrices;
+
+		// allow drawing in canvas coordinates
+		gl::setMatricesWindow( tile.fbo->getSize() );
+		gl::translate( -vec2( tile.area.getUL() ) );
+
+		fn( tile.area );
+	}
+}
+
+} // namespace ph::warping
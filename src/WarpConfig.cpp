@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpConfig.h"
+#include "WarpXmlReader.h"
+
+#include <cinder/Xml.h>
+#include <cinder/app/App.h>
+
+using namespace ci;
+
+namespace ph::warping {
+
+WarpConfigRef WarpConfig::read( const DataSourceRef &source )
+{
+	auto config = WarpConfig::create();
+
+	try {
+		std::string active;
+		for( auto &profile : WarpXmlReader::readProfiles( source, &active ) ) {
+			// build the meshes now, so any profile can be activated without delay
+			for( auto &warp : profile.warps ) {
+				warp->prepare();
+				warp->upload();
+			}
+
+			config->setProfile( profile.name, profile.warps );
+		}
+
+		config->setActiveProfile( active );
+	}
+	catch( const std::exception &exc ) {
+		app::console() << exc.what() << std::endl;
+	}
+
+	return config;
+}
+
+WarpConfig::WarpConfig()
+	: mActive( 0 )
+{
+}
+
+void WarpConfig::write( const DataTargetRef &target ) const
+{
+	// create config document and root <warp-config>
+	XmlTree doc;
+	doc.setTag( "warp-config" );
+	doc.setAttribute( "version", "1.1" );
+	doc.setAttribute( "profile", getActiveProfile() );
+
+	// add profiles to root
+	for( const auto &profile : mProfiles )
+		doc.push_back( Warp::createProfileXml( profile.warps, profile.name ) );
+
+	// write file
+	doc.write( target );
+}
+
+void WarpConfig::setProfile( const std::string &name, const WarpList &warps )
+{
+	const size_t index = findProfile( name );
+	if( index < mProfiles.size() )
+		mProfiles[index].warps = warps;
+	else
+		mProfiles.push_back( { name, warps } );
+}
+
+bool WarpConfig::removeProfile( const std::string &name )
+{
+	const size_t index = findProfile( name );
+	if( index >= mProfiles.size() || index == mActive )
+		return false;
+
+	mProfiles.erase( mProfiles.begin() + index );
+	if( mActive > index )
+		--mActive;
+
+	return true;
+}
+
+const std::string &WarpConfig::getActiveProfile() const
+{
+	static const std::string empty;
+	return mActive < mProfiles.size() ? mProfiles[mActive].name : empty;
+}
+
+bool WarpConfig::setActiveProfile( const std::string &name )
+{
+	const size_t index = findProfile( name );
+	if( index >= mProfiles.size() )
+		return false;
+
+	// finish pending input on the warps we leave behind
+	if( index != mActive && mActive < mProfiles.size() )
+		Warp::processInput( mProfiles[mActive].warps );
+
+	mActive = index;
+
+	return true;
+}
+
+WarpList &WarpConfig::getWarps( const std::string &name )
+{
+	const size_t index = findProfile( name );
+	return index < mProfiles.size() ? mProfiles[index].warps : mEmpty;
+}
+
+void WarpConfig::handleResize()
+{
+	for( auto &profile : mProfiles )
+		Warp::handleResize( profile.warps );
+}
+
+void WarpConfig::handleResize( const ivec2 &size )
+{
+	for( auto &profile : mProfiles )
+		Warp::handleResize( profile.warps, size );
+}
+
+void WarpConfig::setSize( const vec2 &size )
+{
+	for( auto &profile : mProfiles )
+		Warp::setSize( profile.warps, size );
+}
+
+void WarpConfig::update()
+{
+	// the active profile is rebuilt when it is drawn
+	for( size_t i = 0; i < mProfiles.size(); ++i ) {
+		if( i == mActive )
+			continue;
+
+		for( auto &warp : mProfiles[i].warps ) {
+			if( warp->isDirty() ) {
+				warp->prepare();
+				warp->upload();
+				return;
+			}
+		}
+	}
+}
+
+size_t WarpConfig::findProfile( const std::string &name ) const
+{
+	for( size_t i = 0; i < mProfiles.size(); ++i ) {
+		if( mProfiles[i].name == name )
+			return i;
+	}
+
+	return mProfiles.size();
+}
+
+} // namespace ph::warping
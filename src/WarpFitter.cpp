@@ -0,0 +1,353 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpFitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+//! Weights of the 4 control points along one axis that contribute to a point of the surface, starting at control point \a first.
+struct Weights {
+	long  first;
+	float w[4];
+};
+
+//! Returns the weights at normalized position \a t of a row or column of \a count control points. Points beyond the edges are
+//! extrapolated the same way WarpBilinear::getPoint() does, so their weights are moved onto the points they are derived from.
+Weights getWeights( float t, size_t count, bool linear )
+{
+	const long last = long( count ) - 1;
+
+	// transform to [0..last] and determine the segment, the last point belongs to the last segment
+	t = glm::clamp( t, 0.0f, 1.0f ) * float( last );
+	const long segment = glm::min( long( t ), last - 1 );
+	t -= float( segment );
+
+	Weights result = { segment - 1, { 0, 0, 0, 0 } };
+	if( linear ) {
+		result.w[1] = 1.0f - t;
+		result.w[2] = t;
+		return result;
+	}
+
+	// Catmull-Rom basis, see WarpBilinear::cubicInterpolate()
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+	result.w[0] = 0.5f * ( -t + 2.0f * t2 - t3 );
+	result.w[1] = 1.0f + 0.5f * ( -5.0f * t2 + 3.0f * t3 );
+	result.w[2] = 0.5f * ( t + 4.0f * t2 - 3.0f * t3 );
+	result.w[3] = 0.5f * ( -t2 + t3 );
+
+	// extrapolated points: p[-1] = 2 p[0] - p[1] and p[last + 1] = 2 p[last] - p[last - 1]
+	if( segment == 0 ) {
+		result.w[1] += 2.0f * result.w[0];
+		result.w[2] -= result.w[0];
+		result.w[0] = 0;
+	}
+	if( segment == last - 1 ) {
+		result.w[2] += 2.0f * result.w[3];
+		result.w[1] -= result.w[3];
+		result.w[3] = 0;
+	}
+
+	return result;
+}
+
+//! Symmetric positive definite matrix of which only the diagonal and the \a bandwidth sub-diagonals are non-zero. Only the lower half
+//! is stored, row by row, so the elements of a row are contiguous.
+class BandMatrix {
+  public:
+	BandMatrix( size_t size, size_t bandwidth )
+		: mSize( size )
+		, mBandwidth( bandwidth )
+		, mValues( size * ( bandwidth + 1 ), 0.0 )
+	{
+	}
+
+	//! Returns element (\a row, \a col) of the lower half, with \a col in [row - bandwidth, row].
+	double &at( size_t row, size_t col ) { return getRow( row )[col]; }
+	//! Adds \a value to element (\a i, \a j) of the matrix.
+	void add( size_t i, size_t j, double value ) { i < j ? at( j, i ) += value : at( i, j ) += value; }
+
+	//! Returns the first column of \a row that is stored.
+	size_t getFirst( size_t row ) const { return row > mBandwidth ? row - mBandwidth : 0; }
+	//! Returns the last row of \a col that is stored.
+	size_t getLast( size_t col ) const { return glm::min( mSize - 1, col + mBandwidth ); }
+
+	//! Replaces the matrix by its Cholesky factor L. Returns \c FALSE if the matrix is not positive definite.
+	bool factorize()
+	{
+		for( size_t j = 0; j < mSize; ++j ) {
+			const double *rj = getRow( j );
+
+			double sum = rj[j];
+			for( size_t k = getFirst( j ); k < j; ++k )
+				sum -= rj[k] * rj[k];
+			if( !( sum > 0.0 ) )
+				return false;
+
+			const double diagonal = std::sqrt( sum );
+			at( j, j ) = diagonal;
+
+			for( size_t i = j + 1, last = getLast( j ); i <= last; ++i ) {
+				double *ri = getRow( i );
+
+				double value = ri[j];
+				for( size_t k = getFirst( i ); k < j; ++k )
+					value -= ri[k] * rj[k];
+				ri[j] = value / diagonal;
+			}
+		}
+
+		return true;
+	}
+
+	//! Solves L L^T x = b in place, after a successful call to factorize().
+	void solve( std::vector<dvec2> &b ) const
+	{
+		for( size_t i = 0; i < mSize; ++i ) {
+			const double *ri = getRow( i );
+			for( size_t k = getFirst( i ); k < i; ++k )
+				b[i] -= ri[k] * b[k];
+			b[i] /= ri[i];
+		}
+
+		for( size_t i = mSize; i-- > 0; ) {
+			for( size_t k = i + 1, last = getLast( i ); k <= last; ++k )
+				b[i] -= getRow( k )[i] * b[k];
+			b[i] /= getRow( i )[i];
+		}
+	}
+
+  private:
+	//! Row \a i is stored at offset (i + 1) * bandwidth, which lets it be indexed by column.
+	double       *getRow( size_t i ) { return mValues.data() + ( i + 1 ) * mBandwidth; }
+	const double *getRow( size_t i ) const { return mValues.data() + ( i + 1 ) * mBandwidth; }
+
+	size_t              mSize;
+	size_t              mBandwidth;
+	std::vector<double> mValues;
+};
+
+} // namespace
+
+WarpFitter::WarpFitter( const Format &format )
+	: mFormat( format )
+	, mError( 0 )
+{
+}
+
+void WarpFitter::addSample( const vec2 &uv, const vec2 &xy, float weight )
+{
+	if( weight > 0 )
+		mSamples.push_back( { uv, xy, weight } );
+}
+
+bool WarpFitter::solve( size_t controlsX, size_t controlsY, bool linear, std::vector<vec2> &points )
+{
+	return solve( mSamples, controlsX, controlsY, linear, mFormat.mIsCornersFixed, points );
+}
+
+bool WarpFitter::fit( const WarpBilinearRef &warp )
+{
+	if( !warp )
+		return false;
+
+	auto samples = mSamples;
+
+	// the control points of a perspective-bilinear warp are fitted in the space of its perspective warp
+	const bool isPerspective = warp->getType() == Warp::WarpType::PERSPECTIVE_BILINEAR;
+	if( isPerspective ) {
+		const auto &perspective = std::static_pointer_cast<WarpPerspectiveBilinear>( warp )->mWarp;
+		perspective->getTransform();
+
+		const mat4 inverted = perspective->getInvertedTransform();
+		const vec2 size( perspective->getSize() );
+		for( auto &sample : samples ) {
+			const vec2 p = sample.xy * warp->mWindowSize;
+			vec4       pt = inverted * vec4( p.x, p.y, 0, 1 );
+
+			if( pt.w != 0 )
+				pt.w = 1 / pt.w;
+			pt *= pt.w;
+
+			sample.xy = vec2( pt.x, pt.y ) / size;
+		}
+	}
+
+	// residual corrections are added to the surface, so only fit what remains
+	if( warp->mResiduals ) {
+		for( auto &sample : samples )
+			sample.xy -= warp->mResiduals->evaluate( sample.uv );
+	}
+
+	// the corners of a perspective-bilinear warp are controlled by its perspective warp
+	auto points = warp->mPoints;
+	if( !solve( samples, warp->mControlsX, warp->mControlsY, warp->mIsLinear, isPerspective || mFormat.mIsCornersFixed, points ) )
+		return false;
+
+	warp->Warp::setControlPoints( points.data(), points.size() );
+
+	return true;
+}
+
+bool WarpFitter::solve( const std::vector<Sample> &samples, size_t controlsX, size_t controlsY, bool linear, bool fixCorners, std::vector<vec2> &points )
+{
+	if( controlsX < 2 || controlsY < 2 )
+		return false;
+
+	const size_t count = controlsX * controlsY;
+	if( points.size() != count ) {
+		points.clear();
+		for( size_t x = 0; x < controlsX; ++x ) {
+			for( size_t y = 0; y < controlsY; ++y )
+				points.emplace_back( float( x ) / float( controlsX - 1 ), float( y ) / float( controlsY - 1 ) );
+		}
+	}
+
+	// number the unknowns along the shortest side of the grid first, a sample then couples unknowns at most 3 columns and 3 rows apart
+	const bool   isColumnMajor = controlsY <= controlsX;
+	const size_t minor = isColumnMajor ? controlsY : controlsX;
+	auto         unknown = [&]( size_t x, size_t y ) { return isColumnMajor ? x * controlsY + y : y * controlsX + x; };
+
+	BandMatrix         matrix( count, glm::min( 3 * minor + 3, count - 1 ) );
+	std::vector<dvec2> rhs( count, dvec2( 0 ) );
+
+	// data term: each sample is a weighted sum of at most 4x4 control points
+	size_t indices[16];
+	double weights[16];
+	double totalWeight = 0;
+	for( const auto &sample : samples ) {
+		const auto wx = getWeights( sample.uv.x, controlsX, linear );
+		const auto wy = getWeights( sample.uv.y, controlsY, linear );
+
+		size_t n = 0;
+		for( int i = 0; i < 4; ++i ) {
+			for( int j = 0; j < 4; ++j ) {
+				if( wx.w[i] == 0 || wy.w[j] == 0 )
+					continue;
+
+				indices[n] = unknown( size_t( wx.first + i ), size_t( wy.first + j ) );
+				weights[n] = double( wx.w[i] ) * double( wy.w[j] );
+				++n;
+			}
+		}
+
+		for( size_t a = 0; a < n; ++a ) {
+			rhs[indices[a]] += sample.weight * weights[a] * dvec2( sample.xy );
+			for( size_t b = 0; b <= a; ++b )
+				matrix.add( indices[a], indices[b], sample.weight * weights[a] * weights[b] );
+		}
+
+		totalWeight += sample.weight;
+	}
+
+	// smoothness term: penalize the second differences of the grid along both axes
+	const double smoothness = double( mFormat.mSmoothness ) * totalWeight / double( count );
+	auto         addDifference = [&]( size_t p, size_t q, size_t r ) {
+		const size_t index[3] = { p, q, r };
+		const double coefficient[3] = { 1, -2, 1 };
+		for( int a = 0; a < 3; ++a ) {
+			for( int b = 0; b <= a; ++b )
+				matrix.add( index[a], index[b], smoothness * coefficient[a] * coefficient[b] );
+		}
+	};
+	if( smoothness > 0 ) {
+		for( size_t x = 0; x < controlsX; ++x ) {
+			for( size_t y = 0; y < controlsY; ++y ) {
+				if( x > 0 && x + 1 < controlsX )
+					addDifference( unknown( x - 1, y ), unknown( x, y ), unknown( x + 1, y ) );
+				if( y > 0 && y + 1 < controlsY )
+					addDifference( unknown( x, y - 1 ), unknown( x, y ), unknown( x, y + 1 ) );
+			}
+		}
+	}
+
+	// a little damping towards the initial grid, so control points without samples are still determined
+	const double damping = 1e-6 * glm::max( totalWeight / double( count ), 1.0 );
+	for( size_t x = 0; x < controlsX; ++x ) {
+		for( size_t y = 0; y < controlsY; ++y ) {
+			const size_t k = unknown( x, y );
+			matrix.at( k, k ) += damping;
+			rhs[k] += damping * dvec2( points[x * controlsY + y] );
+		}
+	}
+
+	// fixed corners: move them to the right-hand side and decouple their equations
+	if( fixCorners ) {
+		const size_t corners[4][2] = { { 0, 0 }, { controlsX - 1, 0 }, { 0, controlsY - 1 }, { controlsX - 1, controlsY - 1 } };
+		for( const auto &corner : corners ) {
+			const size_t k = unknown( corner[0], corner[1] );
+			const dvec2  value( points[corner[0] * controlsY + corner[1]] );
+
+			for( size_t i = matrix.getFirst( k ), last = matrix.getLast( k ); i <= last; ++i ) {
+				if( i == k )
+					continue;
+
+				double &element = i < k ? matrix.at( k, i ) : matrix.at( i, k );
+				rhs[i] -= element * value;
+				element = 0;
+			}
+
+			matrix.at( k, k ) = 1;
+			rhs[k] = value;
+		}
+	}
+
+	if( !matrix.factorize() )
+		return false;
+
+	matrix.solve( rhs );
+
+	for( size_t x = 0; x < controlsX; ++x ) {
+		for( size_t y = 0; y < controlsY; ++y )
+			points[x * controlsY + y] = vec2( rhs[unknown( x, y )] );
+	}
+
+	// measure how well the surface fits the samples
+	double error = 0;
+	for( const auto &sample : samples ) {
+		const auto wx = getWeights( sample.uv.x, controlsX, linear );
+		const auto wy = getWeights( sample.uv.y, controlsY, linear );
+
+		vec2 p( 0 );
+		for( int i = 0; i < 4; ++i ) {
+			for( int j = 0; j < 4; ++j ) {
+				if( wx.w[i] != 0 && wy.w[j] != 0 )
+					p += wx.w[i] * wy.w[j] * points[size_t( wx.first + i ) * controlsY + size_t( wy.first + j )];
+			}
+		}
+
+		const vec2 d = p - sample.xy;
+		error += sample.weight * double( glm::dot( d, d ) );
+	}
+
+	mError = totalWeight > 0 ? float( std::sqrt( error / totalWeight ) ) : 0.0f;
+
+	return true;
+}
+
+} // namespace ph::warping
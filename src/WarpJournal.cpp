@@ -0,0 +1,525 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpJournal.h"
+#include "WarpBinary.h"
+#include "WarpWatcher.h"
+
+#include <cinder/Xml.h>
+#include <cinder/app/App.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if defined( CINDER_MSW )
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+//! The journal starts with a header, followed by entries. Each entry is a size and a checksum, followed by the index of the warp and
+//! the number of warps, a WarpBinaryRecord, the control points of the warp and its residual grid, if any. An entry with an index past
+//! the number of warps only records that warps were removed.
+struct JournalHeader {
+	static const uint32_t kVersion = 2;
+
+	//! "WARPJNL" followed by a zero.
+	char     magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct EntryHeader {
+	//! Size of the entry in bytes, following this header.
+	uint32_t size;
+	//! CRC-32 of the entry, following this header.
+	uint32_t crc;
+};
+
+const size_t kEntryPrefix = 2 * sizeof( uint32_t );
+
+//! Flushes the file and waits until the operating system has written it to disk.
+void sync( std::FILE *file )
+{
+	std::fflush( file );
+#if defined( CINDER_MSW )
+	_commit( _fileno( file ) );
+#else
+	fsync( fileno( file ) );
+#endif
+}
+
+//! Waits until the file at \a path has been written to disk.
+void sync( const fs::path &path )
+{
+	if( auto file = std::fopen( path.string().c_str(), "ab" ) ) {
+		sync( file );
+		std::fclose( file );
+	}
+}
+
+} // namespace
+
+WarpJournal::WarpJournal( const fs::path &path, const Format &format )
+	: mPath( path )
+	, mJournalPath( path )
+	, mFormat( format )
+	, mIsCountChanged( false )
+	, mIsSeeded( false )
+	, mTimer( true )
+	, mFirstChange( -1 )
+	, mLastChange( 0 )
+	, mHasBaseline( false )
+	, mIsRunning( true )
+	, mIsCompactRequested( false )
+	, mNumRequested( 0 )
+	, mNumCompleted( 0 )
+	, mFile( nullptr )
+	, mIsSaved( false )
+	, mNumJournaled( 0 )
+	, mCompactionTimer( true )
+	, mNumEntries( 0 )
+	, mNumCompactions( 0 )
+{
+	mJournalPath += ".journal";
+
+	mThread = std::thread( &WarpJournal::run, this );
+}
+
+WarpJournal::~WarpJournal()
+{
+	// the last changes may not have settled yet
+	flush( true );
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mIsRunning = false;
+	}
+	mCondition.notify_one();
+
+	if( mThread.joinable() )
+		mThread.join();
+
+	if( mFile )
+		std::fclose( mFile );
+}
+
+size_t WarpJournal::recover( WarpList &warps )
+{
+	std::vector<Warp::State> states;
+	for( const auto &warp : warps )
+		states.push_back( warp->getState() );
+
+	// read the whole journal, it is compacted regularly and therefore small
+	std::ifstream file( mJournalPath, std::ios::binary );
+	std::string   data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	size_t numReplayed = 0;
+
+	JournalHeader header;
+	if( data.size() >= sizeof( header ) ) {
+		std::memcpy( &header, data.data(), sizeof( header ) );
+		if( std::memcmp( header.magic, "WARPJNL", 8 ) != 0 || header.version != JournalHeader::kVersion )
+			data.clear();
+	}
+
+	for( size_t offset = sizeof( header ); offset + sizeof( EntryHeader ) <= data.size(); ) {
+		EntryHeader entry;
+		std::memcpy( &entry, data.data() + offset, sizeof( entry ) );
+		offset += sizeof( entry );
+
+		// stop at a torn or corrupt entry, which can only be the last one written before a crash
+		const size_t fixed = kEntryPrefix + sizeof( WarpBinaryRecord );
+		if( entry.size < fixed || entry.size > data.size() - offset || crc32( data.data() + offset, entry.size ) != entry.crc )
+			break;
+
+		uint32_t         index, numWarps;
+		WarpBinaryRecord record;
+		std::memcpy( &index, data.data() + offset, sizeof( uint32_t ) );
+		std::memcpy( &numWarps, data.data() + offset + sizeof( uint32_t ), sizeof( uint32_t ) );
+		std::memcpy( &record, data.data() + offset + kEntryPrefix, sizeof( record ) );
+
+		states.resize( numWarps );
+		if( index < numWarps ) {
+			const size_t count = size_t( record.controlsX ) * record.controlsY;
+			if( entry.size != fixed + count * sizeof( vec2 ) + record.residuals )
+				break;
+
+			auto &state = states[index];
+			readWarpBinaryRecord( record, state );
+			state.points.resize( count );
+			std::memcpy( state.points.data(), data.data() + offset + fixed, count * sizeof( vec2 ) );
+
+			// the residual grid follows the control points, an entry without one removes it
+			state.residuals.reset();
+			if( record.residuals > 0 )
+				state.residuals = WarpResidualGrid::readBinary( data.data() + offset + fixed + count * sizeof( vec2 ), record.residuals );
+		}
+
+		offset += entry.size;
+		numReplayed++;
+	}
+
+	if( numReplayed > 0 ) {
+		// apply the recovered states, keeping the warps that did not change
+		WarpList loaded;
+		for( const auto &state : states ) {
+			if( auto warp = Warp::create( state.type ) ) {
+				warp->setState( state );
+				loaded.push_back( warp );
+			}
+		}
+
+		WarpWatcher::apply( warps, loaded );
+	}
+
+	seed( warps );
+
+	// write the recovered warps to the settings file and start a new journal
+	if( numReplayed > 0 ) {
+		std::lock_guard<std::mutex> lock( mMutex );
+		mIsCompactRequested = true;
+	}
+	mCondition.notify_one();
+
+	return numReplayed;
+}
+
+void WarpJournal::update( const WarpList &warps )
+{
+	if( !mIsSeeded ) {
+		seed( warps );
+		return;
+	}
+
+	const double now = mTimer.getSeconds();
+	bool         isChanged = false;
+
+	if( warps.size() != mStates.size() ) {
+		mIsCountChanged = true;
+		isChanged = true;
+
+		const size_t size = mStates.size();
+		mStates.resize( warps.size() );
+		mRevisions.resize( warps.size() );
+		mIsChanged.resize( warps.size(), true );
+		for( size_t i = size; i < warps.size(); ++i ) {
+			mStates[i] = warps[i]->getState();
+			mRevisions[i] = getRevision( warps[i] );
+		}
+	}
+
+	for( size_t i = 0; i < warps.size(); ++i ) {
+		// only copy the state of warps that changed since the previous call
+		const auto revision = getRevision( warps[i] );
+		if( revision == mRevisions[i] )
+			continue;
+		mRevisions[i] = revision;
+
+		auto state = warps[i]->getState();
+		if( state != mStates[i] ) {
+			mStates[i] = std::move( state );
+			mIsChanged[i] = true;
+			isChanged = true;
+		}
+	}
+
+	if( isChanged ) {
+		if( mFirstChange < 0 )
+			mFirstChange = now;
+		mLastChange = now;
+	}
+
+	flush( false );
+}
+
+void WarpJournal::save( const WarpList &warps )
+{
+	update( warps );
+	flush( true );
+
+	std::unique_lock<std::mutex> lock( mMutex );
+	mIsCompactRequested = true;
+	const uint64_t ticket = ++mNumRequested;
+	mCondition.notify_one();
+
+	mCompleted.wait( lock, [&] { return mNumCompleted >= ticket; } );
+}
+
+void WarpJournal::seed( const WarpList &warps )
+{
+	mStates.clear();
+	mRevisions.clear();
+	for( const auto &warp : warps ) {
+		mStates.push_back( warp->getState() );
+		mRevisions.push_back( getRevision( warp ) );
+	}
+
+	mIsChanged.assign( mStates.size(), false );
+	mIsCountChanged = false;
+	mIsSeeded = true;
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	mBaseline = mStates;
+	mHasBaseline = true;
+}
+
+void WarpJournal::flush( bool force )
+{
+	if( mFirstChange < 0 )
+		return;
+
+	// wait until editing has paused, but not indefinitely
+	const double now = mTimer.getSeconds();
+	if( !force && now - mLastChange < mFormat.mDebounce && now - mFirstChange < mFormat.mMaxDelay )
+		return;
+
+	const auto numWarps = uint32_t( mStates.size() );
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( uint32_t i = 0; i < numWarps; ++i ) {
+		if( mIsChanged[i] ) {
+			mQueue.push_back( { i, numWarps, mStates[i] } );
+			mIsChanged[i] = false;
+			mIsCountChanged = false;
+		}
+	}
+
+	// warps were removed, but none changed
+	if( mIsCountChanged ) {
+		mQueue.push_back( { numWarps, numWarps, Warp::State() } );
+		mIsCountChanged = false;
+	}
+
+	mFirstChange = -1;
+	mCondition.notify_one();
+}
+
+void WarpJournal::run()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+
+	for( ;; ) {
+		// wake up regularly to check if it is time to compact
+		mCondition.wait_for( lock, std::chrono::seconds( 1 ), [&] { return !mQueue.empty() || mHasBaseline || mIsCompactRequested || !mIsRunning; } );
+
+		std::deque<Entry> entries;
+		entries.swap( mQueue );
+
+		if( mHasBaseline ) {
+			mSaved.swap( mBaseline );
+			mIsSaved = true;
+			mHasBaseline = false;
+		}
+
+		bool           isCompactRequested = mIsCompactRequested;
+		const uint64_t requested = mNumRequested;
+		const bool     isRunning = mIsRunning;
+		mIsCompactRequested = false;
+
+		// never hold the lock while waiting for the disk
+		lock.unlock();
+
+		if( !entries.empty() )
+			append( entries );
+
+		if( mNumJournaled >= mFormat.mMaxEntries || ( mNumJournaled > 0 && mCompactionTimer.getSeconds() >= mFormat.mCompactInterval ) )
+			isCompactRequested = true;
+
+		if( isCompactRequested )
+			compact();
+
+		lock.lock();
+		mNumCompleted = requested;
+		mCompleted.notify_all();
+
+		if( !isRunning && mQueue.empty() )
+			break;
+	}
+}
+
+void WarpJournal::append( const std::deque<Entry> &entries )
+{
+	if( !mFile && !open( false ) )
+		return;
+
+	std::vector<uint8_t> data;
+	for( const auto &entry : entries ) {
+		// keep track of the states described by the journal, so we can compact it
+		mSaved.resize( entry.numWarps );
+		if( entry.index < entry.numWarps )
+			mSaved[entry.index] = entry.state;
+
+		const size_t numPoints = entry.index < entry.numWarps ? entry.state.points.size() : 0;
+		const auto   residuals = entry.index < entry.numWarps ? entry.state.residuals : WarpResidualGridConstRef();
+		const size_t numResidualBytes = residuals ? residuals->getBinarySize() : 0;
+		const size_t size = kEntryPrefix + sizeof( WarpBinaryRecord ) + numPoints * sizeof( vec2 ) + numResidualBytes;
+
+		const size_t start = data.size();
+		data.resize( start + sizeof( EntryHeader ) + size );
+		uint8_t *body = data.data() + start + sizeof( EntryHeader );
+
+		WarpBinaryRecord record = {};
+		writeWarpBinaryRecord( entry.state, record );
+		record.residuals = uint32_t( numResidualBytes );
+
+		std::memcpy( body, &entry.index, sizeof( uint32_t ) );
+		std::memcpy( body + sizeof( uint32_t ), &entry.numWarps, sizeof( uint32_t ) );
+		std::memcpy( body + kEntryPrefix, &record, sizeof( record ) );
+		if( numPoints > 0 )
+			std::memcpy( body + kEntryPrefix + sizeof( record ), entry.state.points.data(), numPoints * sizeof( vec2 ) );
+		if( residuals )
+			residuals->writeBinary( body + kEntryPrefix + sizeof( record ) + numPoints * sizeof( vec2 ) );
+
+		EntryHeader header = { uint32_t( size ), crc32( body, size ) };
+		std::memcpy( data.data() + start, &header, sizeof( header ) );
+	}
+
+	// a single write per batch, so a crash tears at most the last entry
+	if( std::fwrite( data.data(), 1, data.size(), mFile ) != data.size() )
+		app::console() << "WarpJournal: failed to write " << mJournalPath << std::endl;
+	sync( mFile );
+
+	mNumJournaled += entries.size();
+	mNumEntries += entries.size();
+}
+
+void WarpJournal::compact()
+{
+	if( !mIsSaved )
+		return;
+
+	try {
+		WarpList warps;
+		for( const auto &state : mSaved ) {
+			if( auto warp = Warp::create( state.type ) ) {
+				warp->setState( state );
+				warps.push_back( warp );
+			}
+		}
+
+		// write a temporary file and replace the settings file with it, so a crash leaves either the old or the new file
+		fs::path temporary = mPath;
+		temporary += ".tmp";
+
+		writeSettings( warps, temporary );
+		sync( temporary );
+
+		// the live warps may already be ahead of the file, so a WarpWatcher of the same file must not apply it
+		{
+			std::ifstream     file( temporary, std::ios::binary );
+			const std::string data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+			WarpWatcher::ignoreContent( mPath, data );
+		}
+
+		fs::rename( temporary, mPath );
+#if !defined( CINDER_MSW )
+		// make the rename itself durable
+		const int directory = ::open( mPath.has_parent_path() ? mPath.parent_path().c_str() : ".", O_RDONLY );
+		if( directory >= 0 ) {
+			fsync( directory );
+			::close( directory );
+		}
+#endif
+
+		// the settings file now contains everything in the journal, a crash before the journal is cleared only replays it again
+		open( true );
+
+		mNumJournaled = 0;
+		mNumCompactions++;
+	}
+	catch( const std::exception &exc ) {
+		app::console() << exc.what() << std::endl;
+	}
+
+	mCompactionTimer.start();
+}
+
+void WarpJournal::writeSettings( const WarpList &warps, const fs::path &target ) const
+{
+	// the warps were loaded from the first profile, keep the other profiles if the file was written by WarpConfig
+	XmlTree current;
+	try {
+		if( fs::exists( mPath ) )
+			current = XmlTree( loadFile( mPath ) );
+	}
+	catch( const std::exception & ) {
+		// an unreadable settings file is replaced
+	}
+
+	if( !current.hasChild( "warp-config/profile" ) ) {
+		Warp::writeSettings( warps, writeFile( target ) );
+		return;
+	}
+
+	const auto &config = current.getChild( "warp-config" );
+
+	XmlTree doc;
+	doc.setTag( "warp-config" );
+	for( const auto &attribute : config.getAttributes() )
+		doc.setAttribute( attribute.getName(), attribute.getValue() );
+
+	bool isFirst = true;
+	for( const auto &child : config.getChildren() ) {
+		if( isFirst && child->getTag() == "profile" ) {
+			doc.push_back( Warp::createProfileXml( warps, child->getAttributeValue<std::string>( "name", "default" ) ) );
+			isFirst = false;
+		}
+		else {
+			doc.push_back( *child );
+		}
+	}
+
+	doc.write( writeFile( target ) );
+}
+
+bool WarpJournal::open( bool truncate )
+{
+	if( mFile )
+		std::fclose( mFile );
+
+	mFile = std::fopen( mJournalPath.string().c_str(), truncate ? "wb" : "ab" );
+	if( !mFile ) {
+		app::console() << "WarpJournal: failed to open " << mJournalPath << std::endl;
+		return false;
+	}
+
+	// a new journal starts with a header
+	std::fseek( mFile, 0, SEEK_END );
+	if( std::ftell( mFile ) == 0 ) {
+		JournalHeader header = {};
+		std::memcpy( header.magic, "WARPJNL", 8 );
+		header.version = JournalHeader::kVersion;
+		std::fwrite( &header, sizeof( header ), 1, mFile );
+		sync( mFile );
+	}
+
+	return true;
+}
+
+} // namespace ph::warping
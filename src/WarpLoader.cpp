@@ -0,0 +1,170 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpLoader.h"
+
+#include <cinder/app/App.h>
+
+using namespace ci;
+
+namespace ph::warping {
+
+WarpLoader::WarpLoader( const DataSourceRef &source, const Format &format )
+	: mFormat( format )
+	, mTimer( true )
+	, mData( nullptr )
+	, mSize( 0 )
+	, mNext( 0 )
+	, mNumFinished( 0 )
+	, mIsUploaded( false )
+{
+	// map the file if possible, otherwise read it into memory, then find the maps
+	try {
+		if( source->isFilePath() )
+			mFile = MappedFile::create( source->getFilePath() );
+
+		if( mFile ) {
+			mData = static_cast<const char *>( mFile->getData() );
+			mSize = mFile->getSize();
+		}
+		else {
+			mBuffer = source->getBuffer();
+			mData = static_cast<const char *>( mBuffer->getData() );
+			mSize = mBuffer->getSize();
+		}
+
+		mMaps = WarpXmlReader::findMaps( mData, mSize );
+	}
+	catch( const std::exception &exc ) {
+		app::console() << exc.what() << std::endl;
+		mMaps.clear();
+	}
+
+	mStats.scan = mTimer.getSeconds();
+
+	mResults.resize( mMaps.size() );
+	mErrors.resize( mMaps.size() );
+
+	// no need for more threads than maps
+	size_t numThreads = mFormat.mNumThreads > 0 ? mFormat.mNumThreads : size_t( std::thread::hardware_concurrency() );
+	numThreads = glm::clamp<size_t>( numThreads, 1, glm::max<size_t>( mMaps.size(), 1 ) );
+	mStats.numThreads = numThreads;
+
+	for( size_t i = 0; i < numThreads; ++i )
+		mThreads.emplace_back( &WarpLoader::work, this );
+}
+
+WarpLoader::~WarpLoader()
+{
+	for( auto &thread : mThreads ) {
+		if( thread.joinable() )
+			thread.join();
+	}
+}
+
+void WarpLoader::work()
+{
+	double parse = 0;
+	double prepare = 0;
+	size_t cached = 0;
+
+	for( ;; ) {
+		const size_t i = mNext++;
+		if( i >= mMaps.size() )
+			break;
+
+		try {
+			Timer timer( true );
+
+			auto warp = WarpXmlReader::readMap( mData, mSize, mMaps[i] );
+			parse += timer.getSeconds();
+
+			if( warp ) {
+				// compute the mesh for the size it will be drawn at
+				if( mFormat.mWindowSize.x > 0 && mFormat.mWindowSize.y > 0 )
+					warp->resize( mFormat.mWindowSize );
+				if( mFormat.mContentSize.x > 0 && mFormat.mContentSize.y > 0 )
+					warp->setSize( mFormat.mContentSize );
+
+				// restore the mesh if it is cached, otherwise compute it
+				timer.start();
+				if( mFormat.mMeshCache && mFormat.mMeshCache->load( warp ) )
+					cached++;
+				else
+					warp->prepare();
+				prepare += timer.getSeconds();
+			}
+
+			mResults[i] = warp;
+		}
+		catch( const std::exception &exc ) {
+			mErrors[i] = exc.what();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	mStats.parse += parse;
+	mStats.prepare += prepare;
+	mStats.numCached += cached;
+
+	if( ++mNumFinished == mStats.numThreads )
+		mStats.loaded = mTimer.getSeconds();
+}
+
+const WarpList &WarpLoader::getWarps()
+{
+	if( mIsUploaded )
+		return mWarps;
+
+	for( auto &thread : mThreads )
+		thread.join();
+
+	// only the OpenGL work is left for the render thread
+	Timer timer( true );
+	for( size_t i = 0; i < mResults.size(); ++i ) {
+		if( !mErrors[i].empty() )
+			app::console() << mErrors[i] << std::endl;
+
+		if( mResults[i] ) {
+			mResults[i]->upload();
+			mWarps.push_back( mResults[i] );
+		}
+	}
+
+	mStats.upload = timer.getSeconds();
+	mStats.numWarps = mWarps.size();
+
+	// release the file
+	mResults.clear();
+	mErrors.clear();
+	mFile.reset();
+	mBuffer.reset();
+	mIsUploaded = true;
+
+	return mWarps;
+}
+
+void WarpLoader::markFirstFrame()
+{
+	if( mStats.firstFrame == 0 )
+		mStats.firstFrame = mTimer.getSeconds();
+}
+
+} // namespace ph::warping
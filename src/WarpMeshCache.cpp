@@ -0,0 +1,257 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpMeshCache.h"
+#include "WarpBinary.h"
+
+#include <cinder/app/App.h>
+
+#include <cstring>
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+//! The file starts with a header, followed by an entry for each mesh and then the positions, texture coordinates and indices of all
+//! meshes. All values are little-endian and aligned to 8 bytes.
+struct CacheHeader {
+	//! Increment this whenever WarpBilinear::buildMesh() produces different meshes.
+	static const uint32_t kVersion = 1;
+
+	//! "WARPMSH" followed by a zero.
+	char     magic[8];
+	uint32_t version;
+	uint32_t numMeshes;
+	//! Size of the file in bytes.
+	uint64_t size;
+	//! CRC-32 of everything following the header.
+	uint32_t crc;
+	uint32_t reserved;
+};
+
+struct CacheEntry {
+	uint64_t key;
+	uint32_t resolutionX;
+	uint32_t resolutionY;
+	uint32_t numIndices;
+	uint32_t reserved;
+	//! Offsets in bytes from the start of the file.
+	uint64_t positions;
+	uint64_t texCoords;
+	uint64_t indices;
+};
+
+static_assert( sizeof( CacheHeader ) == 32, "unexpected padding in CacheHeader" );
+static_assert( sizeof( CacheEntry ) == 48, "unexpected padding in CacheEntry" );
+
+size_t align( size_t size )
+{
+	return ( size + 7 ) & ~size_t( 7 );
+}
+
+} // namespace
+
+WarpMeshCache::WarpMeshCache( const fs::path &path )
+	: mCachePath( path )
+	, mNumHits( 0 )
+	, mNumMisses( 0 )
+{
+	mCachePath += ".meshes";
+
+	open();
+}
+
+bool WarpMeshCache::load( const WarpRef &warp )
+{
+	auto bilinear = std::dynamic_pointer_cast<WarpBilinear>( warp );
+	if( !bilinear )
+		return false;
+
+	// the mesh may already be up to date
+	if( bilinear->mMeshRevision == bilinear->mRevision )
+		return true;
+
+	const auto itr = mEntries.find( bilinear->getMeshKey() );
+	if( itr == mEntries.end() ) {
+		mNumMisses++;
+		return false;
+	}
+
+	CacheEntry entry;
+	std::memcpy( &entry, itr->second, sizeof( entry ) );
+
+	const auto   data = static_cast<const uint8_t *>( mFile->getData() );
+	const size_t numVertices = size_t( entry.resolutionX ) * entry.resolutionY;
+
+	auto layout = std::make_shared<WarpMeshLru::Layout>();
+	layout->resolutionX = entry.resolutionX;
+	layout->resolutionY = entry.resolutionY;
+	layout->texCoords.resize( numVertices );
+	layout->indices.resize( entry.numIndices );
+	std::memcpy( layout->texCoords.data(), data + entry.texCoords, numVertices * sizeof( vec2 ) );
+	std::memcpy( layout->indices.data(), data + entry.indices, entry.numIndices * sizeof( uint32_t ) );
+
+	bilinear->mResolutionX = entry.resolutionX;
+	bilinear->mResolutionY = entry.resolutionY;
+	bilinear->mLayout = layout;
+	bilinear->mPositions.resize( numVertices );
+	std::memcpy( bilinear->mPositions.data(), data + entry.positions, numVertices * sizeof( vec2 ) );
+
+	// upload() will create the vertex buffer object from these
+	bilinear->mIsLayoutDirty = true;
+	bilinear->mMeshRevision = bilinear->mRevision;
+
+	mNumHits++;
+	return true;
+}
+
+size_t WarpMeshCache::load( const WarpList &warps )
+{
+	size_t found = 0;
+	for( const auto &warp : warps ) {
+		if( load( warp ) )
+			found++;
+	}
+
+	return found;
+}
+
+void WarpMeshCache::save( const WarpList &warps )
+{
+	static_assert( sizeof( vec2 ) == 2 * sizeof( float ), "positions and texture coordinates are written as pairs of floats" );
+
+	std::vector<WarpBilinearRef> meshes;
+	for( const auto &warp : warps ) {
+		if( auto bilinear = std::dynamic_pointer_cast<WarpBilinear>( warp ) ) {
+			if( bilinear->mMeshRevision != bilinear->mRevision )
+				bilinear->buildMesh();
+
+			meshes.push_back( bilinear );
+		}
+	}
+
+	size_t size = sizeof( CacheHeader ) + meshes.size() * sizeof( CacheEntry );
+	for( const auto &mesh : meshes ) {
+		size += align( mesh->mPositions.size() * sizeof( vec2 ) );
+		size += align( mesh->mLayout->texCoords.size() * sizeof( vec2 ) );
+		size += align( mesh->mLayout->indices.size() * sizeof( uint32_t ) );
+	}
+
+	// build the file in memory
+	std::vector<uint64_t> storage( size / 8 );
+	auto                  bytes = reinterpret_cast<uint8_t *>( storage.data() );
+
+	auto header = reinterpret_cast<CacheHeader *>( bytes );
+	std::memcpy( header->magic, "WARPMSH", 8 );
+	header->version = CacheHeader::kVersion;
+	header->numMeshes = uint32_t( meshes.size() );
+	header->size = size;
+
+	auto   entries = reinterpret_cast<CacheEntry *>( bytes + sizeof( CacheHeader ) );
+	size_t offset = sizeof( CacheHeader ) + meshes.size() * sizeof( CacheEntry );
+	for( size_t i = 0; i < meshes.size(); ++i ) {
+		const auto &mesh = meshes[i];
+		auto &      entry = entries[i];
+
+		entry.key = mesh->getMeshKey();
+		entry.resolutionX = uint32_t( mesh->mResolutionX );
+		entry.resolutionY = uint32_t( mesh->mResolutionY );
+		entry.numIndices = uint32_t( mesh->mLayout->indices.size() );
+
+		entry.positions = offset;
+		std::memcpy( bytes + offset, mesh->mPositions.data(), mesh->mPositions.size() * sizeof( vec2 ) );
+		offset += align( mesh->mPositions.size() * sizeof( vec2 ) );
+
+		entry.texCoords = offset;
+		std::memcpy( bytes + offset, mesh->mLayout->texCoords.data(), mesh->mLayout->texCoords.size() * sizeof( vec2 ) );
+		offset += align( mesh->mLayout->texCoords.size() * sizeof( vec2 ) );
+
+		entry.indices = offset;
+		std::memcpy( bytes + offset, mesh->mLayout->indices.data(), mesh->mLayout->indices.size() * sizeof( uint32_t ) );
+		offset += align( mesh->mLayout->indices.size() * sizeof( uint32_t ) );
+	}
+
+	header->crc = crc32( bytes + sizeof( CacheHeader ), size - sizeof( CacheHeader ) );
+
+	// release the old file before replacing it, which Windows does not allow while it is mapped
+	mEntries.clear();
+	mFile.reset();
+
+	try {
+		fs::path temporary = mCachePath;
+		temporary += ".tmp";
+
+		writeFile( temporary )->getStream()->writeData( bytes, size );
+		fs::rename( temporary, mCachePath );
+	}
+	catch( const std::exception &exc ) {
+		app::console() << exc.what() << std::endl;
+	}
+
+	open();
+}
+
+void WarpMeshCache::open()
+{
+	mEntries.clear();
+	mFile = MappedFile::create( mCachePath );
+	if( !mFile )
+		return;
+
+	const auto   data = static_cast<const uint8_t *>( mFile->getData() );
+	const size_t size = mFile->getSize();
+
+	// check the header and checksum, the cache is simply rebuilt if it is invalid
+	CacheHeader header;
+	if( size < sizeof( header ) )
+		return;
+
+	std::memcpy( &header, data, sizeof( header ) );
+	if( std::memcmp( header.magic, "WARPMSH", 8 ) != 0 || header.version != CacheHeader::kVersion || header.size != size )
+		return;
+	if( uint64_t( header.numMeshes ) * sizeof( CacheEntry ) > size - sizeof( header ) )
+		return;
+	if( crc32( data + sizeof( header ), size - sizeof( header ) ) != header.crc )
+		return;
+
+	// make sure all arrays are inside the file
+	auto inside = [&]( uint64_t offset, uint64_t length ) { return offset <= size && length <= size - offset; };
+
+	for( uint32_t i = 0; i < header.numMeshes; ++i ) {
+		const uint8_t *ptr = data + sizeof( header ) + i * sizeof( CacheEntry );
+
+		CacheEntry entry;
+		std::memcpy( &entry, ptr, sizeof( entry ) );
+
+		const uint64_t numVertices = uint64_t( entry.resolutionX ) * entry.resolutionY;
+		if( entry.resolutionX > 0xFFFF || entry.resolutionY > 0xFFFF )
+			continue;
+		if( !inside( entry.positions, numVertices * sizeof( vec2 ) ) || !inside( entry.texCoords, numVertices * sizeof( vec2 ) ) )
+			continue;
+		if( !inside( entry.indices, uint64_t( entry.numIndices ) * sizeof( uint32_t ) ) )
+			continue;
+
+		mEntries[entry.key] = ptr;
+	}
+}
+
+} // namespace ph::warping
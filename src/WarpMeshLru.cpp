@@ -0,0 +1,172 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpMeshLru.h"
+
+using namespace ci;
+
+namespace ph::warping {
+
+WarpMeshLru::MeshRef WarpMeshLru::find( uint64_t key )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	const auto itr = mMap.find( key );
+	if( itr == mMap.end() ) {
+		mNumMisses++;
+		return MeshRef();
+	}
+
+	// move to the front of the list
+	mList.splice( mList.begin(), mList, itr->second );
+	mNumHits++;
+
+	return itr->second->second;
+}
+
+void WarpMeshLru::insert( uint64_t key, const MeshRef &mesh )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	const size_t size = getSize( *mesh );
+	if( size > mCapacity )
+		return;
+
+	const auto itr = mMap.find( key );
+	if( itr != mMap.end() ) {
+		mSize -= getSize( *itr->second->second );
+		mList.erase( itr->second );
+	}
+
+	mList.emplace_front( key, mesh );
+	mMap[key] = mList.begin();
+	mSize += size;
+
+	trim();
+}
+
+void WarpMeshLru::clear()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	mList.clear();
+	mMap.clear();
+	mSize = 0;
+}
+
+WarpMeshLru::LayoutRef WarpMeshLru::getLayout( size_t resolutionX, size_t resolutionY )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	auto &entry = mLayouts[{ resolutionX, resolutionY }];
+	if( auto layout = entry.lock() )
+		return layout;
+
+	// forget the layouts that are no longer in use
+	for( auto itr = mLayouts.begin(); itr != mLayouts.end(); ) {
+		if( itr->second.expired() && &itr->second != &entry )
+			itr = mLayouts.erase( itr );
+		else
+			++itr;
+	}
+
+	auto layout = std::make_shared<Layout>();
+	layout->resolutionX = resolutionX;
+	layout->resolutionY = resolutionY;
+	layout->texCoords.resize( resolutionX * resolutionY );
+	if( resolutionX > 1 && resolutionY > 1 )
+		layout->indices.reserve( 6 * ( resolutionX - 1 ) * ( resolutionY - 1 ) );
+
+	size_t j = 0;
+	for( size_t x = 0; x < resolutionX; ++x ) {
+		for( size_t y = 0; y < resolutionY; ++y ) {
+			// index
+			if( x + 1 < resolutionX && y + 1 < resolutionY ) {
+				layout->indices.push_back( uint32_t( ( x + 0 ) * resolutionY + ( y + 0 ) ) );
+				layout->indices.push_back( uint32_t( ( x + 1 ) * resolutionY + ( y + 0 ) ) );
+				layout->indices.push_back( uint32_t( ( x + 1 ) * resolutionY + ( y + 1 ) ) );
+
+				layout->indices.push_back( uint32_t( ( x + 0 ) * resolutionY + ( y + 0 ) ) );
+				layout->indices.push_back( uint32_t( ( x + 1 ) * resolutionY + ( y + 1 ) ) );
+				layout->indices.push_back( uint32_t( ( x + 0 ) * resolutionY + ( y + 1 ) ) );
+			}
+			// texCoords
+			const float tx = x / float( resolutionX - 1 );
+			const float ty = y / float( resolutionY - 1 );
+			layout->texCoords[j++] = vec2( tx, ty );
+		}
+	}
+
+	entry = layout;
+
+	return layout;
+}
+
+void WarpMeshLru::setCapacity( size_t capacity )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	mCapacity = capacity;
+	trim();
+}
+
+size_t WarpMeshLru::getSize() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mSize;
+}
+
+size_t WarpMeshLru::getNumMeshes() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mList.size();
+}
+
+double WarpMeshLru::getHitRate() const
+{
+	const uint64_t hits = mNumHits;
+	const uint64_t lookups = hits + mNumMisses;
+
+	return lookups > 0 ? double( hits ) / double( lookups ) : 0.0;
+}
+
+void WarpMeshLru::resetStats()
+{
+	mNumHits = 0;
+	mNumMisses = 0;
+}
+
+size_t WarpMeshLru::getSize( const Mesh &mesh )
+{
+	// the layout is shared with other meshes and warps
+	return sizeof( Mesh ) + mesh.positions.size() * sizeof( vec2 );
+}
+
+void WarpMeshLru::trim()
+{
+	while( mSize > mCapacity && !mList.empty() ) {
+		const auto &back = mList.back();
+		mSize -= getSize( *back.second );
+		mMap.erase( back.first );
+		mList.pop_back();
+	}
+}
+
+} // namespace ph::warping
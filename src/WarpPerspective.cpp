@@ -77,6 +77,23 @@ mat4 WarpPerspective::getTransform()
 	return mTransform;
 }
 
+void WarpPerspective::setState( const State &state )
+{
+	if( state.controlsX != 2 || state.controlsY != 2 )
+		return;
+
+	Warp::setState( state );
+}
+
+void WarpPerspective::setContext( const WarpContextRef &context )
+{
+	Warp::setContext( context );
+
+	mShader2D.reset();
+	mShader2DRect.reset();
+	mShader2DYuv.reset();
+}
+
 void WarpPerspective::reset()
 {
 	mPoints.clear();
@@ -85,11 +102,13 @@ void WarpPerspective::reset()
 	mPoints.emplace_back( 1.0f, 1.0f );
 	mPoints.emplace_back( 0.0f, 1.0f );
 
-	mIsDirty = true;
+	invalidate();
 }
 
 void WarpPerspective::draw( const gl::Texture2dRef &texture, const Area &srcArea, const Rectf &destRect )
 {
+	applyPublishedState();
+
 	if( !texture )
 		return;
 
@@ -98,6 +117,91 @@ void WarpPerspective::draw( const gl::Texture2dRef &texture, const Area &srcArea
 	Rectf rect = destRect;
 	clip( area, rect );
 
+	// create shader if necessary
+	createShader();
+
+	auto &shader = texture->getTarget() == GL_TEXTURE_RECTANGLE ? mShader2DRect : mShader2D;
+	if( !shader )
+		return;
+
+	// draw texture
+	const auto coords = texture->getAreaTexCoords( srcArea );
+
+	gl::ScopedTextureBind scpTex0( texture );
+	drawContent( shader, [&]() {
+		shader->uniform( "uCoords", vec4( coords.x1, coords.y1, coords.x2 - coords.x1, coords.y2 - coords.y1 ) );
+		gl::drawSolidRect( rect, vec2( 0 ), vec2( 1 ) );
+	} );
+}
+
+void WarpPerspective::draw( const gl::Texture2dRef &luma, const gl::Texture2dRef &chroma, const Area &srcArea, const Rectf &destRect )
+{
+	applyPublishedState();
+
+	if( !luma || !chroma )
+		return;
+
+	// clip against bounds
+	Area  area = srcArea;
+	Rectf rect = destRect;
+	clip( area, rect );
+
+	// create shader if necessary
+	createShader();
+	if( !mShader2DYuv )
+		return;
+
+	// draw texture, the chroma plane uses the same normalized coordinates
+	const auto coords = luma->getAreaTexCoords( srcArea );
+
+	gl::ScopedTextureBind scpTex0( luma, 0 );
+	gl::ScopedTextureBind scpTex1( chroma, 1 );
+	drawContent( mShader2DYuv, [&]() {
+		mShader2DYuv->uniform( "uTex1", 1 );
+		mShader2DYuv->uniform( "uCoords", vec4( coords.x1, coords.y1, coords.x2 - coords.x1, coords.y2 - coords.y1 ) );
+		setYuvUniforms( mShader2DYuv );
+
+		gl::drawSolidRect( rect, vec2( 0 ), vec2( 1 ) );
+	} );
+}
+
+void WarpPerspective::draw( const WarpCanvasRef &canvas, const Area &srcArea )
+{
+	applyPublishedState();
+
+	if( !canvas )
+		return;
+
+	// make sure the tiles we need will be rendered
+	canvas->reference( srcArea );
+
+	// create shader if necessary
+	createShader();
+	if( !mShader2D )
+		return;
+
+	drawContent( mShader2D, [&]() {
+		// draw the part of the content covered by each tile
+		for( const auto index : canvas->getTiles( srcArea ) ) {
+			const auto texture = canvas->getTexture( index );
+			if( !texture )
+				continue;
+
+			vec4 clip, coords;
+			if( !canvas->getTileCoords( index, srcArea, &clip, &coords ) )
+				continue;
+
+			gl::ScopedTextureBind scpTex0( texture );
+			mShader2D->uniform( "uCoords", coords );
+
+			const Rectf rect( clip.x * mWidth, clip.y * mHeight, clip.z * mWidth, clip.w * mHeight );
+			gl::drawSolidRect( rect, vec2( clip.x, clip.y ), vec2( clip.z, clip.w ) );
+		}
+	} );
+}
+
+void WarpPerspective::drawContent( const gl::GlslProgRef &shader, const std::function<void()> &drawFn )
+{
 	// save current drawing color
 	const ColorA &  currentColor = gl::context()->getCurrentColor();
 	gl::ScopedColor scpColor( currentColor );
@@ -110,29 +214,19 @@ void WarpPerspective::draw( const gl::Texture2dRef &texture, const Area &srcArea
 		gl::color( drawColor );
 	}
 
-	// create shader if necessary
-	createShader();
-
-	auto &shader = texture->getTarget() == GL_TEXTURE_RECTANGLE ? mShader2DRect : mShader2D;
-
-	// draw texture
-	const auto coords = texture->getAreaTexCoords( srcArea );
-
 	gl::pushModelMatrix();
 	gl::multModelMatrix( getTransform() );
 
-	gl::ScopedTextureBind scpTex0( texture );
-	gl::ScopedGlslProg    scpGlsl( shader );
+	gl::ScopedGlslProg scpGlsl( shader );
 	shader->uniform( "uTex0", 0 );
-	shader->uniform( "uCoords", vec4( coords.x1, coords.y1, coords.x2 - coords.x1, coords.y2 - coords.y1 ) );
 	shader->uniform( "uLuminance", mLuminance );
 	shader->uniform( "uGamma", mGamma );
 	shader->uniform( "uEdges", mEdges );
 	shader->uniform( "uExponent", mExponent );
-	shader->uniform( "uEditMode", isEditModeEnabled() );
-	shader->uniform( "uGammaMode", isEditModeEnabled() && isGammaModeEnabled() && mSelected < mPoints.size() );
+	shader->uniform( "uEditMode", mContext->isEditModeEnabled() );
+	shader->uniform( "uGammaMode", mContext->isEditModeEnabled() && mContext->isGammaModeEnabled() && mSelected < mPoints.size() );
 
-	gl::drawSolidRect( rect, vec2( 0 ), vec2( 1 ) );
+	drawFn();
 
 	gl::popModelMatrix();
 
@@ -142,6 +236,9 @@ void WarpPerspective::draw( const gl::Texture2dRef &texture, const Area &srcArea
 
 void WarpPerspective::begin()
 {
+	applyPublishedState();
+	mIsInFrame = true;
+
 	gl::pushModelMatrix();
 	gl::multModelMatrix( getTransform() );
 }
@@ -153,12 +250,14 @@ void WarpPerspective::end()
 
 	// draw interface
 	draw();
+
+	mIsInFrame = false;
 }
 
 void WarpPerspective::draw( bool controls )
 {
 	// only draw grid while editing
-	if( isEditModeEnabled() ) {
+	if( mContext->isEditModeEnabled() ) {
 		gl::pushModelMatrix();
 		gl::multModelMatrix( getTransform() );
 
@@ -196,7 +295,7 @@ void WarpPerspective::keyDown( KeyEvent &event )
 		return;
 
 	// disable keyboard input when not in edit mode
-	if( !isEditModeEnabled() )
+	if( !mContext->isEditModeEnabled() )
 		return;
 
 	// do not listen to key input if not selected
@@ -210,7 +309,7 @@ void WarpPerspective::keyDown( KeyEvent &event )
 		std::swap( mPoints[0], mPoints[1] );
 		std::swap( mPoints[3], mPoints[0] );
 		mSelected = ( mSelected + 1 ) % 4;
-		mIsDirty = true;
+		invalidate();
 		break;
 	case KeyEvent::KEY_F10:
 		// rotate content cw
@@ -218,7 +317,7 @@ void WarpPerspective::keyDown( KeyEvent &event )
 		std::swap( mPoints[0], mPoints[1] );
 		std::swap( mPoints[1], mPoints[2] );
 		mSelected = ( mSelected + 3 ) % 4;
-		mIsDirty = true;
+		invalidate();
 		break;
 	case KeyEvent::KEY_F11:
 		// flip content horizontally
@@ -228,14 +327,14 @@ void WarpPerspective::keyDown( KeyEvent &event )
 			mSelected--;
 		else
 			mSelected++;
-		mIsDirty = true;
+		invalidate();
 		break;
 	case KeyEvent::KEY_F12:
 		// flip content vertically
 		std::swap( mPoints[0], mPoints[3] );
 		std::swap( mPoints[1], mPoints[2] );
 		mSelected = ( unsigned( mPoints.size() ) - 1 ) - mSelected;
-		mIsDirty = true;
+		invalidate();
 		break;
 	default:
 		return;
@@ -314,6 +413,7 @@ void WarpPerspective::gaussianElimination( float *input, int n ) const
 
 void WarpPerspective::createShader()
 {
+	// the NV12 shader is optional, and shaders that failed to compile are not compiled again
 	if( mShader2D && mShader2DRect )
 		return;
 
@@ -400,78 +500,80 @@ void WarpPerspective::createShader()
 		"   }\n"
 		"}" );
 
-	try {
-		mShader2DRect = gl::GlslProg::create( fmt );
-	}
-	catch( const std::exception &e ) {
-		console() << e.what() << std::endl;
-	}
-
-	fmt.fragment(
-		"#version 150\n"
-		""
-		"uniform sampler2D uTex0;\n"
-		"uniform vec3 uLuminance;\n"
-		"uniform vec3 uGamma;\n"
-		"uniform vec4  uEdges;\n"
-		"uniform float uExponent;\n"
-		"uniform bool  uEditMode;\n"
-		"uniform bool  uGammaMode;\n"
-		""
-		"in vec2 vertTexCoord0;\n"
-		"in vec2 vertTexCoord1;\n"
-		"in vec4 vertColor;\n"
-		""
-		"out vec4 fragColor;\n"
-		""
-		"void main( void ) {\n"
-		"   fragColor.a = 1.0;\n"
-		""
-		"   if( uGammaMode ) {\n"
-		"       float b = mod( floor( gl_FragCoord.x / 64.0 ) + floor( gl_FragCoord.y / 64.0 ), 2.0 );\n"
-		"       float r = mod( gl_FragCoord.x + gl_FragCoord.y, 2.0 );\n"
-		"       int c = int( mod( floor( gl_FragCoord.x / 128.0 ) + 2 * floor( gl_FragCoord.y / 128.0 ), 4.0 ) );\n"
-		"       vec3 clr;\n"
-		"       if( c < 3.0 ) clr[c] = 1.0;\n"
-		"       else clr = vec3( 1 );\n"
-		"	    const vec3 one = vec3( 1.0 );\n"
-		"       fragColor.rgb = pow( mix( 0.5 * clr, r * clr, b ), one / uGamma );\n"
-		"   }\n"
-		"   else {\n"
-		"	    fragColor.rgb = texture( uTex0, vertTexCoord1 ).rgb;\n"
-		""
-		// Edge blending.
-		"       float a = 1.0;\n"
-		"       if( uEdges.x > 0.0 ) a *= clamp( vertTexCoord0.x / uEdges.x, 0.0, 1.0 );\n"
-		"       if( uEdges.y > 0.0 ) a *= clamp( vertTexCoord0.y / uEdges.y, 0.0, 1.0 );\n"
-		"       if( uEdges.z < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.x ) / ( 1.0 - uEdges.z ), 0.0, 1.0 );\n"
-		"       if( uEdges.w < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.y ) / ( 1.0 - uEdges.w ), 0.0, 1.0 );\n"
-		""
-		"        const vec3 one = vec3( 1.0 );\n"
-		"        vec3 blend = ( a < 0.5 ) ? ( uLuminance * pow( 2.0 * a, uExponent ) ) : one - ( one - uLuminance ) * pow( 2.0 * ( 1.0 - a ), uExponent );\n"
-		""
-		"       fragColor.rgb *= clamp( pow( blend, one / uGamma ), 0.0, 1.0 );\n"
-		"   }\n"
-		""
-		// Draw edge blending limits.
-		"	if( uEditMode ) {\n"
-		"       const vec4 kEdgeColor = vec4( 0, 1, 1, 1 );\n"
-		"       vec4 edges = abs( vertTexCoord0.xyxy - uEdges );\n"
-		"       vec4 w = 0.5 * fwidth( edges );\n"
-		"       float e = step( edges.x, w.x );\n"
-		"       e += step( edges.y, w.y );\n"
-		"       e += step( edges.z, w.z );\n"
-		"       e += step( edges.w, w.w );\n"
-		"       fragColor = mix( fragColor, kEdgeColor, e );\n"
-		"   }\n"
-		"}" );
+	mShader2DRect = mContext->getShader( "WarpPerspective2DRect", fmt );
+
+	// the 2D and NV12 shaders only differ in their samplers and in how they sample the content
+	const auto fragment2D = []( const std::string &samplers, const std::string &sample ) {
+		return "#version 150\n"
+		       ""
+		       + samplers +
+		       "uniform vec3 uLuminance;\n"
+		       "uniform vec3 uGamma;\n"
+		       "uniform vec4  uEdges;\n"
+		       "uniform float uExponent;\n"
+		       "uniform bool  uEditMode;\n"
+		       "uniform bool  uGammaMode;\n"
+		       ""
+		       "in vec2 vertTexCoord0;\n"
+		       "in vec2 vertTexCoord1;\n"
+		       "in vec4 vertColor;\n"
+		       ""
+		       "out vec4 fragColor;\n"
+		       ""
+		       "void main( void ) {\n"
+		       "   fragColor.a = 1.0;\n"
+		       ""
+		       "   if( uGammaMode ) {\n"
+		       "       float b = mod( floor( gl_FragCoord.x / 64.0 ) + floor( gl_FragCoord.y / 64.0 ), 2.0 );\n"
+		       "       float r = mod( gl_FragCoord.x + gl_FragCoord.y, 2.0 );\n"
+		       "       int c = int( mod( floor( gl_FragCoord.x / 128.0 ) + 2 * floor( gl_FragCoord.y / 128.0 ), 4.0 ) );\n"
+		       "       vec3 clr;\n"
+		       "       if( c < 3.0 ) clr[c] = 1.0;\n"
+		       "       else clr = vec3( 1 );\n"
+		       "	    const vec3 one = vec3( 1.0 );\n"
+		       "       fragColor.rgb = pow( mix( 0.5 * clr, r * clr, b ), one / uGamma );\n"
+		       "   }\n"
+		       "   else {\n"
+		       + sample +
+		       ""
+		       // Edge blending.
+		       "       float a = 1.0;\n"
+		       "       if( uEdges.x > 0.0 ) a *= clamp( vertTexCoord0.x / uEdges.x, 0.0, 1.0 );\n"
+		       "       if( uEdges.y > 0.0 ) a *= clamp( vertTexCoord0.y / uEdges.y, 0.0, 1.0 );\n"
+		       "       if( uEdges.z < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.x ) / ( 1.0 - uEdges.z ), 0.0, 1.0 );\n"
+		       "       if( uEdges.w < 1.0 ) a *= clamp( ( 1.0 - vertTexCoord0.y ) / ( 1.0 - uEdges.w ), 0.0, 1.0 );\n"
+		       ""
+		       "        const vec3 one = vec3( 1.0 );\n"
+		       "        vec3 blend = ( a < 0.5 ) ? ( uLuminance * pow( 2.0 * a, uExponent ) ) : one - ( one - uLuminance ) * pow( 2.0 * ( 1.0 - a ), uExponent );\n"
+		       ""
+		       "       fragColor.rgb *= clamp( pow( blend, one / uGamma ), 0.0, 1.0 );\n"
+		       "   }\n"
+		       ""
+		       // Draw edge blending limits.
+		       "	if( uEditMode ) {\n"
+		       "       const vec4 kEdgeColor = vec4( 0, 1, 1, 1 );\n"
+		       "       vec4 edges = abs( vertTexCoord0.xyxy - uEdges );\n"
+		       "       vec4 w = 0.5 * fwidth( edges );\n"
+		       "       float e = step( edges.x, w.x );\n"
+		       "       e += step( edges.y, w.y );\n"
+		       "       e += step( edges.z, w.z );\n"
+		       "       e += step( edges.w, w.w );\n"
+		       "       fragColor = mix( fragColor, kEdgeColor, e );\n"
+		       "   }\n"
+		       "}";
+	};
 
-	try {
-		mShader2D = gl::GlslProg::create( fmt );
-	}
-	catch( const std::exception &e ) {
-		console() << e.what() << std::endl;
-	}
+	fmt.fragment( fragment2D( "uniform sampler2D uTex0;\n", "\t    fragColor.rgb = texture( uTex0, vertTexCoord1 ).rgb;\n" ) );
+	mShader2D = mContext->getShader( "WarpPerspective2D", fmt );
+
+	// NV12: luma in the red channel of uTex0, interleaved chroma in red and green of uTex1
+	fmt.fragment( fragment2D( "uniform sampler2D uTex0;\n"
+	                          "uniform sampler2D uTex1;\n"
+	                          "uniform mat3      uYuvMatrix;\n"
+	                          "uniform vec3      uYuvOffset;\n",
+	    "\t    vec3 yuv = vec3( texture( uTex0, vertTexCoord1 ).r, texture( uTex1, vertTexCoord1 ).rg );\n"
+	    "\t    fragColor.rgb = clamp( uYuvMatrix * ( yuv - uYuvOffset ), 0.0, 1.0 );\n" ) );
+	mShader2DYuv = mContext->getShader( "WarpPerspective2DYuv", fmt );
 }
 
 } // namespace ph::warping
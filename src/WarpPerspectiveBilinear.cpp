@@ -48,8 +48,8 @@ XmlTree WarpPerspectiveBilinear::toXml() const
 
 		XmlTree cp;
 		cp.setTag( "corner" );
-		cp.setAttribute( "x", corner.x );
-		cp.setAttribute( "y", corner.y );
+		cp.setAttribute( "x", formatFloat( corner.x ) );
+		cp.setAttribute( "y", formatFloat( corner.y ) );
 
 		xml.push_back( cp );
 	}
@@ -73,8 +73,43 @@ void WarpPerspectiveBilinear::fromXml( const XmlTree &xml )
 	}
 }
 
+Warp::State WarpPerspectiveBilinear::getState() const
+{
+	auto state = WarpBilinear::getState();
+	for( unsigned i = 0; i < 4; ++i )
+		state.corners.push_back( mWarp->getControlPoint( i ) );
+
+	return state;
+}
+
+void WarpPerspectiveBilinear::setState( const State &state )
+{
+	if( state.type != mType )
+		return;
+
+	// perspective: only update the corners if they changed
+	if( state.corners.size() == 4 ) {
+		bool changed = false;
+		for( unsigned i = 0; i < 4; ++i )
+			changed |= state.corners[i] != mWarp->getControlPoint( i );
+
+		if( changed )
+			mWarp->setControlPoints( state.corners );
+	}
+
+	WarpBilinear::setState( state );
+}
+
+void WarpPerspectiveBilinear::setContext( const WarpContextRef &context )
+{
+	WarpBilinear::setContext( context );
+	mWarp->setContext( context );
+}
+
 void WarpPerspectiveBilinear::draw( bool controls )
 {
+	applyPublishedState();
+
 	// apply perspective transform
 	gl::pushModelMatrix();
 	gl::multModelMatrix( mWarp->getTransform() );
@@ -86,7 +121,7 @@ void WarpPerspectiveBilinear::draw( bool controls )
 	gl::popModelMatrix();
 
 	// draw edit interface
-	if( isEditModeEnabled() ) {
+	if( mContext->isEditModeEnabled() ) {
 		if( controls && mSelected < mPoints.size() ) {
 			// draw control points
 			for( unsigned i = 0; i < mPoints.size(); ++i )
@@ -105,7 +140,7 @@ void WarpPerspectiveBilinear::mouseMove( MouseEvent &event )
 
 void WarpPerspectiveBilinear::mouseDown( MouseEvent &event )
 {
-	if( !isEditModeEnabled() )
+	if( !mContext->isEditModeEnabled() )
 		return;
 	if( mSelected >= mPoints.size() )
 		return;
@@ -121,7 +156,7 @@ void WarpPerspectiveBilinear::mouseDown( MouseEvent &event )
 
 void WarpPerspectiveBilinear::mouseDrag( MouseEvent &event )
 {
-	if( !isEditModeEnabled() )
+	if( !mContext->isEditModeEnabled() )
 		return;
 	if( mSelected >= mPoints.size() )
 		return;
@@ -137,7 +172,7 @@ void WarpPerspectiveBilinear::mouseDrag( MouseEvent &event )
 
 void WarpPerspectiveBilinear::keyDown( KeyEvent &event )
 {
-	if( !isEditModeEnabled() )
+	if( !mContext->isEditModeEnabled() )
 		return;
 	if( mSelected >= mPoints.size() )
 		return;
@@ -147,11 +182,8 @@ void WarpPerspectiveBilinear::keyDown( KeyEvent &event )
 	case KeyEvent::KEY_DOWN:
 	case KeyEvent::KEY_LEFT:
 	case KeyEvent::KEY_RIGHT:
-		// make sure cursor keys are handled by 1 warp only
-		if( !isCorner( mSelected ) )
-			mWarp->keyDown( event );
-		if( !event.isHandled() )
-			WarpBilinear::keyDown( event );
+		if( nudgeControlPoint( getNudge( event ) ) )
+			event.setHandled( true );
 		break;
 	case KeyEvent::KEY_F9:
 	case KeyEvent::KEY_F10:
@@ -171,14 +203,28 @@ void WarpPerspectiveBilinear::keyDown( KeyEvent &event )
 	}
 }
 
+bool WarpPerspectiveBilinear::nudgeControlPoint( const vec2 &pixels )
+{
+	// make sure cursor keys are handled by 1 warp only
+	if( !isCorner( mSelected ) && mWarp->nudgeControlPoint( pixels ) )
+		return true;
+
+	return WarpBilinear::nudgeControlPoint( pixels );
+}
+
 void WarpPerspectiveBilinear::resize()
+{
+	resize( getWindowSize() );
+}
+
+void WarpPerspectiveBilinear::resize( const ivec2 &size )
 {
 	// make content size compatible with WarpBilinear's mWindowSize
-	mWarp->setSize( getWindowSize() );
+	mWarp->setSize( vec2( size ) );
 
 	//
-	mWarp->resize();
-	WarpBilinear::resize();
+	mWarp->resize( size );
+	WarpBilinear::resize( size );
 }
 
 bool WarpPerspectiveBilinear::setSize( float w, float h )
@@ -245,6 +291,79 @@ void WarpPerspectiveBilinear::moveControlPoint( unsigned index, const vec2 &shif
 	}
 }
 
+void WarpPerspectiveBilinear::setControlPoints( const vec2 *points, size_t count )
+{
+	count = glm::min( count, mPoints.size() );
+	if( count == 0 )
+		return;
+
+	// perspective: set the corners first, so the other points are converted using the new transform
+	vec2 corners[4];
+	for( unsigned i = 0; i < 4; ++i )
+		corners[i] = mWarp->getControlPoint( i );
+	for( unsigned i = 0; i < unsigned( count ); ++i ) {
+		if( isCorner( i ) )
+			corners[convertIndex( i )] = points[i];
+	}
+
+	mWarp->setControlPoints( corners, 4 );
+	mWarp->getTransform();
+
+	// bilinear: transform control points from normalized screen space to warped space
+	const mat4 inverted = mWarp->getInvertedTransform();
+	const vec2 size( mWarp->getSize() );
+	for( unsigned i = 0; i < unsigned( count ); ++i ) {
+		if( isCorner( i ) )
+			continue;
+
+		const vec2 p = points[i] * mWindowSize;
+		vec4       pt = inverted * vec4( p.x, p.y, 0, 1 );
+
+		if( pt.w != 0 )
+			pt.w = 1 / pt.w;
+		pt *= pt.w;
+
+		mPoints[i] = vec2( pt.x, pt.y ) / size;
+	}
+
+	invalidate();
+}
+
+void WarpPerspectiveBilinear::transformControlPoints( const mat3 &transform )
+{
+	std::vector<vec2> points( mPoints.size() );
+
+	// bilinear: transform control points from warped space to normalized screen space
+	const mat4 forward = mWarp->getTransform();
+	const vec2 size( mWarp->getSize() );
+	for( unsigned i = 0; i < unsigned( points.size() ); ++i ) {
+		if( isCorner( i ) ) {
+			points[i] = mWarp->getControlPoint( convertIndex( i ) );
+			continue;
+		}
+
+		const vec2 p = mPoints[i] * size;
+		vec4       pt = forward * vec4( p.x, p.y, 0, 1 );
+
+		if( pt.w != 0 )
+			pt.w = 1 / pt.w;
+		pt *= pt.w;
+
+		points[i] = vec2( pt.x, pt.y ) / mWindowSize;
+	}
+
+	for( auto &pt : points ) {
+		vec3 p = transform * vec3( pt, 1 );
+
+		if( p.z != 0 )
+			p.z = 1 / p.z;
+
+		pt = vec2( p.x, p.y ) * p.z;
+	}
+
+	setControlPoints( points.data(), points.size() );
+}
+
 void WarpPerspectiveBilinear::selectControlPoint( unsigned index )
 {
 	// depending on index, select perspective or bilinear control point
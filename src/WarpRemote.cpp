@@ -0,0 +1,277 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpRemote.h"
+
+#if !defined( CINDER_MSW )
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace ci;
+
+namespace ph::warping {
+
+static_assert( offsetof( warp_remote_ring, head ) % 64 == 0, "the head of the ring must start a cache line" );
+
+namespace {
+
+//! Returns the process id of the application that owns an existing endpoint, or 0 if it can't be read.
+pid_t getOwner( const char *shm )
+{
+	const int fd = shm_open( shm, O_RDONLY, 0 );
+	if( fd < 0 )
+		return 0;
+
+	pid_t       owner = 0;
+	struct stat st;
+	if( fstat( fd, &st ) == 0 && st.st_size >= off_t( sizeof( warp_remote_ring ) ) ) {
+		void *ptr = mmap( nullptr, sizeof( warp_remote_ring ), PROT_READ, MAP_SHARED, fd, 0 );
+		if( ptr != MAP_FAILED ) {
+			owner = pid_t( __atomic_load_n( &static_cast<const warp_remote_ring *>( ptr )->owner, __ATOMIC_ACQUIRE ) );
+			munmap( ptr, sizeof( warp_remote_ring ) );
+		}
+	}
+	close( fd );
+
+	return owner;
+}
+
+//! Returns \c TRUE if the process is still running. A process owned by another user can't be signalled, but does exist.
+bool isRunning( pid_t pid )
+{
+	return pid > 0 && ( kill( pid, 0 ) == 0 || errno == EPERM );
+}
+
+} // namespace
+
+WarpRemote::WarpRemote( const std::string &name )
+	: mName( name )
+	, mRing( nullptr )
+	, mSocket( -1 )
+	, mNumMessages( 0 )
+	, mNumRejected( 0 )
+{
+	char shm[256];
+	warp_remote_shm_name( mName.c_str(), shm, sizeof( shm ) );
+
+	int fd = shm_open( shm, O_CREAT | O_EXCL | O_RDWR, 0600 );
+	if( fd < 0 && errno == EEXIST ) {
+		// only take over an endpoint left behind by an application that is gone
+		const pid_t owner = getOwner( shm );
+		if( isRunning( owner ) )
+			throw std::runtime_error( "WarpRemote: endpoint '" + mName + "' is in use by process " + std::to_string( owner ) );
+
+		shm_unlink( shm );
+		fd = shm_open( shm, O_CREAT | O_EXCL | O_RDWR, 0600 );
+	}
+
+	if( fd < 0 )
+		throw std::runtime_error( "WarpRemote: failed to create shared memory: " + std::string( strerror( errno ) ) );
+
+	void *ptr = MAP_FAILED;
+	if( ftruncate( fd, sizeof( warp_remote_ring ) ) == 0 )
+		ptr = mmap( nullptr, sizeof( warp_remote_ring ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if( ptr == MAP_FAILED ) {
+		const std::string error = strerror( errno );
+		shm_unlink( shm );
+		throw std::runtime_error( "WarpRemote: failed to map shared memory: " + error );
+	}
+
+	// claim the endpoint before anything else, an endpoint without an owner is considered stale
+	mRing = static_cast<warp_remote_ring *>( ptr );
+	__atomic_store_n( &mRing->owner, uint32_t( getpid() ), __ATOMIC_RELEASE );
+
+	// publish the path of the notification socket
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	warp_remote_socket_path( mName.c_str(), addr.sun_path, sizeof( addr.sun_path ) );
+	mSocketPath = addr.sun_path;
+	std::strncpy( mRing->socket_path, addr.sun_path, WARP_REMOTE_PATH_SIZE - 1 );
+
+	// the memory is zero-initialized, every slot starts out writable at its own position
+	mRing->version = WARP_REMOTE_VERSION;
+	mRing->capacity = WARP_REMOTE_CAPACITY;
+	mRing->slot_size = sizeof( warp_remote_slot );
+	for( uint32_t i = 0; i < WARP_REMOTE_CAPACITY; ++i )
+		mRing->slots[i].sequence = i;
+
+	// clients check the magic number, so write it last
+	__atomic_store_n( &mRing->magic, WARP_REMOTE_MAGIC, __ATOMIC_RELEASE );
+
+	// create the notification socket, a socket with the same path belongs to the previous owner of the endpoint
+	unlink( addr.sun_path );
+
+	mSocket = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	if( mSocket < 0 || bind( mSocket, reinterpret_cast<sockaddr *>( &addr ), sizeof( addr ) ) != 0 ) {
+		const std::string error = strerror( errno );
+		release();
+		throw std::runtime_error( "WarpRemote: failed to create socket: " + error );
+	}
+
+	fcntl( mSocket, F_SETFL, fcntl( mSocket, F_GETFL ) | O_NONBLOCK );
+}
+
+WarpRemote::~WarpRemote()
+{
+	release();
+}
+
+void WarpRemote::release()
+{
+	if( mSocket >= 0 ) {
+		unlink( mSocketPath.c_str() );
+
+		close( mSocket );
+		mSocket = -1;
+	}
+
+	if( mRing ) {
+		char shm[256];
+		warp_remote_shm_name( mName.c_str(), shm, sizeof( shm ) );
+		shm_unlink( shm );
+
+		munmap( mRing, sizeof( warp_remote_ring ) );
+		mRing = nullptr;
+	}
+}
+
+size_t WarpRemote::update( WarpList &warps )
+{
+	// discard notifications, the ring itself tells us what to do
+	char buffer[64];
+	while( recv( mSocket, buffer, sizeof( buffer ), 0 ) > 0 )
+		;
+
+	mPoints.resize( warps.size() );
+
+	size_t count = 0;
+	for( ;; ) {
+		// a slot can be read once its sequence is one past the position
+		const uint64_t tail = mRing->tail;
+		auto &         slot = mRing->slots[tail & ( WARP_REMOTE_CAPACITY - 1 )];
+		if( __atomic_load_n( &slot.sequence, __ATOMIC_ACQUIRE ) != tail + 1 )
+			break;
+
+		apply( warps, slot );
+
+		// hand the slot back to the clients
+		__atomic_store_n( &slot.sequence, tail + WARP_REMOTE_CAPACITY, __ATOMIC_RELEASE );
+		__atomic_store_n( &mRing->tail, tail + 1, __ATOMIC_RELEASE );
+
+		++count;
+	}
+
+	// change the control points of each warp only once
+	for( size_t i = 0; i < warps.size(); ++i ) {
+		if( mPoints[i].empty() )
+			continue;
+
+		warps[i]->setControlPoints( mPoints[i] );
+		mPoints[i].clear();
+	}
+
+	mNumMessages += count;
+
+	return count;
+}
+
+bool WarpRemote::wait( double timeout ) const
+{
+	pollfd fd = {};
+	fd.fd = mSocket;
+	fd.events = POLLIN;
+
+	return poll( &fd, 1, int( timeout * 1000.0 ) ) > 0;
+}
+
+void WarpRemote::apply( WarpList &warps, const warp_remote_slot &slot )
+{
+	if( slot.warp >= warps.size() || slot.count > WARP_REMOTE_MAX_POINTS ) {
+		++mNumRejected;
+		return;
+	}
+
+	const auto &warp = warps[slot.warp];
+	auto &      points = mPoints[slot.warp];
+
+	// start from the current control points
+	if( points.empty() && slot.type != WARP_REMOTE_BLEND ) {
+		points.resize( warp->getNumControlPoints() );
+		for( unsigned i = 0; i < unsigned( points.size() ); ++i )
+			points[i] = warp->getControlPoint( i );
+	}
+
+	switch( slot.type ) {
+	case WARP_REMOTE_CONTROL_POINTS:
+		for( uint32_t i = 0; i < slot.count; ++i ) {
+			const size_t index = size_t( slot.first ) + i;
+			if( index < points.size() )
+				points[index] = vec2( slot.data[2 * i], slot.data[2 * i + 1] );
+		}
+		break;
+	case WARP_REMOTE_CORNERS: {
+		// perspective warps store their corners in order, the others store their control points column-major
+		const size_t cx = warp->getNumControlsX();
+		const size_t cy = warp->getNumControlsY();
+		size_t       corners[4] = { 0, 1, 2, 3 };
+		if( warp->getType() != Warp::WarpType::PERSPECTIVE ) {
+			corners[1] = ( cx - 1 ) * cy;
+			corners[2] = cx * cy - 1;
+			corners[3] = cy - 1;
+		}
+
+		for( uint32_t i = 0; i < 4; ++i ) {
+			if( corners[i] < points.size() )
+				points[corners[i]] = vec2( slot.data[2 * i], slot.data[2 * i + 1] );
+		}
+	} break;
+	case WARP_REMOTE_BLEND: {
+		warp_remote_blend blend;
+		std::memcpy( &blend, slot.data, sizeof( blend ) );
+
+		warp->setExponent( blend.exponent );
+		warp->setEdges( blend.edges[0], blend.edges[1], blend.edges[2], blend.edges[3] );
+		warp->setGamma( blend.gamma[0], blend.gamma[1], blend.gamma[2] );
+		warp->setLuminance( blend.luminance[0], blend.luminance[1], blend.luminance[2] );
+		warp->setBrightness( blend.brightness );
+	} break;
+	default:
+		++mNumRejected;
+		break;
+	}
+}
+
+} // namespace ph::warping
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WIN32
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "WarpRemoteClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct warp_remote_client {
+	warp_remote_ring *ring;
+	int               socket;
+};
+
+warp_remote_client *warp_remote_connect( const char *name )
+{
+	char shm[256];
+	warp_remote_shm_name( name, shm, sizeof( shm ) );
+
+	const int fd = shm_open( shm, O_RDWR, 0 );
+	if( fd < 0 )
+		return NULL;
+
+	void *ptr = mmap( NULL, sizeof( warp_remote_ring ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( ptr == MAP_FAILED )
+		return NULL;
+
+	warp_remote_ring *ring = (warp_remote_ring *)ptr;
+	if( ring->magic != WARP_REMOTE_MAGIC || ring->version != WARP_REMOTE_VERSION || ring->capacity != WARP_REMOTE_CAPACITY || ring->slot_size != sizeof( warp_remote_slot ) ) {
+		munmap( ptr, sizeof( warp_remote_ring ) );
+		errno = EPROTO;
+		return NULL;
+	}
+
+	warp_remote_client *client = (warp_remote_client *)calloc( 1, sizeof( warp_remote_client ) );
+	if( !client ) {
+		munmap( ptr, sizeof( warp_remote_ring ) );
+		return NULL;
+	}
+
+	client->ring = ring;
+
+	/* notifications are optional, the application also polls the ring every frame */
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	memcpy( addr.sun_path, ring->socket_path, sizeof( addr.sun_path ) < WARP_REMOTE_PATH_SIZE ? sizeof( addr.sun_path ) : WARP_REMOTE_PATH_SIZE );
+	addr.sun_path[sizeof( addr.sun_path ) - 1] = 0;
+
+	client->socket = addr.sun_path[0] ? socket( AF_UNIX, SOCK_DGRAM, 0 ) : -1;
+	if( client->socket >= 0 ) {
+		fcntl( client->socket, F_SETFL, fcntl( client->socket, F_GETFL ) | O_NONBLOCK );
+		if( connect( client->socket, (struct sockaddr *)&addr, sizeof( addr ) ) != 0 ) {
+			close( client->socket );
+			client->socket = -1;
+		}
+	}
+
+	return client;
+}
+
+void warp_remote_disconnect( warp_remote_client *client )
+{
+	if( !client )
+		return;
+
+	if( client->socket >= 0 )
+		close( client->socket );
+
+	munmap( client->ring, sizeof( warp_remote_ring ) );
+	free( client );
+}
+
+/* Bounded multi-producer queue: a slot can be written when its sequence equals the position. */
+static int push( warp_remote_client *client, uint32_t type, uint32_t warp, uint32_t first, uint32_t count, const float *data, size_t size )
+{
+	if( !client ) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	warp_remote_ring *ring = client->ring;
+	warp_remote_slot *slot;
+
+	uint64_t pos = __atomic_load_n( &ring->head, __ATOMIC_RELAXED );
+	for( ;; ) {
+		slot = &ring->slots[pos & ( WARP_REMOTE_CAPACITY - 1 )];
+
+		const uint64_t sequence = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE );
+		const int64_t  diff = (int64_t)( sequence - pos );
+		if( diff == 0 ) {
+			if( __atomic_compare_exchange_n( &ring->head, &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+				break;
+		}
+		else if( diff < 0 ) {
+			errno = EAGAIN;
+			return -1;
+		}
+		else {
+			pos = __atomic_load_n( &ring->head, __ATOMIC_RELAXED );
+		}
+	}
+
+	slot->type = type;
+	slot->warp = warp;
+	slot->first = first;
+	slot->count = count;
+	memcpy( slot->data, data, size );
+
+	__atomic_store_n( &slot->sequence, pos + 1, __ATOMIC_RELEASE );
+
+	/* only wake up the application if it has read everything before this message */
+	if( client->socket >= 0 && __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) == pos ) {
+		const char notification = 0;
+		send( client->socket, &notification, 1, 0 );
+	}
+
+	return 0;
+}
+
+int warp_remote_set_points( warp_remote_client *client, uint32_t warp, uint32_t first, uint32_t count, const float *xy )
+{
+	while( count > 0 ) {
+		const uint32_t n = count < WARP_REMOTE_MAX_POINTS ? count : WARP_REMOTE_MAX_POINTS;
+		if( push( client, WARP_REMOTE_CONTROL_POINTS, warp, first, n, xy, 2 * n * sizeof( float ) ) != 0 )
+			return -1;
+
+		first += n;
+		count -= n;
+		xy += 2 * n;
+	}
+
+	return 0;
+}
+
+int warp_remote_set_corners( warp_remote_client *client, uint32_t warp, const float *xy )
+{
+	return push( client, WARP_REMOTE_CORNERS, warp, 0, 4, xy, 8 * sizeof( float ) );
+}
+
+int warp_remote_set_blend( warp_remote_client *client, uint32_t warp, const warp_remote_blend *blend )
+{
+	return push( client, WARP_REMOTE_BLEND, warp, 0, 0, (const float *)blend, sizeof( warp_remote_blend ) );
+}
+
+#endif /* _WIN32 */
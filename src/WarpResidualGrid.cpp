@@ -0,0 +1,426 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpResidualGrid.h"
+
+#include <cinder/Xml.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+//! Binary representation: the number of levels, then for each level its size and number of blocks, followed by the blocks. Each block
+//! is its position and 64 pairs of floats. All values are 32 bits.
+struct LevelHeader {
+	uint32_t width;
+	uint32_t height;
+	uint32_t numBlocks;
+	uint32_t reserved;
+};
+
+struct BlockHeader {
+	uint32_t bx;
+	uint32_t by;
+};
+
+const size_t kBlockBytes = sizeof( BlockHeader ) + WarpResidualGrid::kBlockSize * WarpResidualGrid::kBlockSize * sizeof( vec2 );
+
+bool isZero( const WarpResidualGrid::Block &block )
+{
+	return std::all_of( block.begin(), block.end(), []( const vec2 &offset ) { return offset == vec2( 0 ); } );
+}
+
+size_t getBlockCount( size_t size )
+{
+	return ( size + WarpResidualGrid::kBlockSize - 1 ) / WarpResidualGrid::kBlockSize;
+}
+
+} // namespace
+
+WarpResidualGridRef WarpResidualGrid::create( size_t width, size_t height, const vec2 *offsets, float threshold )
+{
+	auto grid = create();
+	if( width == 0 || height == 0 || !offsets )
+		return grid;
+
+	const size_t level = grid->addLevel( width, height );
+	width = grid->mLevels[level].width;
+	height = grid->mLevels[level].height;
+
+	for( size_t by = 0; by < getBlockCount( height ); ++by ) {
+		for( size_t bx = 0; bx < getBlockCount( width ); ++bx ) {
+			Block block;
+			block.fill( vec2( 0 ) );
+
+			bool isNeeded = false;
+			for( size_t y = 0; y < kBlockSize && by * kBlockSize + y < height; ++y ) {
+				for( size_t x = 0; x < kBlockSize && bx * kBlockSize + x < width; ++x ) {
+					const vec2 &offset = offsets[( by * kBlockSize + y ) * width + bx * kBlockSize + x];
+					block[y * kBlockSize + x] = offset;
+					isNeeded |= glm::abs( offset.x ) > threshold || glm::abs( offset.y ) > threshold;
+				}
+			}
+
+			if( isNeeded )
+				grid->setBlock( level, bx, by, block );
+		}
+	}
+
+	return grid;
+}
+
+size_t WarpResidualGrid::addLevel( size_t width, size_t height )
+{
+	Level level;
+	level.width = glm::clamp<size_t>( width, 2, kMaxSize );
+	level.height = glm::clamp<size_t>( height, 2, kMaxSize );
+	mLevels.push_back( std::move( level ) );
+
+	return mLevels.size() - 1;
+}
+
+size_t WarpResidualGrid::getNumBlocks() const
+{
+	size_t count = 0;
+	for( const auto &level : mLevels )
+		count += level.blocks.size();
+
+	return count;
+}
+
+vec2 WarpResidualGrid::getOffset( size_t level, size_t x, size_t y ) const
+{
+	const auto &l = mLevels.at( level );
+	if( x >= l.width || y >= l.height )
+		return vec2( 0 );
+
+	return getSample( l, x, y );
+}
+
+void WarpResidualGrid::setOffset( size_t level, size_t x, size_t y, const vec2 &offset )
+{
+	auto &l = mLevels.at( level );
+	if( x >= l.width || y >= l.height )
+		return;
+
+	const auto key = getBlockKey( x / kBlockSize, y / kBlockSize );
+	auto       itr = l.blocks.find( key );
+	if( itr == l.blocks.end() ) {
+		if( offset == vec2( 0 ) )
+			return;
+
+		Block block;
+		block.fill( vec2( 0 ) );
+		itr = l.blocks.emplace( key, block ).first;
+	}
+
+	itr->second[( y % kBlockSize ) * kBlockSize + x % kBlockSize] = offset;
+
+	if( offset == vec2( 0 ) && isZero( itr->second ) )
+		l.blocks.erase( itr );
+}
+
+void WarpResidualGrid::setBlock( size_t level, size_t bx, size_t by, const Block &block )
+{
+	auto &l = mLevels.at( level );
+	if( bx >= getBlockCount( l.width ) || by >= getBlockCount( l.height ) )
+		return;
+
+	if( isZero( block ) )
+		l.blocks.erase( getBlockKey( bx, by ) );
+	else
+		l.blocks[getBlockKey( bx, by )] = block;
+}
+
+vec2 WarpResidualGrid::evaluate( const vec2 &uv ) const
+{
+	vec2 result( 0 );
+	for( const auto &level : mLevels ) {
+		if( level.blocks.empty() )
+			continue;
+
+		// bilinear interpolation between the 4 nearest offsets
+		const float fx = glm::clamp( uv.x, 0.0f, 1.0f ) * float( level.width - 1 );
+		const float fy = glm::clamp( uv.y, 0.0f, 1.0f ) * float( level.height - 1 );
+		const auto  x = glm::min( size_t( fx ), level.width - 2 );
+		const auto  y = glm::min( size_t( fy ), level.height - 2 );
+		const float tx = fx - float( x );
+		const float ty = fy - float( y );
+
+		const vec2 top = glm::mix( getSample( level, x, y ), getSample( level, x + 1, y ), tx );
+		const vec2 bottom = glm::mix( getSample( level, x, y + 1 ), getSample( level, x + 1, y + 1 ), tx );
+		result += glm::mix( top, bottom, ty );
+	}
+
+	return result;
+}
+
+WarpResidualGridRef WarpResidualGrid::flipped( bool horizontal ) const
+{
+	auto grid = create();
+	for( size_t i = 0; i < mLevels.size(); ++i ) {
+		const auto &level = mLevels[i];
+		grid->addLevel( level.width, level.height );
+
+		// the positions of the offsets are mirrored, the offsets themselves are not. See getBlockKey() for the layout of the keys
+		for( const auto &block : level.blocks ) {
+			const size_t bx = block.first & 0xFFFF;
+			const size_t by = block.first >> 16;
+			for( size_t j = 0; j < kBlockSize * kBlockSize; ++j ) {
+				const size_t x = bx * kBlockSize + j % kBlockSize;
+				const size_t y = by * kBlockSize + j / kBlockSize;
+				if( x < level.width && y < level.height )
+					grid->setOffset( i, horizontal ? level.width - 1 - x : x, horizontal ? y : level.height - 1 - y, block.second[j] );
+			}
+		}
+	}
+
+	return grid;
+}
+
+WarpResidualGridRef WarpResidualGrid::transformed( const mat2 &transform ) const
+{
+	auto grid = std::make_shared<WarpResidualGrid>( *this );
+	for( auto &level : grid->mLevels ) {
+		for( auto itr = level.blocks.begin(); itr != level.blocks.end(); ) {
+			for( auto &offset : itr->second )
+				offset = transform * offset;
+
+			// a degenerate transform may clear a block
+			if( isZero( itr->second ) )
+				itr = level.blocks.erase( itr );
+			else
+				++itr;
+		}
+	}
+
+	return grid;
+}
+
+bool WarpResidualGrid::operator==( const WarpResidualGrid &other ) const
+{
+	if( mLevels.size() != other.mLevels.size() )
+		return false;
+
+	for( size_t i = 0; i < mLevels.size(); ++i ) {
+		const auto &a = mLevels[i];
+		const auto &b = other.mLevels[i];
+		if( a.width != b.width || a.height != b.height || a.blocks != b.blocks )
+			return false;
+	}
+
+	return true;
+}
+
+XmlTree WarpResidualGrid::toXml() const
+{
+	XmlTree xml;
+	xml.setTag( "residuals" );
+
+	for( const auto &level : mLevels ) {
+		XmlTree l;
+		l.setTag( "level" );
+		l.setAttribute( "width", level.width );
+		l.setAttribute( "height", level.height );
+
+		for( const auto key : getSortedKeys( level ) ) {
+			// 9 significant digits are enough to restore every float exactly
+			std::string offsets;
+			char        buffer[32];
+			for( const auto &offset : level.blocks.at( key ) ) {
+				std::snprintf( buffer, sizeof( buffer ), offsets.empty() ? "%.9g %.9g" : " %.9g %.9g", offset.x, offset.y );
+				offsets += buffer;
+			}
+
+			XmlTree block;
+			block.setTag( "block" );
+			block.setAttribute( "x", key & 0xFFFF );
+			block.setAttribute( "y", key >> 16 );
+			block.setAttribute( "offsets", offsets );
+			l.push_back( block );
+		}
+
+		xml.push_back( l );
+	}
+
+	return xml;
+}
+
+WarpResidualGridRef WarpResidualGrid::fromXml( const XmlTree &xml )
+{
+	auto grid = create();
+
+	for( auto level = xml.begin( "level" ); level != xml.end(); ++level ) {
+		const auto index = grid->addLevel( level->getAttributeValue<size_t>( "width", 2 ), level->getAttributeValue<size_t>( "height", 2 ) );
+
+		for( auto block = level->begin( "block" ); block != level->end(); ++block ) {
+			Block offsets;
+			if( !parseBlock( block->getAttributeValue<std::string>( "offsets", "" ), offsets ) )
+				throw std::invalid_argument( "invalid offsets in residual block" );
+
+			grid->setBlock( index, block->getAttributeValue<size_t>( "x", 0 ), block->getAttributeValue<size_t>( "y", 0 ), offsets );
+		}
+	}
+
+	return grid;
+}
+
+bool WarpResidualGrid::parseBlock( const std::string &text, Block &block )
+{
+	const char *ptr = text.c_str();
+	for( auto &offset : block ) {
+		for( int i = 0; i < 2; ++i ) {
+			char *end = nullptr;
+			offset[i] = std::strtof( ptr, &end );
+			if( end == ptr )
+				return false;
+			ptr = end;
+		}
+	}
+
+	// nothing but whitespace may follow
+	while( *ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n' )
+		++ptr;
+
+	return *ptr == 0;
+}
+
+size_t WarpResidualGrid::getBinarySize() const
+{
+	size_t size = 2 * sizeof( uint32_t );
+	for( const auto &level : mLevels )
+		size += sizeof( LevelHeader ) + level.blocks.size() * kBlockBytes;
+
+	return size;
+}
+
+void WarpResidualGrid::writeBinary( void *data ) const
+{
+	static_assert( sizeof( vec2 ) == 2 * sizeof( float ), "offsets are written as pairs of floats" );
+
+	auto bytes = static_cast<uint8_t *>( data );
+
+	const uint32_t counts[2] = { uint32_t( mLevels.size() ), 0 };
+	std::memcpy( bytes, counts, sizeof( counts ) );
+	bytes += sizeof( counts );
+
+	for( const auto &level : mLevels ) {
+		const LevelHeader header = { uint32_t( level.width ), uint32_t( level.height ), uint32_t( level.blocks.size() ), 0 };
+		std::memcpy( bytes, &header, sizeof( header ) );
+		bytes += sizeof( header );
+
+		for( const auto key : getSortedKeys( level ) ) {
+			const BlockHeader block = { key & 0xFFFF, key >> 16 };
+			std::memcpy( bytes, &block, sizeof( block ) );
+			std::memcpy( bytes + sizeof( block ), level.blocks.at( key ).data(), kBlockBytes - sizeof( block ) );
+			bytes += kBlockBytes;
+		}
+	}
+}
+
+WarpResidualGridRef WarpResidualGrid::readBinary( const void *data, size_t size )
+{
+	auto bytes = static_cast<const uint8_t *>( data );
+	auto end = bytes + size;
+
+	uint32_t counts[2];
+	if( size < sizeof( counts ) )
+		return WarpResidualGridRef();
+
+	std::memcpy( counts, bytes, sizeof( counts ) );
+	bytes += sizeof( counts );
+
+	auto grid = create();
+	for( uint32_t i = 0; i < counts[0]; ++i ) {
+		LevelHeader header;
+		if( size_t( end - bytes ) < sizeof( header ) )
+			return WarpResidualGridRef();
+
+		std::memcpy( &header, bytes, sizeof( header ) );
+		bytes += sizeof( header );
+
+		if( header.width > kMaxSize || header.height > kMaxSize || uint64_t( header.numBlocks ) * kBlockBytes > uint64_t( end - bytes ) )
+			return WarpResidualGridRef();
+
+		const auto level = grid->addLevel( header.width, header.height );
+		for( uint32_t j = 0; j < header.numBlocks; ++j ) {
+			BlockHeader position;
+			Block       block;
+			std::memcpy( &position, bytes, sizeof( position ) );
+			std::memcpy( block.data(), bytes + sizeof( position ), kBlockBytes - sizeof( position ) );
+			bytes += kBlockBytes;
+
+			grid->setBlock( level, position.bx, position.by, block );
+		}
+	}
+
+	return grid;
+}
+
+uint64_t WarpResidualGrid::hash( uint64_t hash ) const
+{
+	auto add = [&]( const void *data, size_t size ) {
+		auto bytes = static_cast<const uint8_t *>( data );
+		for( size_t i = 0; i < size; ++i )
+			hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+	};
+
+	for( const auto &level : mLevels ) {
+		const uint64_t sizes[] = { level.width, level.height, level.blocks.size() };
+		add( sizes, sizeof( sizes ) );
+
+		for( const auto key : getSortedKeys( level ) ) {
+			add( &key, sizeof( key ) );
+			add( level.blocks.at( key ).data(), sizeof( Block ) );
+		}
+	}
+
+	return hash;
+}
+
+std::vector<uint32_t> WarpResidualGrid::getSortedKeys( const Level &level )
+{
+	std::vector<uint32_t> keys;
+	keys.reserve( level.blocks.size() );
+	for( const auto &block : level.blocks )
+		keys.push_back( block.first );
+
+	std::sort( keys.begin(), keys.end() );
+	return keys;
+}
+
+vec2 WarpResidualGrid::getSample( const Level &level, size_t x, size_t y ) const
+{
+	const auto itr = level.blocks.find( getBlockKey( x / kBlockSize, y / kBlockSize ) );
+	if( itr == level.blocks.end() )
+		return vec2( 0 );
+
+	return itr->second[( y % kBlockSize ) * kBlockSize + x % kBlockSize];
+}
+
+} // namespace ph::warping
@@ -0,0 +1,646 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpSync.h"
+
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#if defined( CINDER_MSW )
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment( lib, "ws2_32.lib" )
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+const uint32_t kMagic = 0x4E595357; // "WSYN"
+const uint8_t  kVersion = 2;
+
+//! Larger warps don't fit in a single datagram and are not synchronized.
+const size_t kMaxValues = 16384;
+//! Largest datagram we send, the maximum payload of a UDP datagram over IPv4.
+const size_t kMaxDatagramSize = 65507;
+
+enum Kind : uint8_t { KEYFRAME = 1, DELTA = 2, REQUEST = 3 };
+
+//! A keyframe is followed by all values and the residual grid of the warp, if any. A delta is followed by runs of changed values: a
+//! start index, a count and the values. Deltas never change the residual grid, a new grid is always sent as a keyframe.
+struct Header {
+	uint32_t magic;
+	uint8_t  version;
+	uint8_t  kind;
+	uint16_t warp;
+	uint64_t sender;
+	uint32_t base;
+	uint32_t revision;
+	uint8_t  type;
+	uint8_t  flags;
+	uint16_t resolution;
+	uint16_t controlsX;
+	uint16_t controlsY;
+	uint32_t count;
+	//! Size in bytes of the residual grid following the values of a keyframe, see WarpResidualGrid::writeBinary().
+	uint32_t residuals;
+};
+
+const uint8_t kLinear = 1;
+const uint8_t kAdaptive = 2;
+
+//! Number of blend values following the control points: brightness, luminance (3), gamma (3), edges (4) and exponent.
+const size_t kNumBlendValues = 12;
+
+//! Quantization ranges. Control points and corners are normalized, but may lie a little outside the content.
+const float kPointMin = -0.5f;
+const float kPointMax = 1.5f;
+
+uint16_t encode( float value, float lo, float hi )
+{
+	return uint16_t( glm::clamp( ( value - lo ) / ( hi - lo ), 0.0f, 1.0f ) * 65535.0f + 0.5f );
+}
+
+float decode( uint16_t value, float lo, float hi )
+{
+	return lo + float( value ) * ( hi - lo ) / 65535.0f;
+}
+
+//! Returns \c TRUE if both residual grids contain the same corrections.
+bool isEqual( const WarpResidualGridConstRef &a, const WarpResidualGridConstRef &b )
+{
+	return a == b || ( a && b && *a == *b );
+}
+
+//! Returns \c TRUE if revision \a a is newer than revision \a b, taking wrap-around into account.
+bool isNewer( uint32_t a, uint32_t b )
+{
+	return int32_t( a - b ) > 0;
+}
+
+#if defined( CINDER_MSW )
+typedef SOCKET Socket;
+typedef DWORD  MulticastOption;
+
+std::string getSocketError()
+{
+	return "error " + std::to_string( WSAGetLastError() );
+}
+
+void closeSocket( Socket s )
+{
+	closesocket( s );
+}
+
+void setNonBlocking( Socket s )
+{
+	u_long enable = 1;
+	ioctlsocket( s, FIONBIO, &enable );
+}
+#else
+typedef int           Socket;
+typedef unsigned char MulticastOption;
+
+std::string getSocketError()
+{
+	return strerror( errno );
+}
+
+void closeSocket( Socket s )
+{
+	close( s );
+}
+
+void setNonBlocking( Socket s )
+{
+	fcntl( s, F_SETFL, fcntl( s, F_GETFL ) | O_NONBLOCK );
+}
+#endif
+
+} // namespace
+
+// ----------------------------------------------------------------------------------------------------------------
+
+WarpSyncUdpTransport::WarpSyncUdpTransport( const std::string &group, uint16_t port )
+	: mSocket( -1 )
+	, mGroup( 0 )
+	, mPort( htons( port ) )
+{
+#if defined( CINDER_MSW )
+	// Winsock is reference counted, every transport holds a reference
+	WSADATA data;
+	if( WSAStartup( MAKEWORD( 2, 2 ), &data ) != 0 )
+		throw std::runtime_error( "WarpSyncUdpTransport: failed to initialize Winsock" );
+#endif
+
+	in_addr address = {};
+	if( inet_pton( AF_INET, group.c_str(), &address ) != 1 ) {
+#if defined( CINDER_MSW )
+		WSACleanup();
+#endif
+		throw std::runtime_error( "WarpSyncUdpTransport: invalid multicast group: " + group );
+	}
+	mGroup = address.s_addr;
+
+	const Socket s = socket( AF_INET, SOCK_DGRAM, 0 );
+	mSocket = s == Socket( -1 ) ? -1 : intptr_t( s );
+	if( mSocket < 0 ) {
+		const std::string error = getSocketError();
+#if defined( CINDER_MSW )
+		WSACleanup();
+#endif
+		throw std::runtime_error( "WarpSyncUdpTransport: failed to create socket: " + error );
+	}
+
+	// allow several processes on the same machine to join the group
+	int enable = 1;
+	setsockopt( s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>( &enable ), sizeof( enable ) );
+#if defined( SO_REUSEPORT )
+	setsockopt( s, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>( &enable ), sizeof( enable ) );
+#endif
+
+	sockaddr_in local = {};
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl( INADDR_ANY );
+	local.sin_port = mPort;
+
+	ip_mreq membership = {};
+	membership.imr_multiaddr.s_addr = mGroup;
+	membership.imr_interface.s_addr = htonl( INADDR_ANY );
+
+	if( bind( s, reinterpret_cast<sockaddr *>( &local ), sizeof( local ) ) != 0
+	    || setsockopt( s, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char *>( &membership ), sizeof( membership ) ) != 0 ) {
+		const std::string error = getSocketError();
+		closeSocket( s );
+#if defined( CINDER_MSW )
+		WSACleanup();
+#endif
+		throw std::runtime_error( "WarpSyncUdpTransport: failed to join multicast group: " + error );
+	}
+
+	// deliver to processes on this machine, but don't leave the local network
+	MulticastOption loop = 1;
+	MulticastOption ttl = 1;
+	setsockopt( s, IPPROTO_IP, IP_MULTICAST_LOOP, reinterpret_cast<const char *>( &loop ), sizeof( loop ) );
+	setsockopt( s, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char *>( &ttl ), sizeof( ttl ) );
+
+	setNonBlocking( s );
+}
+
+WarpSyncUdpTransport::~WarpSyncUdpTransport()
+{
+	closeSocket( Socket( mSocket ) );
+#if defined( CINDER_MSW )
+	WSACleanup();
+#endif
+}
+
+void WarpSyncUdpTransport::send( const void *data, size_t size )
+{
+	sockaddr_in remote = {};
+	remote.sin_family = AF_INET;
+	remote.sin_addr.s_addr = mGroup;
+	remote.sin_port = mPort;
+
+	sendto( Socket( mSocket ), static_cast<const char *>( data ), int( size ), 0, reinterpret_cast<sockaddr *>( &remote ), sizeof( remote ) );
+}
+
+size_t WarpSyncUdpTransport::receive( void *data, size_t capacity )
+{
+	const auto size = recv( Socket( mSocket ), static_cast<char *>( data ), int( capacity ), 0 );
+	return size > 0 ? size_t( size ) : 0;
+}
+
+// ----------------------------------------------------------------------------------------------------------------
+
+#if !defined( CINDER_MSW )
+
+WarpSyncUnixTransport::WarpSyncUnixTransport( const std::string &path, const std::vector<std::string> &peers )
+	: mSocket( -1 )
+	, mPath( path )
+	, mPeers( peers )
+{
+	sockaddr_un local = {};
+	local.sun_family = AF_UNIX;
+	if( mPath.size() >= sizeof( local.sun_path ) )
+		throw std::runtime_error( "WarpSyncUnixTransport: path too long: " + mPath );
+	std::strcpy( local.sun_path, mPath.c_str() );
+
+	// remove a stale socket left behind by a crashed process
+	unlink( local.sun_path );
+
+	mSocket = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	if( mSocket < 0 || bind( mSocket, reinterpret_cast<sockaddr *>( &local ), sizeof( local ) ) != 0 ) {
+		const std::string error = strerror( errno );
+		if( mSocket >= 0 )
+			close( mSocket );
+		throw std::runtime_error( "WarpSyncUnixTransport: failed to create socket: " + error );
+	}
+
+	fcntl( mSocket, F_SETFL, fcntl( mSocket, F_GETFL ) | O_NONBLOCK );
+}
+
+WarpSyncUnixTransport::~WarpSyncUnixTransport()
+{
+	close( mSocket );
+	unlink( mPath.c_str() );
+}
+
+void WarpSyncUnixTransport::send( const void *data, size_t size )
+{
+	// peers that are not running are silently skipped
+	for( const auto &peer : mPeers ) {
+		sockaddr_un remote = {};
+		remote.sun_family = AF_UNIX;
+		if( peer.size() >= sizeof( remote.sun_path ) )
+			continue;
+		std::strcpy( remote.sun_path, peer.c_str() );
+
+		sendto( mSocket, data, size, 0, reinterpret_cast<sockaddr *>( &remote ), sizeof( remote ) );
+	}
+}
+
+size_t WarpSyncUnixTransport::receive( void *data, size_t capacity )
+{
+	const ssize_t size = recv( mSocket, data, capacity, 0 );
+	return size > 0 ? size_t( size ) : 0;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------------------------------------------
+
+WarpSync::WarpSync( const WarpSyncTransportRef &transport )
+	: mTransport( transport )
+	, mTimer( true )
+	, mKeyframeInterval( 1.0 )
+	, mJoinTime( -1.0 )
+	, mKeyframeTime( 0.0 )
+	, mNumSent( 0 )
+	, mNumApplied( 0 )
+	, mNumDropped( 0 )
+{
+	// identifies our own datagrams and breaks ties between keyframes of the same revision
+	std::random_device device;
+	mSender = ( uint64_t( device() ) << 32 ) ^ device();
+
+	mBuffer.resize( kMaxDatagramSize );
+}
+
+void WarpSync::update( WarpList &warps )
+{
+	if( mJoinTime < 0.0 ) {
+		// when joining, ask the other nodes for their warps
+		mJoinTime = mKeyframeTime = mTimer.getSeconds();
+		for( size_t i = 0; i < warps.size(); ++i )
+			sendRequest( uint16_t( i ) );
+	}
+
+	receive( warps );
+	broadcast( warps );
+}
+
+void WarpSync::receive( WarpList &warps )
+{
+	if( mSnapshots.size() < warps.size() )
+		mSnapshots.resize( warps.size() );
+
+	while( const size_t size = mTransport->receive( mBuffer.data(), mBuffer.size() ) ) {
+		if( size < sizeof( Header ) )
+			continue;
+
+		Header header;
+		std::memcpy( &header, mBuffer.data(), sizeof( Header ) );
+		if( header.magic != kMagic || header.version != kVersion || header.sender == mSender || header.warp >= warps.size() )
+			continue;
+
+		const auto &warp = warps[header.warp];
+		auto &      snapshot = mSnapshots[header.warp];
+
+		const uint8_t *payload = mBuffer.data() + sizeof( Header );
+		const size_t   remaining = size - sizeof( Header );
+
+		switch( header.kind ) {
+		case REQUEST:
+			snapshot.keyframe = true;
+			break;
+		case KEYFRAME: {
+			// keep the newest keyframe, or the one of the node with the highest id if they have the same revision
+			if( snapshot.revision != 0 && !isNewer( header.revision, snapshot.revision ) && !( header.revision == snapshot.revision && header.sender > mSender ) )
+				break;
+
+			auto state = warp->getState();
+			if( uint8_t( state.type ) != header.type )
+				break;
+
+			state.controlsX = header.controlsX;
+			state.controlsY = header.controlsY;
+			state.resolution = header.resolution;
+			state.linear = ( header.flags & kLinear ) != 0;
+			state.adaptive = ( header.flags & kAdaptive ) != 0;
+			state.points.resize( state.controlsX * state.controlsY );
+
+			const size_t count = 2 * state.points.size() + kNumBlendValues + 2 * state.corners.size();
+			if( header.count != count || remaining < count * sizeof( uint16_t ) + header.residuals )
+				break;
+
+			// the residual grid replaces ours, a keyframe without one removes it
+			WarpResidualGridConstRef residuals;
+			if( header.residuals > 0 ) {
+				residuals = WarpResidualGrid::readBinary( payload + count * sizeof( uint16_t ), header.residuals );
+				if( !residuals )
+					break;
+			}
+
+			snapshot.values.resize( count );
+			std::memcpy( snapshot.values.data(), payload, count * sizeof( uint16_t ) );
+			for( size_t i = 0; i < count; ++i )
+				dequantize( state, i, snapshot.values[i] );
+
+			state.residuals = residuals;
+
+			warp->setState( state );
+
+			snapshot.revision = header.revision;
+			snapshot.type = state.type;
+			snapshot.controlsX = state.controlsX;
+			snapshot.controlsY = state.controlsY;
+			snapshot.resolution = state.resolution;
+			snapshot.linear = state.linear;
+			snapshot.adaptive = state.adaptive;
+			snapshot.residuals = residuals;
+			snapshot.waiting = false;
+
+			++mNumApplied;
+		} break;
+		case DELTA: {
+			// a delta only applies to the version it was based on, otherwise we need a keyframe
+			bool valid = snapshot.revision == header.base && !snapshot.values.empty();
+
+			// validate the runs before changing anything
+			size_t offset = 0;
+			for( uint32_t run = 0; valid && run < header.count; ++run ) {
+				uint16_t range[2];
+				valid = offset + sizeof( range ) <= remaining;
+				if( valid ) {
+					std::memcpy( range, payload + offset, sizeof( range ) );
+					offset += sizeof( range ) + range[1] * sizeof( uint16_t );
+					valid = size_t( range[0] ) + range[1] <= snapshot.values.size() && offset <= remaining;
+				}
+			}
+
+			if( !valid ) {
+				++mNumDropped;
+				if( !snapshot.waiting ) {
+					sendRequest( header.warp );
+					snapshot.waiting = true;
+				}
+				break;
+			}
+
+			// only change the values in the delta, local changes to other values are kept and broadcast later
+			auto state = warp->getState();
+			if( 2 * state.points.size() + kNumBlendValues + 2 * state.corners.size() != snapshot.values.size() )
+				break;
+
+			offset = 0;
+			for( uint32_t run = 0; run < header.count; ++run ) {
+				uint16_t range[2];
+				std::memcpy( range, payload + offset, sizeof( range ) );
+				offset += sizeof( range );
+
+				std::memcpy( &snapshot.values[range[0]], payload + offset, range[1] * sizeof( uint16_t ) );
+				offset += range[1] * sizeof( uint16_t );
+
+				for( size_t i = range[0]; i < size_t( range[0] ) + range[1]; ++i )
+					dequantize( state, i, snapshot.values[i] );
+			}
+
+			warp->setState( state );
+
+			snapshot.revision = header.revision;
+
+			++mNumApplied;
+		} break;
+		}
+	}
+}
+
+void WarpSync::broadcast( WarpList &warps )
+{
+	const double now = mTimer.getSeconds();
+	const bool   periodic = now - mKeyframeTime >= mKeyframeInterval;
+	const bool   joining = now - mJoinTime < mKeyframeInterval;
+	if( periodic )
+		mKeyframeTime = now;
+
+	mSnapshots.resize( warps.size() );
+
+	for( size_t i = 0; i < warps.size(); ++i ) {
+		const auto state = warps[i]->getState();
+		quantize( state, mValues );
+		if( mValues.size() > kMaxValues )
+			continue;
+
+		const size_t numResidualBytes = state.residuals ? state.residuals->getBinarySize() : 0;
+		if( sizeof( Header ) + mValues.size() * sizeof( uint16_t ) + numResidualBytes > kMaxDatagramSize )
+			continue;
+
+		// give the other nodes one interval to send their version, so we don't overwrite it with ours
+		auto &snapshot = mSnapshots[i];
+		if( joining && snapshot.revision == 0 )
+			continue;
+
+		const bool reshaped = snapshot.type != state.type || snapshot.controlsX != state.controlsX || snapshot.controlsY != state.controlsY
+		                      || snapshot.resolution != state.resolution || snapshot.linear != state.linear || snapshot.adaptive != state.adaptive
+		                      || snapshot.values.size() != mValues.size() || !isEqual( snapshot.residuals, state.residuals );
+
+		if( reshaped ) {
+			// the layout of the values or the residual grid changed, which requires a keyframe
+			snapshot.type = state.type;
+			snapshot.controlsX = state.controlsX;
+			snapshot.controlsY = state.controlsY;
+			snapshot.resolution = state.resolution;
+			snapshot.linear = state.linear;
+			snapshot.adaptive = state.adaptive;
+			snapshot.residuals = state.residuals;
+			snapshot.values.swap( mValues );
+			snapshot.revision++;
+			snapshot.keyframe = true;
+		}
+		else if( snapshot.values != mValues ) {
+			sendDelta( uint16_t( i ), snapshot, mValues );
+			snapshot.values.swap( mValues );
+			snapshot.revision++;
+		}
+
+		if( snapshot.keyframe || periodic ) {
+			sendKeyframe( uint16_t( i ), snapshot );
+			snapshot.keyframe = false;
+			snapshot.waiting = false;
+		}
+	}
+}
+
+void WarpSync::sendKeyframe( uint16_t warp, const Snapshot &snapshot )
+{
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.kind = KEYFRAME;
+	header.warp = warp;
+	header.sender = mSender;
+	header.revision = snapshot.revision;
+	header.type = uint8_t( snapshot.type );
+	header.flags = ( snapshot.linear ? kLinear : 0 ) | ( snapshot.adaptive ? kAdaptive : 0 );
+	header.resolution = uint16_t( snapshot.resolution );
+	header.controlsX = uint16_t( snapshot.controlsX );
+	header.controlsY = uint16_t( snapshot.controlsY );
+	header.count = uint32_t( snapshot.values.size() );
+	header.residuals = snapshot.residuals ? uint32_t( snapshot.residuals->getBinarySize() ) : 0;
+
+	size_t size = sizeof( Header );
+	std::memcpy( mBuffer.data() + size, snapshot.values.data(), snapshot.values.size() * sizeof( uint16_t ) );
+	size += snapshot.values.size() * sizeof( uint16_t );
+
+	// there is an even number of values, so the residual grid is aligned to 4 bytes as writeBinary() requires
+	if( snapshot.residuals ) {
+		snapshot.residuals->writeBinary( mBuffer.data() + size );
+		size += header.residuals;
+	}
+
+	std::memcpy( mBuffer.data(), &header, sizeof( Header ) );
+	mTransport->send( mBuffer.data(), size );
+	++mNumSent;
+}
+
+void WarpSync::sendDelta( uint16_t warp, const Snapshot &snapshot, const std::vector<uint16_t> &values )
+{
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.kind = DELTA;
+	header.warp = warp;
+	header.sender = mSender;
+	header.base = snapshot.revision;
+	header.revision = snapshot.revision + 1;
+	header.type = uint8_t( snapshot.type );
+
+	// write runs of changed values
+	size_t offset = sizeof( Header );
+	for( size_t i = 0; i < values.size(); ) {
+		if( values[i] == snapshot.values[i] ) {
+			++i;
+			continue;
+		}
+
+		size_t end = i + 1;
+		while( end < values.size() && values[end] != snapshot.values[end] )
+			++end;
+
+		const uint16_t range[2] = { uint16_t( i ), uint16_t( end - i ) };
+		std::memcpy( mBuffer.data() + offset, range, sizeof( range ) );
+		offset += sizeof( range );
+		std::memcpy( mBuffer.data() + offset, &values[i], ( end - i ) * sizeof( uint16_t ) );
+		offset += ( end - i ) * sizeof( uint16_t );
+
+		header.count++;
+		i = end;
+	}
+
+	std::memcpy( mBuffer.data(), &header, sizeof( Header ) );
+
+	mTransport->send( mBuffer.data(), offset );
+	++mNumSent;
+}
+
+void WarpSync::sendRequest( uint16_t warp )
+{
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.kind = REQUEST;
+	header.warp = warp;
+	header.sender = mSender;
+
+	mTransport->send( &header, sizeof( Header ) );
+	++mNumSent;
+}
+
+void WarpSync::quantize( const Warp::State &state, std::vector<uint16_t> &values )
+{
+	values.clear();
+	values.reserve( 2 * state.points.size() + kNumBlendValues + 2 * state.corners.size() );
+
+	for( const auto &pt : state.points ) {
+		values.push_back( encode( pt.x, kPointMin, kPointMax ) );
+		values.push_back( encode( pt.y, kPointMin, kPointMax ) );
+	}
+
+	values.push_back( encode( state.brightness, 0.0f, 4.0f ) );
+	for( int i = 0; i < 3; ++i )
+		values.push_back( encode( state.luminance[i], 0.0f, 1.0f ) );
+	for( int i = 0; i < 3; ++i )
+		values.push_back( encode( state.gamma[i], 0.0f, 4.0f ) );
+	for( int i = 0; i < 4; ++i )
+		values.push_back( encode( state.edges[i], 0.0f, 1.0f ) );
+	values.push_back( encode( state.exponent, 1.0f, 100.0f ) );
+
+	for( const auto &pt : state.corners ) {
+		values.push_back( encode( pt.x, kPointMin, kPointMax ) );
+		values.push_back( encode( pt.y, kPointMin, kPointMax ) );
+	}
+}
+
+void WarpSync::dequantize( Warp::State &state, size_t index, uint16_t value )
+{
+	const size_t numPoints = 2 * state.points.size();
+	if( index < numPoints ) {
+		state.points[index / 2][int( index % 2 )] = decode( value, kPointMin, kPointMax );
+		return;
+	}
+
+	index -= numPoints;
+	if( index == 0 )
+		state.brightness = decode( value, 0.0f, 4.0f );
+	else if( index < 4 )
+		state.luminance[int( index - 1 )] = decode( value, 0.0f, 1.0f );
+	else if( index < 7 )
+		state.gamma[int( index - 4 )] = decode( value, 0.0f, 4.0f );
+	else if( index < 11 )
+		state.edges[int( index - 7 )] = decode( value, 0.0f, 1.0f );
+	else if( index == 11 )
+		state.exponent = decode( value, 1.0f, 100.0f );
+	else if( index - kNumBlendValues < 2 * state.corners.size() )
+		state.corners[( index - kNumBlendValues ) / 2][int( index % 2 )] = decode( value, kPointMin, kPointMax );
+}
+
+} // namespace ph::warping
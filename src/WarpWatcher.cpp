@@ -0,0 +1,250 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpWatcher.h"
+#include "WarpBinary.h"
+#include "WarpXmlReader.h"
+
+#include <cinder/app/App.h>
+
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#if defined( __linux__ )
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+//! Editors often save a file in several steps, so we wait until it has been quiet for this long.
+const int kSettleMilliseconds = 50;
+//! Interval between checks of the modification time where inotify is not available, or of whether to stop.
+const int kPollMilliseconds = 250;
+
+//! Checksum of the last version of each file written by ignoreContent(), shared by all watchers.
+std::mutex                      sIgnoredMutex;
+std::map<std::string, uint32_t> sIgnored;
+
+std::string getKey( const fs::path &path )
+{
+	std::error_code ec;
+	const auto      absolute = fs::absolute( path, ec );
+
+	return ( ec ? path : absolute ).lexically_normal().string();
+}
+
+bool isIgnored( const fs::path &path, const std::string &content )
+{
+	std::lock_guard<std::mutex> lock( sIgnoredMutex );
+
+	const auto itr = sIgnored.find( getKey( path ) );
+	return itr != sIgnored.end() && itr->second == crc32( content.data(), content.size() );
+}
+
+} // namespace
+
+WarpWatcher::WarpWatcher( const fs::path &path )
+	: mPath( path )
+	, mIsRunning( true )
+	, mHasPending( false )
+	, mNumReloads( 0 )
+	, mNumChanged( 0 )
+{
+	mThread = std::thread( &WarpWatcher::run, this );
+}
+
+WarpWatcher::~WarpWatcher()
+{
+	mIsRunning = false;
+
+	if( mThread.joinable() )
+		mThread.join();
+}
+
+bool WarpWatcher::update( WarpList &warps )
+{
+	WarpList loaded;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( !mHasPending )
+			return false;
+
+		loaded.swap( mPending );
+		mHasPending = false;
+	}
+
+	const size_t changed = apply( warps, loaded );
+	mNumChanged += changed;
+
+	return changed > 0;
+}
+
+size_t WarpWatcher::apply( WarpList &warps, const WarpList &loaded )
+{
+	// new warps share the context and content size of the existing ones
+	const WarpContextRef context = WarpContext::get( warps );
+	const vec2           size = warps.empty() ? vec2( 0 ) : warps.front()->getSize();
+
+	size_t changed = 0;
+	for( size_t i = 0; i < loaded.size(); ++i ) {
+		if( i < warps.size() && warps[i]->getType() == loaded[i]->getType() ) {
+			// setState() only invalidates the mesh if the geometry changed, blend parameters are passed to the shader
+			const auto state = loaded[i]->getState();
+			if( state != warps[i]->getState() ) {
+				warps[i]->setState( state );
+				changed++;
+			}
+			continue;
+		}
+
+		const WarpRef &warp = loaded[i];
+		warp->setContext( context );
+		warp->resize();
+		if( size.x > 0 && size.y > 0 )
+			warp->setSize( i < warps.size() ? warps[i]->getSize() : size );
+		warp->upload();
+
+		if( i < warps.size() )
+			warps[i] = warp;
+		else
+			warps.push_back( warp );
+
+		changed++;
+	}
+
+	if( warps.size() > loaded.size() ) {
+		changed += warps.size() - loaded.size();
+		warps.resize( loaded.size() );
+	}
+
+	return changed;
+}
+
+void WarpWatcher::ignoreContent( const fs::path &path, const std::string &content )
+{
+	std::lock_guard<std::mutex> lock( sIgnoredMutex );
+	sIgnored[getKey( path )] = crc32( content.data(), content.size() );
+}
+
+void WarpWatcher::run()
+{
+#if defined( __linux__ )
+	// watch the directory rather than the file, because editors often replace the file by renaming a temporary one
+	const fs::path directory = mPath.has_parent_path() ? mPath.parent_path() : fs::path( "." );
+	const auto     filename = mPath.filename().string();
+
+	const int fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( fd < 0 || inotify_add_watch( fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) {
+		app::console() << "WarpWatcher: failed to watch " << directory << std::endl;
+		if( fd >= 0 )
+			close( fd );
+		return;
+	}
+
+	alignas( inotify_event ) char buffer[4096];
+	bool                          isChanged = false;
+
+	while( mIsRunning ) {
+		// wake up regularly to check if we should stop
+		pollfd pfd = { fd, POLLIN, 0 };
+		if( poll( &pfd, 1, isChanged ? kSettleMilliseconds : kPollMilliseconds ) <= 0 ) {
+			if( isChanged ) {
+				isChanged = false;
+				reload();
+			}
+			continue;
+		}
+
+		const ssize_t length = read( fd, buffer, sizeof( buffer ) );
+		for( ssize_t offset = 0; offset < length; ) {
+			const auto *event = reinterpret_cast<const inotify_event *>( buffer + offset );
+			if( event->len > 0 && filename == event->name )
+				isChanged = true;
+
+			offset += sizeof( inotify_event ) + event->len;
+		}
+	}
+
+	close( fd );
+#else
+	std::error_code    ec;
+	fs::file_time_type time = fs::last_write_time( mPath, ec );
+	uintmax_t          size = fs::file_size( mPath, ec );
+	bool               isChanged = false;
+
+	while( mIsRunning ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( isChanged ? kSettleMilliseconds : kPollMilliseconds ) );
+
+		const auto t = fs::last_write_time( mPath, ec );
+		if( ec )
+			continue;
+		const auto s = fs::file_size( mPath, ec );
+		if( ec )
+			continue;
+
+		if( t != time || s != size ) {
+			time = t;
+			size = s;
+			isChanged = true;
+		}
+		else if( isChanged ) {
+			isChanged = false;
+			reload();
+		}
+	}
+#endif
+}
+
+void WarpWatcher::reload()
+{
+	// read a copy rather than mapping the file, another process may truncate it while we parse
+	std::ifstream file( mPath, std::ios::binary );
+	if( !file )
+		return;
+
+	const std::string data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	// applying our own version of the file could revert edits made since it was written
+	if( isIgnored( mPath, data ) )
+		return;
+
+	try {
+		// construct the warps here, so the render thread only has to compare them
+		auto warps = WarpXmlReader::read( data.data(), data.size() );
+
+		std::lock_guard<std::mutex> lock( mMutex );
+		mPending.swap( warps );
+		mHasPending = true;
+		mNumReloads++;
+	}
+	catch( const std::exception &exc ) {
+		// keep the current warps, the file may be saved again shortly
+		app::console() << mPath.string() << ": " << exc.what() << std::endl;
+	}
+}
+
+} // namespace ph::warping
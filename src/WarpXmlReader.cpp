@@ -0,0 +1,662 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpXmlReader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace ci;
+
+namespace ph::warping {
+
+namespace {
+
+bool isNameStart( char c )
+{
+	return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || c == '_' || c == ':' || ( c & 0x80 ) != 0;
+}
+
+bool isNameChar( char c )
+{
+	return isNameStart( c ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '.';
+}
+
+bool isWhitespace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void appendUtf8( std::string &str, unsigned long code )
+{
+	if( code < 0x80 )
+		str += char( code );
+	else if( code < 0x800 ) {
+		str += char( 0xC0 | ( code >> 6 ) );
+		str += char( 0x80 | ( code & 0x3F ) );
+	}
+	else if( code < 0x10000 ) {
+		str += char( 0xE0 | ( code >> 12 ) );
+		str += char( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+		str += char( 0x80 | ( code & 0x3F ) );
+	}
+	else {
+		str += char( 0xF0 | ( code >> 18 ) );
+		str += char( 0x80 | ( ( code >> 12 ) & 0x3F ) );
+		str += char( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+		str += char( 0x80 | ( code & 0x3F ) );
+	}
+}
+
+} // namespace
+
+WarpXmlReader::Exception::Exception( const std::string &message, size_t line, size_t column )
+	: std::runtime_error( "warp settings, line " + std::to_string( line ) + ", column " + std::to_string( column ) + ": " + message )
+	, mLine( line )
+	, mColumn( column )
+{
+}
+
+WarpList WarpXmlReader::read( const DataSourceRef &source )
+{
+	// map the file if possible, otherwise read it into memory
+	MappedFileRef file;
+	if( source->isFilePath() )
+		file = MappedFile::create( source->getFilePath() );
+
+	if( file )
+		return read( static_cast<const char *>( file->getData() ), file->getSize() );
+
+	const auto buffer = source->getBuffer();
+	return read( static_cast<const char *>( buffer->getData() ), buffer->getSize() );
+}
+
+WarpList WarpXmlReader::read( const char *data, size_t size )
+{
+	WarpXmlReader reader( data, size );
+	return reader.parse();
+}
+
+std::vector<WarpXmlReader::Profile> WarpXmlReader::readProfiles( const DataSourceRef &source, std::string *active )
+{
+	// map the file if possible, otherwise read it into memory
+	MappedFileRef file;
+	if( source->isFilePath() )
+		file = MappedFile::create( source->getFilePath() );
+
+	if( file )
+		return readProfiles( static_cast<const char *>( file->getData() ), file->getSize(), active );
+
+	const auto buffer = source->getBuffer();
+	return readProfiles( static_cast<const char *>( buffer->getData() ), buffer->getSize(), active );
+}
+
+std::vector<WarpXmlReader::Profile> WarpXmlReader::readProfiles( const char *data, size_t size, std::string *active )
+{
+	WarpXmlReader reader( data, size );
+	reader.mIsReadingProfiles = true;
+	reader.parse();
+
+	if( active )
+		*active = reader.mActiveProfile;
+
+	return std::move( reader.mProfiles );
+}
+
+std::vector<WarpXmlReader::Range> WarpXmlReader::findMaps( const char *data, size_t size )
+{
+	WarpXmlReader reader( data, size );
+	reader.mIsScanning = true;
+	reader.parse();
+
+	return std::move( reader.mMaps );
+}
+
+WarpRef WarpXmlReader::readMap( const char *data, size_t size, const Range &range )
+{
+	// read the map as if it were part of the first profile
+	WarpXmlReader reader( data, size );
+	reader.mPos = data + range.begin;
+	reader.mEnd = data + std::min( range.end, size );
+	reader.mBaseDepth = 2;
+	reader.mStack = { "warp-config", "profile" };
+	reader.mNumProfiles = 1;
+
+	const auto warps = reader.parse();
+	return warps.empty() ? nullptr : warps.front();
+}
+
+WarpXmlReader::WarpXmlReader( const char *data, size_t size )
+	: mBegin( data )
+	, mPos( data )
+	, mEnd( data + size )
+	, mBaseDepth( 0 )
+	, mIsScanning( false )
+	, mIsReadingProfiles( false )
+	, mNumAttributes( 0 )
+	, mTagPos( data )
+	, mWarpPos( data )
+	, mNumCorners( 0 )
+	, mNumProfiles( 0 )
+	, mInMap( false )
+	, mHasWarp( false )
+	, mInBlend( false )
+	, mHasBlend( false )
+	, mInResiduals( false )
+{
+	// skip the byte order mark
+	if( size >= 3 && std::string_view( data, 3 ) == "\xEF\xBB\xBF" )
+		mPos += 3;
+}
+
+WarpList WarpXmlReader::parse()
+{
+	bool hasRoot = false;
+
+	for( ;; ) {
+		// text content is not used
+		while( mPos < mEnd && *mPos != '<' )
+			++mPos;
+
+		if( mPos >= mEnd )
+			break;
+
+		mTagPos = mPos++;
+		if( mPos >= mEnd )
+			fail( "unexpected end of document" );
+
+		if( *mPos == '?' || *mPos == '!' ) {
+			skipMarkup();
+		}
+		else if( *mPos == '/' ) {
+			++mPos;
+			const auto name = parseName();
+			skipWhitespace();
+			expect( '>' );
+
+			if( mStack.size() <= mBaseDepth )
+				fail( "unexpected </" + std::string( name ) + ">", mTagPos );
+			if( mStack.back() != name )
+				fail( "expected </" + std::string( mStack.back() ) + "> but found </" + std::string( name ) + ">", mTagPos );
+
+			mStack.pop_back();
+			endElement( name, mStack.size() );
+		}
+		else {
+			std::string_view name;
+			const bool       closed = parseStartTag( name );
+
+			if( mStack.size() == mBaseDepth && mBaseDepth > 0 ) {
+				if( hasRoot )
+					fail( "unexpected element <" + std::string( name ) + "> after the map", mTagPos );
+				if( name != "map" )
+					fail( "expected <map> but found <" + std::string( name ) + ">", mTagPos );
+				hasRoot = true;
+			}
+			else if( mStack.empty() ) {
+				if( hasRoot )
+					fail( "unexpected element <" + std::string( name ) + "> after the root element", mTagPos );
+				if( name != "warp-config" )
+					fail( "expected <warp-config> but found <" + std::string( name ) + ">", mTagPos );
+				hasRoot = true;
+			}
+
+			startElement( name, mStack.size() );
+
+			if( closed )
+				endElement( name, mStack.size() );
+			else
+				mStack.push_back( name );
+		}
+	}
+
+	if( mStack.size() != mBaseDepth )
+		fail( "unexpected end of document, <" + std::string( mStack.back() ) + "> is not closed" );
+	if( !hasRoot )
+		fail( mBaseDepth > 0 ? "expected <map>" : "expected <warp-config>" );
+
+	return std::move( mWarps );
+}
+
+bool WarpXmlReader::parseStartTag( std::string_view &name )
+{
+	name = parseName();
+	mNumAttributes = 0;
+
+	for( ;; ) {
+		const char *pos = mPos;
+		skipWhitespace();
+
+		if( mPos >= mEnd )
+			fail( "unexpected end of document" );
+
+		if( *mPos == '/' ) {
+			++mPos;
+			expect( '>' );
+			return true;
+		}
+
+		if( *mPos == '>' ) {
+			++mPos;
+			return false;
+		}
+
+		if( pos == mPos )
+			fail( "expected whitespace, '>' or '/>'" );
+
+		const char *attributePos = mPos;
+		const auto  attributeName = parseName();
+		if( !mIsScanning && find( attributeName ) )
+			fail( "duplicate attribute '" + std::string( attributeName ) + "'", attributePos );
+
+		skipWhitespace();
+		expect( '=' );
+		skipWhitespace();
+
+		// reuse the strings of previous elements
+		if( mNumAttributes == mAttributes.size() )
+			mAttributes.emplace_back();
+
+		auto &attribute = mAttributes[mNumAttributes++];
+		attribute.name = attributeName;
+		parseValue( attribute.value );
+	}
+}
+
+void WarpXmlReader::parseValue( std::string &value )
+{
+	if( mPos >= mEnd || ( *mPos != '"' && *mPos != '\'' ) )
+		fail( "expected a quoted value" );
+
+	const char quote = *mPos++;
+	value.clear();
+
+	if( mIsScanning ) {
+		// the structure doesn't depend on attribute values, and markup is not allowed inside them
+		const auto end = std::string_view( mPos, size_t( mEnd - mPos ) ).find_first_of( quote == '"' ? "\"<" : "'<" );
+		if( end == std::string_view::npos )
+			fail( "unterminated attribute value" );
+
+		mPos += end;
+		if( *mPos == '<' )
+			fail( "'<' is not allowed in attribute values" );
+
+		++mPos;
+		return;
+	}
+
+	for( ;; ) {
+		// copy runs of plain characters at once
+		const char *start = mPos;
+		while( mPos < mEnd && *mPos != quote && *mPos != '&' && *mPos != '<' )
+			++mPos;
+		value.append( start, mPos );
+
+		if( mPos >= mEnd )
+			fail( "unterminated attribute value" );
+
+		if( *mPos == quote ) {
+			++mPos;
+			return;
+		}
+
+		if( *mPos == '<' )
+			fail( "'<' is not allowed in attribute values" );
+
+		// entity reference
+		const char *entity = mPos++;
+		while( mPos < mEnd && *mPos != ';' && mPos - entity < 12 )
+			++mPos;
+		if( mPos >= mEnd || *mPos != ';' )
+			fail( "unterminated entity reference", entity );
+
+		const std::string_view ref( entity + 1, size_t( mPos - entity - 1 ) );
+		++mPos;
+
+		if( ref == "lt" )
+			value += '<';
+		else if( ref == "gt" )
+			value += '>';
+		else if( ref == "amp" )
+			value += '&';
+		else if( ref == "quot" )
+			value += '"';
+		else if( ref == "apos" )
+			value += '\'';
+		else if( ref.size() > 1 && ref[0] == '#' ) {
+			const std::string digits( ref.substr( ref[1] == 'x' ? 2 : 1 ) );
+			char *            end = nullptr;
+			const auto        code = std::strtoul( digits.c_str(), &end, ref[1] == 'x' ? 16 : 10 );
+			if( digits.empty() || *end != 0 || code == 0 || code > 0x10FFFF )
+				fail( "invalid character reference", entity );
+			appendUtf8( value, code );
+		}
+		else
+			fail( "unknown entity '&" + std::string( ref ) + ";'", entity );
+	}
+}
+
+std::string_view WarpXmlReader::parseName()
+{
+	const char *start = mPos;
+	if( mPos >= mEnd || !isNameStart( *mPos ) )
+		fail( "expected a name" );
+
+	while( mPos < mEnd && isNameChar( *mPos ) )
+		++mPos;
+
+	return std::string_view( start, size_t( mPos - start ) );
+}
+
+void WarpXmlReader::skipMarkup()
+{
+	const std::string_view rest( mPos, size_t( mEnd - mPos ) );
+	if( rest.substr( 0, 3 ) == "!--" )
+		skipPast( "-->" );
+	else if( rest.substr( 0, 8 ) == "![CDATA[" )
+		skipPast( "]]>" );
+	else if( rest[0] == '?' )
+		skipPast( "?>" );
+	else {
+		// declaration, which may contain nested markup
+		int depth = 1;
+		while( ++mPos < mEnd && depth > 0 ) {
+			if( *mPos == '<' )
+				++depth;
+			else if( *mPos == '>' )
+				--depth;
+		}
+
+		if( depth > 0 )
+			fail( "unterminated declaration", mTagPos );
+	}
+}
+
+void WarpXmlReader::skipWhitespace()
+{
+	while( mPos < mEnd && isWhitespace( *mPos ) )
+		++mPos;
+}
+
+void WarpXmlReader::skipPast( std::string_view terminator )
+{
+	const std::string_view rest( mPos, size_t( mEnd - mPos ) );
+	const auto             pos = rest.find( terminator );
+	if( pos == std::string_view::npos )
+		fail( "expected '" + std::string( terminator ) + "'", mTagPos );
+
+	mPos += pos + terminator.size();
+}
+
+void WarpXmlReader::expect( char c )
+{
+	if( mPos >= mEnd || *mPos != c )
+		fail( std::string( "expected '" ) + c + "'" );
+
+	++mPos;
+}
+
+void WarpXmlReader::startElement( std::string_view name, size_t depth )
+{
+	if( mIsScanning ) {
+		if( depth == 2 && name == "map" && mStack[1] == "profile" && mNumProfiles == 1 )
+			mMaps.push_back( { size_t( mTagPos - mBegin ), 0 } );
+		else if( depth == 1 && name == "profile" )
+			++mNumProfiles;
+		return;
+	}
+
+	// warp-config/profile/map/warp
+	switch( depth ) {
+	case 0:
+		if( mIsReadingProfiles ) {
+			const auto active = find( "profile" );
+			mActiveProfile = active ? *active : std::string();
+		}
+		break;
+	case 1:
+		if( name != "profile" )
+			break;
+
+		++mNumProfiles;
+		if( mIsReadingProfiles ) {
+			const auto profile = find( "name" );
+			mProfiles.push_back( { profile ? *profile : "profile " + std::to_string( mNumProfiles ), WarpList() } );
+		}
+		break;
+	case 2:
+		// unless all profiles are read, only the first profile is loaded
+		mInMap = name == "map" && mStack[1] == "profile" && ( mIsReadingProfiles || mNumProfiles == 1 );
+		mHasWarp = false;
+		break;
+	case 3: {
+		// only the first warp of a map is loaded
+		if( !mInMap || mHasWarp || name != "warp" )
+			break;
+
+		mHasWarp = true;
+
+		// create warp of the correct type, other types are skipped
+		const auto method = find( "method" );
+		if( !method )
+			break;
+		else if( *method == "bilinear" )
+			mWarp = WarpBilinearRef( new WarpBilinear() );
+		else if( *method == "perspective" )
+			mWarp = WarpPerspectiveRef( new WarpPerspective() );
+		else if( *method == "perspective-bilinear" )
+			mWarp = WarpPerspectiveBilinearRef( new WarpPerspectiveBilinear() );
+		else
+			break;
+
+		mWarpPos = mTagPos;
+		mNumCorners = 0;
+		mHasBlend = false;
+		mResiduals.reset();
+
+		const int width = getInt( "width", 2 );
+		const int height = getInt( "height", 2 );
+		if( width < 2 || height < 2 )
+			fail( "a warp requires at least 2x2 control points", mTagPos );
+
+		mState = mWarp->getState();
+		mState.controlsX = size_t( width );
+		mState.controlsY = size_t( height );
+		mState.brightness = getFloat( "brightness", 1.0f );
+		mState.resolution = getInt( "resolution", 16 );
+		mState.linear = getBool( "linear", false );
+		mState.adaptive = getBool( "adaptive", false );
+		mState.points.clear();
+		mState.points.reserve( mState.controlsX * mState.controlsY );
+	} break;
+	case 4:
+		if( !mWarp )
+			break;
+
+		if( name == "control-point" )
+			mState.points.emplace_back( getFloat( "x", 0.0f ), getFloat( "y", 0.0f ) );
+		else if( name == "corner" ) {
+			if( mNumCorners < mState.corners.size() )
+				mState.corners[mNumCorners] = vec2( getFloat( "x", 0.0f ), getFloat( "y", 0.0f ) );
+			++mNumCorners;
+		}
+		else if( name == "blend" && !mHasBlend ) {
+			mHasBlend = mInBlend = true;
+			mState.exponent = getFloat( "exponent", mState.exponent );
+		}
+		else if( name == "residuals" && !mResiduals && mState.type != Warp::WarpType::PERSPECTIVE ) {
+			mResiduals = WarpResidualGrid::create();
+			mInResiduals = true;
+		}
+		break;
+	case 5:
+		if( mInResiduals && name == "level" ) {
+			const int width = getInt( "width", 2 );
+			const int height = getInt( "height", 2 );
+			if( width < 2 || height < 2 || width > int( WarpResidualGrid::kMaxSize ) || height > int( WarpResidualGrid::kMaxSize ) )
+				fail( "invalid size of residual level", mTagPos );
+
+			mResiduals->addLevel( size_t( width ), size_t( height ) );
+			break;
+		}
+		else if( !mInBlend )
+			break;
+
+		if( name == "edges" ) {
+			mState.edges.x = getFloat( "left", mState.edges.x );
+			mState.edges.y = getFloat( "top", mState.edges.y );
+			mState.edges.z = getFloat( "right", mState.edges.z );
+			mState.edges.w = getFloat( "bottom", mState.edges.w );
+		}
+		else if( name == "gamma" ) {
+			mState.gamma.x = getFloat( "red", mState.gamma.x );
+			mState.gamma.y = getFloat( "green", mState.gamma.y );
+			mState.gamma.z = getFloat( "blue", mState.gamma.z );
+		}
+		else if( name == "luminance" ) {
+			mState.luminance.x = getFloat( "red", mState.luminance.x );
+			mState.luminance.y = getFloat( "green", mState.luminance.y );
+			mState.luminance.z = getFloat( "blue", mState.luminance.z );
+		}
+		break;
+	case 6:
+		if( mInResiduals && name == "block" && mStack[5] == "level" ) {
+			const int x = getInt( "x", -1 );
+			const int y = getInt( "y", -1 );
+			const auto offsets = find( "offsets" );
+
+			WarpResidualGrid::Block block;
+			if( x < 0 || y < 0 || !offsets || !WarpResidualGrid::parseBlock( *offsets, block ) )
+				fail( "invalid residual block", mTagPos );
+
+			mResiduals->setBlock( mResiduals->getNumLevels() - 1, size_t( x ), size_t( y ), block );
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void WarpXmlReader::endElement( std::string_view name, size_t depth )
+{
+	if( mIsScanning ) {
+		if( depth == 2 && name == "map" && mStack[1] == "profile" && mNumProfiles == 1 )
+			mMaps.back().end = size_t( mPos - mBegin );
+		return;
+	}
+
+	if( depth == 4 && name == "blend" ) {
+		mInBlend = false;
+	}
+	else if( depth == 4 && name == "residuals" ) {
+		mInResiduals = false;
+	}
+	else if( depth == 3 && name == "warp" && mWarp ) {
+		const size_t expected = mState.controlsX * mState.controlsY;
+		if( mState.points.size() != expected )
+			fail( "warp has " + std::to_string( mState.points.size() ) + " control points, expected " + std::to_string( expected ), mWarpPos );
+		if( mState.type == Warp::WarpType::PERSPECTIVE && expected != 4 )
+			fail( "a perspective warp requires 2x2 control points", mWarpPos );
+
+		if( mResiduals && !mResiduals->isEmpty() )
+			mState.residuals = mResiduals;
+		mResiduals.reset();
+
+		mWarp->setState( mState );
+		if( mIsReadingProfiles )
+			mProfiles.back().warps.push_back( mWarp );
+		else
+			mWarps.push_back( mWarp );
+		mWarp.reset();
+	}
+	else if( depth == 2 && name == "map" ) {
+		mInMap = false;
+	}
+}
+
+const std::string *WarpXmlReader::find( std::string_view name ) const
+{
+	for( size_t i = 0; i < mNumAttributes; ++i ) {
+		if( mAttributes[i].name == name )
+			return &mAttributes[i].value;
+	}
+
+	return nullptr;
+}
+
+float WarpXmlReader::getFloat( std::string_view name, float defaultValue ) const
+{
+	const auto value = find( name );
+	if( !value )
+		return defaultValue;
+
+	char *     end = nullptr;
+	const auto result = std::strtof( value->c_str(), &end );
+	if( value->empty() || end != value->c_str() + value->size() )
+		fail( "invalid number '" + *value + "' for attribute '" + std::string( name ) + "'", mTagPos );
+
+	return result;
+}
+
+int WarpXmlReader::getInt( std::string_view name, int defaultValue ) const
+{
+	const auto value = find( name );
+	if( !value )
+		return defaultValue;
+
+	char *     end = nullptr;
+	const auto result = std::strtol( value->c_str(), &end, 10 );
+	if( value->empty() || end != value->c_str() + value->size() )
+		fail( "invalid integer '" + *value + "' for attribute '" + std::string( name ) + "'", mTagPos );
+
+	return int( result );
+}
+
+bool WarpXmlReader::getBool( std::string_view name, bool defaultValue ) const
+{
+	const auto value = find( name );
+	if( !value )
+		return defaultValue;
+
+	if( *value == "1" || *value == "true" )
+		return true;
+	if( *value == "0" || *value == "false" )
+		return false;
+
+	fail( "invalid boolean '" + *value + "' for attribute '" + std::string( name ) + "'", mTagPos );
+}
+
+void WarpXmlReader::fail( const std::string &message, const char *pos ) const
+{
+	// the position is only needed for errors, so count lines here instead of while parsing
+	size_t      line = 1;
+	const char *lineStart = mBegin;
+	for( const char *p = mBegin; p < pos && p < mEnd; ++p ) {
+		if( *p == '\n' ) {
+			++line;
+			lineStart = p + 1;
+		}
+	}
+
+	throw Exception( message, line, size_t( pos - lineStart ) + 1 );
+}
+
+} // namespace ph::warping
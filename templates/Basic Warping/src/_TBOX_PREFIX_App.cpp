@@ -26,6 +26,9 @@
 #include "cinder/Rand.h"
 
 #include "Warp.h"
+#include "WarpJournal.h"
+#include "WarpLoader.h"
+#include "WarpMeshCache.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -59,6 +62,9 @@ private:
 
 	gl::TextureRef	mImage;
 	WarpList		mWarps;
+	WarpLoaderRef	mLoader;
+	WarpJournalRef	mJournal;
+	WarpMeshCacheRef	mMeshCache;
 
 	Area			mSrcArea;
 };
@@ -74,11 +80,33 @@ void _TBOX_PREFIX_App::setup()
 	updateWindowTitle();
 	disableFrameRate();
 
+	// draw the control points of all warps in a single draw call
+	Warp::enableDeferredControlPoints();
+	// apply mouse moves and drags once per frame
+	Warp::enableInputCoalescing();
+
+	// load test image
+	try {
+		mImage = gl::Texture::create( loadImage( loadAsset( "help.png" ) ), 
+									  gl::Texture2d::Format().loadTopDown().mipmap( true ).minFilter( GL_LINEAR_MIPMAP_LINEAR ) );
+
+		mSrcArea = mImage->getBounds();
+	}
+	catch( const std::exception &e ) {
+		console() << e.what() << std::endl;
+	}
+
 	// initialize warps
 	mSettings = getAssetPath( "" ) / "warps.xml";
+	mMeshCache = WarpMeshCache::create( mSettings );
 	if( fs::exists( mSettings ) ) {
-		// load warp settings from file if one exists
-		mWarps = Warp::readSettings( loadFile( mSettings ) );
+		// load warp settings from file if one exists, computing the meshes on worker threads unless they were cached
+		auto format = WarpLoader::Format().windowSize( getWindowSize() ).meshCache( mMeshCache );
+		if( mImage )
+			format.contentSize( mImage->getSize() );
+
+		mLoader = WarpLoader::create( loadFile( mSettings ), format );
+		mWarps = mLoader->getWarps();
 	}
 	else {
 		// otherwise create a warp from scratch
@@ -87,30 +115,30 @@ void _TBOX_PREFIX_App::setup()
 		mWarps.push_back( WarpPerspectiveBilinear::create() );
 	}
 
-	// load test image
-	try {
-		mImage = gl::Texture::create( loadImage( loadAsset( "help.png" ) ), 
-									  gl::Texture2d::Format().loadTopDown().mipmap( true ).minFilter( GL_LINEAR_MIPMAP_LINEAR ) );
-
-		mSrcArea = mImage->getBounds();
-
-		// adjust the content size of the warps
+	// adjust the content size of the warps
+	if( mImage )
 		Warp::setSize( mWarps, mImage->getSize() );
-	}
-	catch( const std::exception &e ) {
-		console() << e.what() << std::endl;
-	}
+
+	// save edits as they happen and recover the edits of a previous session that crashed
+	mJournal = WarpJournal::create( mSettings );
+	mJournal->recover( mWarps );
 }
 
 void _TBOX_PREFIX_App::cleanup()
 {
 	// save warp settings
-	Warp::writeSettings( mWarps, writeFile( mSettings ) );
+	mJournal->save( mWarps );
+	// and the meshes, so the next launch doesn't have to compute them
+	mMeshCache->save( mWarps );
 }
 
 void _TBOX_PREFIX_App::update()
 {
-	// there is nothing to update
+	// apply the mouse input of this frame to the warps
+	Warp::processInput( mWarps );
+
+	// record the edits, they are written to disk in the background
+	mJournal->update( mWarps );
 }
 
 void _TBOX_PREFIX_App::draw()
@@ -134,7 +162,7 @@ void _TBOX_PREFIX_App::draw()
 				warp->end();
 			}
 			else {
-				// b) simply draw a texture on them (ideal for video)
+				// b) simply draw a texture on them (ideal for video, use warp->draw( luma, chroma ) for NV12 frames)
 
 				// in this demo, we want to draw a specific area of our image,
 				// but if you want to draw the whole image, you can simply use: warp->draw( mImage );
@@ -142,6 +170,19 @@ void _TBOX_PREFIX_App::draw()
 			}
 		}
 	}
+
+	// draw the control points of all warps at once
+	Warp::flushControlPoints();
+
+	// report how long it took to show the first frame
+	if( mLoader ) {
+		mLoader->markFirstFrame();
+
+		const auto &stats = mLoader->getStats();
+		console() << "Loaded " << stats.numWarps << " warps on " << stats.numThreads << " threads (" << stats.numCached << " cached meshes), first frame after " << stats.firstFrame << " seconds" << std::endl;
+
+		mLoader.reset();
+	}
 }
 
 void _TBOX_PREFIX_App::resize()
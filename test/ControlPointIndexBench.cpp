@@ -0,0 +1,122 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Warp.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace ci;
+using namespace ph::warping;
+
+namespace {
+
+//! The linear search that ControlPointIndex replaced, see Warp::selectClosestControlPoint().
+bool findClosestLinear( const WarpList &warps, const vec2 &pos, size_t *warp, unsigned *index, float *distance )
+{
+	*distance = FLT_MAX;
+	for( size_t i = warps.size(); i-- > 0; ) {
+		float          d;
+		const unsigned j = warps[i]->findControlPoint( pos, &d );
+		if( d < *distance ) {
+			*distance = d;
+			*index = j;
+			*warp = i;
+		}
+	}
+
+	return *distance < FLT_MAX;
+}
+
+double getMilliseconds( std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+} // namespace
+
+//! Checks that ControlPointIndex::findClosest() finds the same control points as a linear search, and compares their speed.
+int main( int argc, char *argv[] )
+{
+	const int    kNumWarps = 16;
+	const int    kNumControls = 32;
+	const size_t kNumQueries = 100000;
+
+	std::mt19937                          rng( 1 );
+	std::uniform_real_distribution<float> random( -0.1f, 1.1f );
+
+	WarpList warps;
+	for( int i = 0; i < kNumWarps; ++i ) {
+		auto warp = WarpBilinear::create();
+		warp->setSize( 1920, 1080 );
+		warp->setNumControlX( kNumControls );
+		warp->setNumControlY( kNumControls );
+
+		std::vector<vec2> points( warp->getNumControlPoints() );
+		for( auto &pt : points )
+			pt = vec2( random( rng ), random( rng ) );
+		warp->setControlPoints( points );
+
+		warps.push_back( warp );
+	}
+
+	std::vector<vec2> queries( kNumQueries );
+	for( auto &pos : queries )
+		pos = vec2( random( rng ) * 1920, random( rng ) * 1080 );
+
+	ControlPointIndex index;
+
+	auto start = std::chrono::steady_clock::now();
+	index.update( warps );
+	const double updateTime = getMilliseconds( start );
+
+	size_t   numMismatches = 0;
+	size_t   warp, expectedWarp;
+	unsigned point, expectedPoint;
+	float    distance, expectedDistance;
+	for( const auto &pos : queries ) {
+		const bool found = index.findClosest( pos, &warp, &point, &distance );
+		findClosestLinear( warps, pos, &expectedWarp, &expectedPoint, &expectedDistance );
+
+		// points at exactly the same distance may be found in either order
+		if( !found || ( ( warp != expectedWarp || point != expectedPoint ) && distance != expectedDistance ) )
+			++numMismatches;
+	}
+
+	start = std::chrono::steady_clock::now();
+	for( const auto &pos : queries )
+		index.findClosest( pos, &warp, &point, &distance );
+	const double indexTime = getMilliseconds( start );
+
+	start = std::chrono::steady_clock::now();
+	for( const auto &pos : queries )
+		findClosestLinear( warps, pos, &warp, &point, &distance );
+	const double linearTime = getMilliseconds( start );
+
+	std::printf( "%d warps of %dx%d control points, %zu queries\n", kNumWarps, kNumControls, kNumControls, kNumQueries );
+	std::printf( "  index update:   %8.2f ms\n", updateTime );
+	std::printf( "  index queries:  %8.2f ms (%.3f us per query)\n", indexTime, 1000.0 * indexTime / kNumQueries );
+	std::printf( "  linear queries: %8.2f ms (%.3f us per query)\n", linearTime, 1000.0 * linearTime / kNumQueries );
+	std::printf( "  mismatches:     %zu\n", numMismatches );
+
+	return numMismatches == 0 ? 0 : 1;
+}
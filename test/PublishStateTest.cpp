@@ -0,0 +1,135 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Warp.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+using namespace ci;
+using namespace ph::warping;
+
+namespace {
+
+//! Minimal warp that gives the test access to the render thread side of the triple buffer.
+class TestWarp : public Warp {
+  public:
+	TestWarp() = default;
+
+	std::vector<float> getWarpMesh( const Rectf &srcRect ) override { return std::vector<float>(); }
+	void               reset() override {}
+	void               begin() override {}
+	void               end() override {}
+
+	using Warp::draw;
+	void draw( const gl::Texture2dRef &texture, const Area &srcArea, const Rectf &destRect ) override {}
+	void draw( const gl::Texture2dRef &luma, const gl::Texture2dRef &chroma, const Area &srcArea, const Rectf &destRect ) override {}
+	void draw( const WarpCanvasRef &canvas, const Area &srcArea ) override {}
+
+	using Warp::applyPublishedState;
+
+  protected:
+	void draw( bool controls ) override {}
+};
+
+//! Each snapshot stores its sequence number in every control point and in the exponent, so a torn snapshot is easy to detect.
+Warp::State createState( int publisher, int sequence )
+{
+	const float value = float( publisher * 1000000 + sequence );
+
+	Warp::State state;
+	state.controlsX = 16;
+	state.controlsY = 16;
+	state.points.assign( state.controlsX * state.controlsY, vec2( value ) );
+	state.exponent = value;
+
+	return state;
+}
+
+} // namespace
+
+//! Publishes snapshots from 2 threads while the main thread applies them, like a render thread would. Run it under ThreadSanitizer
+//! (WARPING_TSAN) to check publishState() and applyPublishedState() for data races.
+int main( int argc, char *argv[] )
+{
+	const int kNumPublishers = 2;
+	const int kNumStates = 100000;
+
+	auto warp = std::make_shared<TestWarp>();
+
+	std::atomic<int>         numRunning( kNumPublishers );
+	std::vector<std::thread> publishers;
+	for( int p = 0; p < kNumPublishers; ++p ) {
+		publishers.emplace_back( [&, p]() {
+			for( int i = 0; i < kNumStates; ++i )
+				warp->publishState( createState( p, i ) );
+			--numRunning;
+		} );
+	}
+
+	size_t numApplied = 0;
+	size_t numErrors = 0;
+	int    last[kNumPublishers] = { -1, -1 };
+
+	auto check = [&]() {
+		const auto state = warp->getState();
+		const int  publisher = int( state.exponent ) / 1000000;
+		const int  sequence = int( state.exponent ) % 1000000;
+
+		// every control point must belong to the same snapshot
+		for( const auto &pt : state.points ) {
+			if( pt != vec2( state.exponent ) ) {
+				++numErrors;
+				break;
+			}
+		}
+
+		// snapshots of a publisher must arrive in order, although some are skipped
+		if( publisher < 0 || publisher >= kNumPublishers || sequence <= last[publisher] )
+			++numErrors;
+		else
+			last[publisher] = sequence;
+	};
+
+	while( numRunning > 0 ) {
+		if( warp->applyPublishedState() ) {
+			check();
+			++numApplied;
+		}
+	}
+
+	for( auto &thread : publishers )
+		thread.join();
+
+	// the last snapshot published is the final one of its publisher
+	if( warp->applyPublishedState() ) {
+		check();
+		++numApplied;
+	}
+
+	const int lastSequence = int( warp->getState().exponent ) % 1000000;
+	if( lastSequence != kNumStates - 1 )
+		++numErrors;
+
+	std::printf( "%d publishers, %d snapshots each: %zu applied, %zu errors\n", kNumPublishers, kNumStates, numApplied, numErrors );
+
+	return numErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Warp.h"
+
+#include <cinder/BSpline.h>
+
+#include <cstdio>
+#include <random>
+
+using namespace ci;
+using namespace ph::warping;
+
+namespace {
+
+//! Gives the test access to the control points beyond the edges of the grid.
+class TestWarp : public WarpBilinear {
+  public:
+	using WarpBilinear::getPoint;
+};
+
+//! Resamples row \a index (or column, if \a horizontal is \c FALSE) of \a warp to \a n points using BSpline2f, like
+//! WarpBilinear::setNumControlX() and setNumControlY() did before they used their own arc length parameterization.
+std::vector<vec2> resampleWithBSpline( const TestWarp &warp, bool linear, bool horizontal, long index, size_t n )
+{
+	const long count = long( horizontal ? warp.getNumControlsX() : warp.getNumControlsY() );
+	auto       getPoint = [&]( long i ) { return horizontal ? warp.getPoint( i, index ) : warp.getPoint( index, i ); };
+
+	std::vector<vec2> points;
+	if( linear ) {
+		for( long i = 0; i < count; ++i )
+			points.push_back( getPoint( i ) );
+	}
+	else {
+		for( long i = 0; i < count; ++i ) {
+			const vec2 p0 = getPoint( i - 1 );
+			const vec2 p1 = getPoint( i );
+			const vec2 p2 = getPoint( i + 1 );
+			const vec2 p3 = getPoint( i + 2 );
+
+			points.push_back( p1 );
+
+			if( i < count - 1 ) {
+				points.push_back( p1 + ( p2 - p0 ) / 6.0f );
+				points.push_back( p2 - ( p3 - p1 ) / 6.0f );
+			}
+		}
+	}
+
+	const BSpline2f s( points, linear ? 1 : 3, false, true );
+
+	const float length = s.getLength( 0.0f, 1.0f );
+	const float step = 1.0f / ( float( n ) - 1.0f );
+
+	std::vector<vec2> result;
+	for( size_t i = 0; i < n; ++i )
+		result.push_back( s.getPosition( s.getTime( length * i * step ) ) );
+
+	return result;
+}
+
+} // namespace
+
+//! Checks that resampling the control grid gives the same control points as BSpline2f, within a tolerance of 1e-5 in normalized
+//! screen coordinates, for random linear and Catmull-Rom grids.
+int main( int argc, char *argv[] )
+{
+	const float kTolerance = 1e-5f;
+	const int   kNumGrids = 200;
+
+	std::mt19937                          rng( 1 );
+	std::uniform_int_distribution<size_t> randomSize( 2, 12 );
+	std::uniform_real_distribution<float> randomOffset( -0.05f, 0.05f );
+
+	float  maxDeviation[2] = { 0, 0 };
+	size_t numFailures = 0;
+	for( int i = 0; i < kNumGrids; ++i ) {
+		const bool linear = ( i % 2 ) == 1;
+		const bool horizontal = ( i % 4 ) < 2;
+
+		// a random grid, with every control point moved away from its regular position
+		TestWarp warp;
+		warp.setLinear( linear );
+		warp.setNumControlX( randomSize( rng ) );
+		warp.setNumControlY( randomSize( rng ) );
+
+		std::vector<vec2> points( warp.getNumControlPoints() );
+		for( size_t j = 0; j < points.size(); ++j ) {
+			const vec2 regular = warp.getControlPoint( unsigned( j ) );
+			points[j] = regular + vec2( randomOffset( rng ), randomOffset( rng ) );
+		}
+		warp.setControlPoints( points );
+
+		const size_t n = randomSize( rng );
+		const long   count = long( horizontal ? warp.getNumControlsY() : warp.getNumControlsX() );
+
+		std::vector<std::vector<vec2>> expected;
+		for( long index = 0; index < count; ++index )
+			expected.push_back( resampleWithBSpline( warp, linear, horizontal, index, n ) );
+
+		if( horizontal )
+			warp.setNumControlX( n );
+		else
+			warp.setNumControlY( n );
+
+		// control points are stored column by column
+		float deviation = 0;
+		for( long index = 0; index < count; ++index ) {
+			for( size_t j = 0; j < n; ++j ) {
+				const size_t point = horizontal ? j * size_t( count ) + size_t( index ) : size_t( index ) * n + j;
+				deviation = glm::max( deviation, glm::distance( warp.getControlPoint( unsigned( point ) ), expected[index][j] ) );
+			}
+		}
+
+		maxDeviation[linear] = glm::max( maxDeviation[linear], deviation );
+		if( !( deviation <= kTolerance ) )
+			++numFailures;
+	}
+
+	std::printf( "%d grids resampled\n", kNumGrids );
+	std::printf( "  catmull-rom max deviation: %.2e\n", maxDeviation[0] );
+	std::printf( "  linear max deviation:      %.2e\n", maxDeviation[1] );
+	std::printf( "  failures:                  %zu\n", numFailures );
+
+	return numFailures == 0 ? 0 : 1;
+}
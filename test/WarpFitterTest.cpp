@@ -0,0 +1,230 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Warp.h"
+#include "WarpFitter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace ci;
+using namespace ph::warping;
+
+namespace {
+
+//! A sample of the surface drawn by a warp.
+struct Sample {
+	vec2 uv;
+	vec2 xy;
+};
+
+//! Returns a known grid of control points, in the same order as the control points of a warp. The corners can be kept in place.
+std::vector<vec2> getKnownPoints( size_t controlsX, size_t controlsY, bool fixCorners = false )
+{
+	std::vector<vec2> points;
+	for( size_t x = 0; x < controlsX; ++x ) {
+		for( size_t y = 0; y < controlsY; ++y ) {
+			const float u = float( x ) / float( controlsX - 1 );
+			const float v = float( y ) / float( controlsY - 1 );
+
+			const bool isCorner = ( x == 0 || x == controlsX - 1 ) && ( y == 0 || y == controlsY - 1 );
+			if( fixCorners && isCorner )
+				points.emplace_back( u, v );
+			else
+				points.emplace_back( u + 0.05f * std::sin( 3 * v + u ), v + 0.04f * std::cos( 4 * u ) );
+		}
+	}
+
+	return points;
+}
+
+//! Returns the regular grid a new warp starts with.
+std::vector<vec2> getRegularPoints( size_t controlsX, size_t controlsY )
+{
+	std::vector<vec2> points;
+	for( size_t x = 0; x < controlsX; ++x ) {
+		for( size_t y = 0; y < controlsY; ++y )
+			points.emplace_back( float( x ) / float( controlsX - 1 ), float( y ) / float( controlsY - 1 ) );
+	}
+
+	return points;
+}
+
+//! Sets the size, control points and mesh settings of \a warp. The mesh resolution is fine enough to determine every control point.
+void setupWarp( const WarpBilinearRef &warp, const ivec2 &size, size_t controlsX, size_t controlsY, const std::vector<vec2> &points, bool linear )
+{
+	warp->setSize( float( size.x ), float( size.y ) );
+	warp->resize( size );
+
+	auto state = warp->getState();
+	state.controlsX = controlsX;
+	state.controlsY = controlsY;
+	state.points = points;
+	state.linear = linear;
+	state.resolution = 4;
+	warp->setState( state );
+}
+
+//! Samples the vertices of the mesh that \a warp draws, in normalized screen coordinates. The vertices of a perspective-bilinear warp
+//! are drawn in the space of its perspective warp, pass a perspective warp with the same corners to transform them to the screen.
+std::vector<Sample> getMeshSamples( const WarpBilinearRef &warp, const vec2 &windowSize, const WarpPerspectiveRef &perspective = nullptr )
+{
+	// the perspective-bilinear warp doesn't return its mesh, so ask its bilinear part directly
+	const auto vertices = warp->WarpBilinear::getWarpMesh( Rectf( 0, 0, 1, 1 ) );
+	const mat4 transform = perspective ? perspective->getTransform() : mat4( 1 );
+
+	std::vector<Sample> samples;
+	for( size_t i = 0; i + 6 <= vertices.size(); i += 6 ) {
+		vec4 pt = transform * vec4( vertices[i + 0], vertices[i + 1], 0, 1 );
+		if( pt.w != 0 )
+			pt.w = 1 / pt.w;
+		pt *= pt.w;
+
+		samples.push_back( { vec2( vertices[i + 2], vertices[i + 3] ), vec2( pt.x, pt.y ) / windowSize } );
+	}
+
+	return samples;
+}
+
+double getMilliseconds( std::chrono::steady_clock::time_point start )
+{
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+} // namespace
+
+//! Samples the meshes of warps with known control points, fits them with WarpFitter and checks that the control points are recovered.
+int main( int argc, char *argv[] )
+{
+	const float kTolerance = 1e-3f;
+	const ivec2 kWindowSize( 1024, 768 );
+
+	size_t numFailures = 0;
+	for( size_t size : { 8, 16, 32, 64 } ) {
+		for( bool linear : { false, true } ) {
+			const size_t controlsX = size;
+			const size_t controlsY = size * 3 / 4;
+			const auto   known = getKnownPoints( controlsX, controlsY );
+
+			auto warp = WarpBilinear::create();
+			setupWarp( warp, kWindowSize, controlsX, controlsY, known, linear );
+
+			// without regularization, the mesh determines the grid exactly
+			auto fitter = WarpFitter::create( WarpFitter::Format().smoothness( 0 ) );
+			for( const auto &sample : getMeshSamples( warp, vec2( kWindowSize ) ) )
+				fitter->addSample( sample.uv, sample.xy );
+
+			std::vector<vec2> points;
+
+			const auto start = std::chrono::steady_clock::now();
+			const bool solved = fitter->solve( controlsX, controlsY, linear, points );
+			const double solveTime = getMilliseconds( start );
+
+			float maxDistance = 0;
+			for( size_t i = 0; solved && i < points.size(); ++i )
+				maxDistance = glm::max( maxDistance, glm::distance( points[i], known[i] ) );
+
+			const bool passed = solved && points.size() == known.size() && maxDistance < kTolerance && fitter->getError() < kTolerance;
+			if( !passed )
+				++numFailures;
+
+			std::printf( "%2zux%-2zu %-11s %6zu samples: %8.2f ms, rms error %.2e, max control point error %.2e %s\n", controlsX, controlsY,
+			    linear ? "linear" : "catmull-rom", fitter->getNumSamples(), solveTime, fitter->getError(), maxDistance, passed ? "" : "FAILED" );
+		}
+	}
+
+	// sparse samples in one quadrant only: fixed corners must stay at their initial position
+	{
+		auto warp = WarpBilinear::create();
+		setupWarp( warp, kWindowSize, 16, 12, getKnownPoints( 16, 12 ), false );
+
+		auto fitter = WarpFitter::create( WarpFitter::Format().fixCorners() );
+		for( const auto &sample : getMeshSamples( warp, vec2( kWindowSize ) ) ) {
+			if( sample.uv.x < 0.5f && sample.uv.y < 0.5f )
+				fitter->addSample( sample.uv, sample.xy );
+		}
+
+		std::vector<vec2> points;
+		const bool        solved = fitter->solve( 16, 12, false, points );
+		const bool        passed = solved && points.front() == vec2( 0, 0 ) && points.back() == vec2( 1, 1 );
+		if( !passed )
+			++numFailures;
+
+		std::printf( "sparse samples, fixed corners: rms error %.2e %s\n", fitter->getError(), passed ? "" : "FAILED" );
+	}
+
+	// fit() on a bilinear and a perspective-bilinear warp that start as regular grids
+	for( bool perspective : { false, true } ) {
+		const size_t controlsX = 12;
+		const size_t controlsY = 9;
+
+		// the corners of a perspective-bilinear warp are controlled by its perspective warp
+		const std::vector<vec2> corners = { vec2( 0.1f, 0.05f ), vec2( 0.95f, 0.1f ), vec2( 0.9f, 0.9f ), vec2( 0.05f, 0.95f ) };
+
+		WarpBilinearRef    known, fitted;
+		WarpPerspectiveRef transform;
+		if( perspective ) {
+			known = WarpPerspectiveBilinear::create();
+			fitted = WarpPerspectiveBilinear::create();
+
+			transform = WarpPerspective::create();
+			transform->setSize( float( kWindowSize.x ), float( kWindowSize.y ) );
+			transform->setControlPoints( corners );
+		}
+		else {
+			known = WarpBilinear::create();
+			fitted = WarpBilinear::create();
+		}
+
+		setupWarp( known, kWindowSize, controlsX, controlsY, getKnownPoints( controlsX, controlsY, perspective ), false );
+		setupWarp( fitted, kWindowSize, controlsX, controlsY, getRegularPoints( controlsX, controlsY ), false );
+
+		if( perspective ) {
+			for( const auto &warp : { known, fitted } ) {
+				auto state = warp->getState();
+				state.corners = corners;
+				warp->setState( state );
+			}
+		}
+
+		auto fitter = WarpFitter::create( WarpFitter::Format().smoothness( 0 ) );
+		for( const auto &sample : getMeshSamples( known, vec2( kWindowSize ), transform ) )
+			fitter->addSample( sample.uv, sample.xy );
+
+		const bool solved = fitter->fit( fitted );
+
+		// both warps return their control points in normalized screen coordinates
+		float maxDistance = 0;
+		for( unsigned i = 0; solved && i < fitted->getNumControlPoints(); ++i )
+			maxDistance = glm::max( maxDistance, glm::distance( fitted->getControlPoint( i ), known->getControlPoint( i ) ) );
+
+		const bool passed = solved && fitted->getNumControlPoints() == known->getNumControlPoints() && maxDistance < kTolerance;
+		if( !passed )
+			++numFailures;
+
+		std::printf( "fit() %-20s %6zu samples: rms error %.2e, max control point error %.2e %s\n", perspective ? "perspective-bilinear" : "bilinear",
+		    fitter->getNumSamples(), fitter->getError(), maxDistance, passed ? "" : "FAILED" );
+	}
+
+	return numFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpRemote.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace ci;
+using namespace ph::warping;
+
+//! Measures the time from warp_remote_set_points() in a client until WarpRemote::update() has applied the message on the
+//! render thread, which waits for notifications like an idle application would. Also checks that a running application
+//! can't be replaced by a second endpoint with the same name.
+int main( int argc, char *argv[] )
+{
+	const int kNumMessages = 10000;
+
+	const std::string name = "cinder-warping-bench-" + std::to_string( getpid() );
+	auto              remote = WarpRemote::create( name );
+
+	bool replaced = true;
+	try {
+		WarpRemote::create( name );
+	}
+	catch( const std::exception & ) {
+		replaced = false;
+	}
+
+	WarpList warps;
+	warps.push_back( WarpBilinear::create() );
+
+	std::atomic<uint64_t> numApplied( 0 );
+	std::atomic<bool>     done( false );
+	std::vector<double>   latencies;
+	size_t                numTimeouts = 0;
+
+	std::thread client( [&]() {
+		warp_remote_client *connection = warp_remote_connect( name.c_str() );
+		if( connection ) {
+			latencies.reserve( kNumMessages );
+
+			uint64_t numSent = 0;
+			for( int i = 0; i < kNumMessages; ++i ) {
+				const float xy[2] = { float( i % 100 ) / 100.0f, 0.5f };
+
+				const auto start = std::chrono::steady_clock::now();
+				if( warp_remote_set_points( connection, 0, 0, 1, xy ) != 0 ) {
+					++numTimeouts;
+					continue;
+				}
+
+				// wait for the render thread, give up after a second
+				++numSent;
+				while( numApplied.load( std::memory_order_acquire ) < numSent && std::chrono::steady_clock::now() - start < std::chrono::seconds( 1 ) )
+					std::this_thread::yield();
+
+				if( numApplied.load( std::memory_order_acquire ) < numSent )
+					++numTimeouts;
+				else
+					latencies.push_back( std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count() );
+			}
+
+			warp_remote_disconnect( connection );
+		}
+		else {
+			std::perror( "warp_remote_connect" );
+		}
+
+		done = true;
+	} );
+
+	while( !done ) {
+		remote->wait( 0.1 );
+		remote->update( warps );
+		numApplied.store( remote->getNumMessages(), std::memory_order_release );
+	}
+
+	client.join();
+
+	if( latencies.empty() ) {
+		std::printf( "no messages arrived\n" );
+		return 1;
+	}
+
+	std::sort( latencies.begin(), latencies.end() );
+	auto percentile = [&]( double p ) { return latencies[std::min( latencies.size() - 1, size_t( p * latencies.size() ) )]; };
+
+	std::printf( "%zu messages from %s\n", latencies.size(), remote->getSocketPath().c_str() );
+	std::printf( "  median latency: %8.2f us\n", percentile( 0.5 ) );
+	std::printf( "  99th percentile:%8.2f us\n", percentile( 0.99 ) );
+	std::printf( "  maximum:        %8.2f us\n", latencies.back() );
+	std::printf( "  timeouts:       %zu\n", numTimeouts );
+	std::printf( "  rejected:       %llu\n", (unsigned long long)remote->getNumRejected() );
+	std::printf( "  replaced:       %s\n", replaced ? "yes" : "no" );
+
+	return numTimeouts == 0 && remote->getNumRejected() == 0 && !replaced ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/*
+ Copyright (c) 2010-2020, Paul Houx - All rights reserved.
+ This code is intended for use with the Cinder C++ library: http://libcinder.org
+
+ This file is part of Cinder-Warping.
+
+ Cinder-Warping is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Cinder-Warping is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Cinder-Warping.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WarpSync.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ci;
+using namespace ph::warping;
+
+namespace {
+
+const int    kNumControls = 5;
+const double kTimeout = 10.0;
+
+//! Control points of the primary node, which the secondary node should receive.
+vec2 getExpectedPoint( int i )
+{
+	return vec2( float( i % kNumControls ), float( i / kNumControls ) ) / float( kNumControls - 1 ) + vec2( 0.01f * float( i % 3 ), -0.02f );
+}
+
+WarpList createWarps()
+{
+	auto warp = WarpBilinear::create();
+	warp->setNumControlX( kNumControls );
+	warp->setNumControlY( kNumControls );
+
+	return WarpList{ warp };
+}
+
+bool hasExpectedPoints( const WarpRef &warp )
+{
+	if( warp->getNumControlPoints() != kNumControls * kNumControls )
+		return false;
+
+	for( int i = 0; i < kNumControls * kNumControls; ++i ) {
+		const vec2 delta = warp->getControlPoint( unsigned( i ) ) - getExpectedPoint( i );
+		if( std::abs( delta.x ) > WarpSync::kPointTolerance || std::abs( delta.y ) > WarpSync::kPointTolerance )
+			return false;
+	}
+
+	return true;
+}
+
+//! Runs the secondary node: it joins, waits for the control points of the primary node, then changes the brightness.
+int runSecondary( const std::string &path, const std::string &peer )
+{
+	auto warps = createWarps();
+	auto sync = WarpSync::create( WarpSyncUnixTransport::create( path, { peer } ) );
+	sync->setKeyframeInterval( 0.1 );
+
+	Timer timer( true );
+	while( !hasExpectedPoints( warps[0] ) ) {
+		if( timer.getSeconds() > kTimeout ) {
+			std::printf( "secondary: control points did not arrive\n" );
+			return 1;
+		}
+
+		sync->update( warps );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+	}
+
+	std::printf( "secondary: received control points after %.3f s\n", timer.getSeconds() );
+
+	// keep running, so the primary node receives the change
+	warps[0]->setBrightness( 0.5f );
+	for( timer.start(); timer.getSeconds() < 1.0; std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) ) )
+		sync->update( warps );
+
+	return 0;
+}
+
+} // namespace
+
+//! Synchronizes a warp between two processes over Unix domain sockets. The primary node is running when the secondary node
+//! joins, so the secondary node has to ask for a keyframe. Changes made by the secondary node are then sent back as deltas.
+int main( int argc, char *argv[] )
+{
+	const std::string primary = "/tmp/cinder-warping-sync-" + std::to_string( getpid() ) + "-a.sock";
+	const std::string secondary = "/tmp/cinder-warping-sync-" + std::to_string( getpid() ) + "-b.sock";
+
+	auto warps = createWarps();
+	for( int i = 0; i < kNumControls * kNumControls; ++i )
+		warps[0]->setControlPoint( unsigned( i ), getExpectedPoint( i ) );
+
+	auto sync = WarpSync::create( WarpSyncUnixTransport::create( primary, { secondary } ) );
+	sync->setKeyframeInterval( 0.1 );
+
+	// let the primary node finish joining on its own
+	Timer timer( true );
+	while( timer.getSeconds() < 0.3 ) {
+		sync->update( warps );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+	}
+
+	std::fflush( stdout );
+	const pid_t child = fork();
+	if( child < 0 ) {
+		std::perror( "fork" );
+		return 1;
+	}
+
+	// skip the destructors of the objects copied from the parent, they would remove its socket
+	if( child == 0 )
+		_exit( runSecondary( secondary, primary ) );
+
+	bool received = false;
+	for( timer.start(); !received && timer.getSeconds() < kTimeout; std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) ) ) {
+		sync->update( warps );
+		received = std::abs( warps[0]->getBrightness() - 0.5f ) < 1.0e-3f;
+	}
+
+	int status = 0;
+	waitpid( child, &status, 0 );
+	const bool secondaryPassed = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+
+	std::printf( "primary: %s the brightness of the secondary node\n", received ? "received" : "did not receive" );
+	std::printf( "  sent %llu, applied %llu, dropped %llu\n", (unsigned long long)sync->getNumSent(), (unsigned long long)sync->getNumApplied(),
+	             (unsigned long long)sync->getNumDropped() );
+
+	return received && secondaryPassed ? 0 : 1;
+}